@@ -0,0 +1,274 @@
+/**
+ * 线程池任务队列的性能对比
+ *  原来的 mutex + condition_variable 队列、现在共享的 MpmcQueue + EventCount，
+ *  以及工作窃取模式的每线程队列：一半线程入队、一半线程出队，线程数 1 到 64，
+ *  输出每秒出队的元素个数。
+ *  用法：queueBench [元素个数]
+ */
+#include "../constance.h"
+#include "../pool/threadPool/mpmcQueue.h"
+#include "../pool/threadPool/eventCount.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+static const int THREAD_COUNTS[] = {1, 2, 4, 8, 16, 32, 64};
+
+/* user-023 之前线程池使用的队列 */
+class MutexQueue
+{
+public:
+    explicit MutexQueue(int) {}
+
+    void push(long value, int)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            items.push(value);
+        }
+        notEmpty.notify_one();
+    }
+
+    /* 取到 0 表示结束 */
+    long pop(int)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        notEmpty.wait(lock, [this]() { return !items.empty(); });
+        long value = items.front();
+        items.pop();
+        return value;
+    }
+
+    void close(int consumers)
+    {
+        for(int i = 0; i < consumers; ++i)
+        {
+            push(0, i);
+        }
+    }
+
+private:
+    std::mutex mtx;
+    std::condition_variable notEmpty;
+    std::queue<long> items;
+};
+
+/* 和 ThreadPool 的共享队列模式一样：出队先自旋，再通过 EventCount 睡眠 */
+class SharedQueue
+{
+public:
+    explicit SharedQueue(int) : items(TASK_QUEUE_SIZE) {}
+
+    void push(long value, int)
+    {
+        while(!items.push(value))
+        {
+            std::this_thread::yield();
+        }
+        event.notify();
+    }
+
+    long pop(int)
+    {
+        long value;
+        while(true)
+        {
+            for(int i = 0; i < TASK_SPIN_COUNT; ++i)
+            {
+                if(items.pop(value))
+                {
+                    return value;
+                }
+            }
+
+            event.prepareWait();
+            if(items.pop(value))
+            {
+                event.cancelWait();
+                return value;
+            }
+            event.wait();
+        }
+    }
+
+    void close(int consumers)
+    {
+        for(int i = 0; i < consumers; ++i)
+        {
+            push(0, i);
+        }
+    }
+
+private:
+    MpmcQueue<long> items;
+    EventCount event;
+};
+
+/**
+ * 工作窃取模式的简化模型：每个出队线程有自己的队列，入队按 key 分配；
+ * 自己的队列空了在自旋时窃取其他线程的，睡眠只等自己的队列
+ */
+class StealQueue
+{
+public:
+    explicit StealQueue(int consumers) : workers(new Worker[consumers]), count(consumers), closed(false) {}
+
+    void push(long value, int key)
+    {
+        Worker& worker = workers[key % count];
+        while(!worker.items.push(value))
+        {
+            std::this_thread::yield();
+        }
+        worker.event.notify();
+    }
+
+    long pop(int id)
+    {
+        Worker& self = workers[id];
+        long value;
+        while(true)
+        {
+            for(int i = 0; i < TASK_SPIN_COUNT; ++i)
+            {
+                if(self.items.pop(value) || steal(id, value))
+                {
+                    return value;
+                }
+            }
+
+            self.event.prepareWait();
+            if(self.items.pop(value))
+            {
+                self.event.cancelWait();
+                return value;
+            }
+            if(closed)
+            {
+                self.event.cancelWait();
+                return 0;
+            }
+            self.event.wait();
+        }
+    }
+
+    /* 0 可能被别的线程窃取，结束改用标志：入队都已经完成，线程取空自己的队列后才退出 */
+    void close(int)
+    {
+        closed = true;
+        for(int i = 0; i < count; ++i)
+        {
+            workers[i].event.notifyAll();
+        }
+    }
+
+private:
+    bool steal(int id, long& value)
+    {
+        for(int i = 1; i < count; ++i)
+        {
+            if(workers[(id + i) % count].items.pop(value))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct Worker
+    {
+        Worker() : items(WORKER_QUEUE_SIZE) {}
+
+        MpmcQueue<long> items;
+        EventCount event;
+    };
+
+    std::unique_ptr<Worker[]> workers;
+    int count;
+    std::atomic_bool closed;
+};
+
+/* 返回每秒出队的元素个数（百万） */
+template<typename Q>
+static double runQueue(int threads, long count)
+{
+    int producers = std::max(threads / 2, 1);
+    int consumers = std::max(threads - producers, 1);
+    Q queue(consumers);
+    std::atomic<long> sum(0);
+    std::atomic<long> taken(0);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for(int id = 0; id < consumers; ++id)
+    {
+        workers.emplace_back([&, id]()
+        {
+            long local = 0;
+            long n = 0;
+            while(long value = queue.pop(id))
+            {
+                local += value;
+                ++n;
+            }
+            sum += local;
+            taken += n;
+        });
+    }
+
+    std::vector<std::thread> senders;
+    for(int p = 0; p < producers; ++p)
+    {
+        senders.emplace_back([&, p]()
+        {
+            for(long i = p; i < count; i += producers)
+            {
+                queue.push(i + 1, (int)i);
+            }
+        });
+    }
+    for(auto& td : senders)
+    {
+        td.join();
+    }
+
+    queue.close(consumers);
+    for(auto& td : workers)
+    {
+        td.join();
+    }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(sum != count * (count + 1) / 2 || taken != count)
+    {
+        fprintf(stderr, "queue lost items\n");
+        exit(1);
+    }
+    return count / secs / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+    long items = (argc > 1 ? atol(argv[1]) : 4000000);
+
+    printf("%ld items, half producers / half consumers (Mops/s)\n", items);
+    printf("%8s %10s %10s %10s\n", "threads", "mutex", "shared", "steal");
+    for(int threads : THREAD_COUNTS)
+    {
+        double mutex = runQueue<MutexQueue>(threads, items);
+        double shared = runQueue<SharedQueue>(threads, items);
+        double steal = runQueue<StealQueue>(threads, items);
+        printf("%8d %10.2f %10.2f %10.2f\n", threads, mutex, shared, steal);
+    }
+    return 0;
+}
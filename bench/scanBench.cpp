@@ -0,0 +1,168 @@
+/**
+ * 请求行切分的性能对比
+ *  同样的请求放进 ChainBuffer，分别用原来逐字节的 paraseLine 循环
+ *  和现在按块调用 scanLineEnd 的循环切出所有的行，输出每秒处理的请求数。
+ *  用法：scanBench [每种请求的轮数]
+ */
+#include "../buffer/chainBuffer.h"
+#include "../http/httpScan.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+/* 几种典型的请求：命令行工具、浏览器、带长 Cookie 的 POST */
+static const char* const requests[][2] = {
+    {"curl", "GET /index.html HTTP/1.1\r\n"
+             "Host: 127.0.0.1:9006\r\n"
+             "User-Agent: curl/8.5.0\r\n"
+             "Accept: */*\r\n"
+             "\r\n"},
+    {"browser", "GET /picture.html HTTP/1.1\r\n"
+                "Host: 127.0.0.1:9006\r\n"
+                "Connection: keep-alive\r\n"
+                "Cache-Control: max-age=0\r\n"
+                "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+                "sec-ch-ua-mobile: ?0\r\n"
+                "sec-ch-ua-platform: \"Linux\"\r\n"
+                "Upgrade-Insecure-Requests: 1\r\n"
+                "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+                "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8\r\n"
+                "Sec-Fetch-Site: same-origin\r\n"
+                "Sec-Fetch-Mode: navigate\r\n"
+                "Sec-Fetch-User: ?1\r\n"
+                "Sec-Fetch-Dest: document\r\n"
+                "Referer: http://127.0.0.1:9006/welcome.html\r\n"
+                "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+                "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+                "If-None-Match: \"6650a1f2-1b3a\"\r\n"
+                "If-Modified-Since: Fri, 24 May 2024 14:02:26 GMT\r\n"
+                "\r\n"},
+    {"cookie", "POST /2 HTTP/1.1\r\n"
+               "Host: 127.0.0.1:9006\r\n"
+               "Connection: keep-alive\r\n"
+               "Content-Length: 29\r\n"
+               "Content-Type: application/x-www-form-urlencoded\r\n"
+               "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+               "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+               "Origin: http://127.0.0.1:9006\r\n"
+               "Referer: http://127.0.0.1:9006/log.html\r\n"
+               "Cookie: _ga=GA1.1.1234567890.1716559346; _ga_ABCDEF1234=GS1.1.1716559346.1.1.1716559400.0.0.0; "
+               "session=eyJhbGciOiJIUzI1NiIsInR5cCI6IkpXVCJ9.eyJzdWIiOiIxMjM0NTY3ODkwIiwibmFtZSI6IkpvaG4gRG9lIiwiaWF0IjoxNTE2MjM5MDIyfQ."
+               "SflKwRJSMeKKF2QT4fwpMeJf36POk6yJV_adQssw5c; csrftoken=Zq3vL8mN2pR5tY7wB9xC1dF4gH6jK0lM; theme=dark; lang=zh-CN; "
+               "prefs=%7B%22fontSize%22%3A14%2C%22sidebar%22%3Atrue%2C%22notifications%22%3Afalse%7D\r\n"
+               "\r\n"},
+};
+
+/* 原来的 paraseLine：逐字节通过 operator[] 查找 "\r\n"，返回行数，lens 累加行长度 */
+static int splitByteLoop(ChainBuffer& buf, size_t& lens)
+{
+    int lines = 0;
+    size_t lineIdx = 0;
+    size_t readIdx = buf.size();
+    for(size_t curIdx = 0; curIdx < readIdx; ++curIdx)
+    {
+        if(buf[curIdx] == '\r')
+        {
+            if(curIdx + 1 == readIdx || buf[curIdx + 1] != '\n')
+            {
+                return -1;
+            }
+            lens += curIdx - lineIdx;
+            ++lines;
+            ++curIdx;
+            lineIdx = curIdx + 1;
+        }
+        else if(buf[curIdx] == '\n')
+        {
+            return -1;
+        }
+    }
+    return lines;
+}
+
+/* 现在的 paraseLine：按块用 scanLineEnd 查找 '\r' 或 '\n' */
+static int splitScan(ChainBuffer& buf, size_t& lens)
+{
+    int lines = 0;
+    size_t lineIdx = 0;
+    size_t curIdx = 0;
+    size_t readIdx = buf.size();
+    while(curIdx < readIdx)
+    {
+        size_t len = 0;
+        const char* seg = buf.peek(curIdx, &len);
+        size_t pos = scanLineEnd(seg, len);
+        if(pos == len)
+        {
+            curIdx += len;
+            continue;
+        }
+
+        curIdx += pos;
+        if(seg[pos] == '\n' || curIdx + 1 == readIdx || buf[curIdx + 1] != '\n')
+        {
+            return -1;
+        }
+        lens += curIdx - lineIdx;
+        ++lines;
+        curIdx += 2;
+        lineIdx = curIdx;
+    }
+    return lines;
+}
+
+typedef int (*SplitFunc)(ChainBuffer&, size_t&);
+
+/* 返回每秒处理的请求数 */
+static double run(SplitFunc split, ChainBuffer& buf, long rounds, int expectLines)
+{
+    size_t lens = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(long i = 0; i < rounds; ++i)
+    {
+        if(split(buf, lens) != expectLines)
+        {
+            fprintf(stderr, "line count mismatch\n");
+            exit(1);
+        }
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    /* 防止整个循环被优化掉 */
+    if(lens == 0)
+    {
+        fprintf(stderr, "no data\n");
+    }
+    return rounds / secs;
+}
+
+int main(int argc, char* argv[])
+{
+    long rounds = (argc > 1 ? atol(argv[1]) : 2000000);
+
+    printf("%-8s %6s %6s %14s %14s %8s\n", "request", "bytes", "lines", "byte loop/s", "scan/s", "speedup");
+    for(auto& req : requests)
+    {
+        std::string text(req[1]);
+        ChainBuffer buf;
+        if(!buf.append(text.data(), text.size(), text.size() + BUFF_BLOCK_SIZE))
+        {
+            fprintf(stderr, "append failed\n");
+            return 1;
+        }
+
+        size_t lens = 0;
+        int lines = splitByteLoop(buf, lens);
+
+        /* 先各跑一遍预热 */
+        run(splitByteLoop, buf, rounds / 10, lines);
+        run(splitScan, buf, rounds / 10, lines);
+        double byteLoop = run(splitByteLoop, buf, rounds, lines);
+        double scan = run(splitScan, buf, rounds, lines);
+
+        printf("%-8s %6zu %6d %14.0f %14.0f %7.2fx\n", req[0], text.size(), lines, byteLoop, scan, scan / byteLoop);
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "chainBuffer.h"
+#include "../pool/bufferPool/bufferPool.h"
+
+#include <cstring>
+
+ChainBuffer::ChainBuffer() : readPos(0), writePos(0)
+{
+}
+
+ChainBuffer::~ChainBuffer()
+{
+    clear();
+}
+
+void ChainBuffer::copyOut(size_t start, size_t len, char* dst) const
+{
+    size_t pos = readPos + start;
+    while(len > 0)
+    {
+        size_t off = pos % BUFF_BLOCK_SIZE;
+        size_t n = std::min(len, BUFF_BLOCK_SIZE - off);
+        memcpy(dst, blocks[pos / BUFF_BLOCK_SIZE] + off, n);
+        dst += n;
+        pos += n;
+        len -= n;
+    }
+}
+
+std::string ChainBuffer::getString(size_t start, size_t len)
+{
+    std::string str(len, '\0');
+    copyOut(start, len, &str[0]);
+    return str;
+}
+
+bool ChainBuffer::ensureWritable(size_t cap)
+{
+    if(writableBytes() > 0)
+    {
+        return true;
+    }
+
+    if(size() >= cap)
+    {
+        return false;
+    }
+
+    blocks.push_back(BufferPool::getInstance()->get());
+    return true;
+}
+
+bool ChainBuffer::append(const char* data, size_t len, size_t cap)
+{
+    if(size() + len > cap)
+    {
+        return false;
+    }
+
+    while(len > 0)
+    {
+        ensureWritable(cap);
+        size_t n = std::min(len, writableBytes());
+        memcpy(beginWrite(), data, n);
+        hasWritten(n);
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+void ChainBuffer::consume(size_t len)
+{
+    if(len >= size())
+    {
+        clear();
+        return;
+    }
+
+    readPos += len;
+    while(readPos >= (size_t)BUFF_BLOCK_SIZE)
+    {
+        BufferPool::getInstance()->put(blocks.front());
+        blocks.pop_front();
+        readPos -= BUFF_BLOCK_SIZE;
+        writePos -= BUFF_BLOCK_SIZE;
+    }
+}
+
+void ChainBuffer::clear()
+{
+    for(char* block : blocks)
+    {
+        BufferPool::getInstance()->put(block);
+    }
+    blocks.clear();
+    readPos = 0;
+    writePos = 0;
+}
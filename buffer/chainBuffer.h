@@ -0,0 +1,83 @@
+/**
+ * ChainBuffer: 由定长块串起来的读缓冲区
+ *  块从 BufferPool 中取，按需增长，总大小受调用者给出的上限限制。
+ *  下标是相对于可读数据开头的逻辑位置，可以跨块访问。
+ */
+#ifndef CHAINBUFFER_H
+#define CHAINBUFFER_H
+
+#include <deque>
+#include <string>
+#include <cstddef>
+#include <algorithm>
+#include "../constance.h"
+
+class ChainBuffer
+{
+public:
+    ChainBuffer();
+    ~ChainBuffer();
+
+    ChainBuffer(const ChainBuffer&) = delete;
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+
+    /* 可读字节数 */
+    size_t size() const { return writePos - readPos; }
+    bool empty() const { return writePos == readPos; }
+
+    /* 第 idx 个可读字节 */
+    char& operator[](size_t idx)
+    {
+        size_t pos = readPos + idx;
+        return blocks[pos / BUFF_BLOCK_SIZE][pos % BUFF_BLOCK_SIZE];
+    }
+
+    /* 第 start 个可读字节的地址，len 返回同一块内从这里开始的连续字节数 */
+    const char* peek(size_t start, size_t* len) const
+    {
+        size_t pos = readPos + start;
+        size_t off = pos % BUFF_BLOCK_SIZE;
+        *len = std::min(writePos - pos, BUFF_BLOCK_SIZE - off);
+        return blocks[pos / BUFF_BLOCK_SIZE] + off;
+    }
+
+    /* [start, start + len) 是否在同一块内，是的话可以直接用 peek 得到的指针 */
+    bool isContiguous(size_t start, size_t len) const
+    {
+        size_t pos = readPos + start;
+        return len == 0 || pos / BUFF_BLOCK_SIZE == (pos + len - 1) / BUFF_BLOCK_SIZE;
+    }
+
+    /* 把 [start, start + len) 复制到 dst */
+    void copyOut(size_t start, size_t len, char* dst) const;
+
+    /* 取出 [start, start + len) 的数据 */
+    std::string getString(size_t start, size_t len);
+
+    /**
+     * 保证最后一块还有可写空间，需要新块时总大小不能超过 cap。
+     * 返回 false 表示已经达到上限
+     */
+    bool ensureWritable(size_t cap);
+
+    /* 最后一块中可以直接写入的位置和长度 */
+    char* beginWrite() { return blocks.back() + writePos % BUFF_BLOCK_SIZE; }
+    size_t writableBytes() const { return blocks.size() * BUFF_BLOCK_SIZE - writePos; }
+    void hasWritten(size_t len) { writePos += len; }
+
+    /* 追加数据，超过 cap 时不写入并返回 false */
+    bool append(const char* data, size_t len, size_t cap);
+
+    /* 丢弃开头的 len 个字节，用完的块还给缓冲区池 */
+    void consume(size_t len);
+
+    /* 清空并归还所有块 */
+    void clear();
+
+private:
+    std::deque<char*> blocks;
+    size_t readPos;     // 可读数据在第一块中的偏移
+    size_t writePos;    // 可读数据的结尾，相对第一块的开头
+};
+
+#endif
@@ -0,0 +1,452 @@
+#include "fileCache.h"
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstring>
+#include <iostream>
+#include <filesystem>
+#include "../http/mimeType.h"
+#include <zlib.h>
+#ifdef USE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+static const char* encodingNames[ENCODING_COUNT] = { "identity", "gzip", "br" };
+
+FileEntry::FileEntry() : fd(-1), addr(nullptr), compressible(false), bytes(0)
+{
+    memset(&info, 0, sizeof(info));
+    lastModified[0] = '\0';
+    for(Variant& variant : variants)
+    {
+        variant.ready = false;
+        variant.etag[0] = '\0';
+    }
+}
+
+FileEntry::~FileEntry()
+{
+    if(addr)
+    {
+        munmap(addr, info.st_size);
+    }
+    if(fd != -1)
+    {
+        close(fd);
+    }
+}
+
+FileCache::FileCache()
+{
+    totalBytes = 0;
+    maxBytes = FILE_CACHE_MAX_BYTES;
+    maxEntries = FILE_CACHE_MAX_ENTRIES;
+    mapFiles = true;
+    version = 0;
+    inotifyFd = -1;
+    stopFd = -1;
+}
+
+FileCache::~FileCache()
+{
+    stop();
+}
+
+FileCache* FileCache::getInstance()
+{
+    static FileCache fileCache;
+    return &fileCache;
+}
+
+void FileCache::makeValidators(const struct stat& info, ENCODING encoding, char* etag, size_t etagLen,
+    char* lastModified, size_t lastModifiedLen)
+{
+    /* 文件被替换（inode 变化）、修改或截断后 ETag 都会变化；不同编码的内容不同，ETag 也不同 */
+    snprintf(etag, etagLen, "\"%lx-%lx-%lx%s%s\"",
+        (unsigned long)info.st_ino, (unsigned long)info.st_size,
+        (unsigned long)(info.st_mtim.tv_sec * 1000000000L + info.st_mtim.tv_nsec),
+        (encoding == ENCODING_IDENTITY ? "" : "-"),
+        (encoding == ENCODING_IDENTITY ? "" : encodingNames[encoding]));
+
+    struct tm tmInfo;
+    gmtime_r(&info.st_mtime, &tmInfo);
+    strftime(lastModified, lastModifiedLen, "%a, %d %b %Y %H:%M:%S GMT", &tmInfo);
+}
+
+bool FileCache::isCompressible(const std::string& path, off_t size)
+{
+    return size >= (off_t)FILE_COMPRESS_MIN_SIZE && mimeType(path).compressible;
+}
+
+int FileCache::supportedEncodings()
+{
+    int mask = (1 << ENCODING_IDENTITY) | (1 << ENCODING_GZIP);
+    #ifdef USE_BROTLI
+        mask |= (1 << ENCODING_BROTLI);
+    #endif
+    return mask;
+}
+
+bool FileCache::compress(ENCODING encoding, const char* data, size_t len, std::string& out)
+{
+    if(encoding == ENCODING_GZIP)
+    {
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        /* windowBits 加 16 输出 gzip 格式 */
+        if(deflateInit2(&stream, FILE_GZIP_LEVEL, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return false;
+        }
+
+        out.resize(deflateBound(&stream, len));
+        stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        stream.avail_in = len;
+        stream.next_out = reinterpret_cast<Bytef*>(&out[0]);
+        stream.avail_out = out.size();
+
+        int ret = deflate(&stream, Z_FINISH);
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return ret == Z_STREAM_END;
+    }
+
+    #ifdef USE_BROTLI
+    if(encoding == ENCODING_BROTLI)
+    {
+        size_t outLen = BrotliEncoderMaxCompressedSize(len);
+        if(outLen == 0)
+        {
+            return false;
+        }
+
+        out.resize(outLen);
+        if(!BrotliEncoderCompress(FILE_BROTLI_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+            len, reinterpret_cast<const uint8_t*>(data), &outLen, reinterpret_cast<uint8_t*>(&out[0])))
+        {
+            return false;
+        }
+        out.resize(outLen);
+        return true;
+    }
+    #endif
+
+    return false;
+}
+
+void FileCache::buildVariant(FileEntry& entry, ENCODING encoding, size_t length)
+{
+    FileEntry::Variant& variant = entry.variants[encoding];
+    makeValidators(entry.info, encoding, variant.etag, sizeof(variant.etag),
+        entry.lastModified, sizeof(entry.lastModified));
+
+    char header[320];
+    int len = snprintf(header, sizeof(header), "%.*s",
+        (int)entry.contentType.size(), entry.contentType.data());
+    if(encoding != ENCODING_IDENTITY)
+    {
+        len += snprintf(header + len, sizeof(header) - len, "Content-Encoding: %s\r\n", encodingNames[encoding]);
+    }
+    /* 只有原始内容支持范围请求 */
+    if(encoding == ENCODING_IDENTITY)
+    {
+        len += snprintf(header + len, sizeof(header) - len, "Accept-Ranges: bytes\r\n");
+    }
+    /* 同一个 URL 有多种编码，缓存要按 Accept-Encoding 区分 */
+    if(entry.compressible)
+    {
+        len += snprintf(header + len, sizeof(header) - len, "Vary: Accept-Encoding\r\n");
+    }
+    snprintf(header + len, sizeof(header) - len, "ETag: %s\r\nLast-Modified: %s\r\nContent-Length:%ld\r\n",
+        variant.etag, entry.lastModified, (long)length);
+
+    variant.header = header;
+    variant.ready = true;
+}
+
+bool FileCache::init(const std::string& root, bool m_mapFiles, size_t m_maxBytes, int m_maxEntries)
+{
+    mapFiles = m_mapFiles;
+    maxBytes = m_maxBytes;
+    maxEntries = m_maxEntries;
+
+    inotifyFd = inotify_init1(IN_CLOEXEC);
+    stopFd = eventfd(0, EFD_CLOEXEC);
+    if(inotifyFd == -1 || stopFd == -1)
+    {
+        return false;
+    }
+
+    /* 根目录及其子目录，之后新建的子目录不监视，其中的文件也就不缓存 */
+    addWatch(root);
+    std::error_code ec;
+    for(auto it = std::filesystem::recursive_directory_iterator(root, ec);
+        it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+    {
+        if(it->is_directory(ec))
+        {
+            addWatch(it->path().string());
+        }
+    }
+
+    watcher = std::thread(&FileCache::watch, this);
+    return true;
+}
+
+void FileCache::addWatch(const std::string& dir)
+{
+    uint32_t mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO
+        | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF;
+    int wd = inotify_add_watch(inotifyFd, dir.c_str(), mask);
+    if(wd == -1)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> locker(mtx);
+    watchFds[wd] = dir;
+    watchedDirs.insert(dir);
+}
+
+void FileCache::stop()
+{
+    if(watcher.joinable())
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(stopFd, &one, sizeof(one));
+        (void)ret;
+        watcher.join();
+    }
+
+    if(inotifyFd != -1)
+    {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+    if(stopFd != -1)
+    {
+        close(stopFd);
+        stopFd = -1;
+    }
+
+    std::lock_guard<std::mutex> locker(mtx);
+    invalidateAll();
+}
+
+FileEntryPtr FileCache::get(const std::string& path)
+{
+    std::lock_guard<std::mutex> locker(mtx);
+    auto it = entries.find(path);
+    if(it == entries.end())
+    {
+        return nullptr;
+    }
+
+    /* 移到表头 */
+    lru.splice(lru.begin(), lru, it->second);
+    return *it->second;
+}
+
+FileEntryPtr FileCache::load(const std::string& path)
+{
+    std::string dir = path.substr(0, path.find_last_of('/'));
+
+    uint64_t startVersion = 0;
+    bool cacheable = false;
+    {
+        std::lock_guard<std::mutex> locker(mtx);
+        startVersion = version;
+        cacheable = (watchedDirs.count(dir) > 0);
+    }
+
+    FileEntryPtr entry = std::make_shared<FileEntry>();
+    entry->path = path;
+    entry->contentType = mimeType(path).header;
+    entry->fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(entry->fd == -1 || fstat(entry->fd, &entry->info) == -1)
+    {
+        return nullptr;
+    }
+
+    size_t size = entry->info.st_size;
+    cacheable = cacheable && size <= maxBytes / FILE_CACHE_MAX_SHARE;
+
+    if(mapFiles && size > 0)
+    {
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+        if(addr == MAP_FAILED)
+        {
+            return nullptr;
+        }
+        entry->addr = static_cast<char*>(addr);
+    }
+
+    /**
+     * 压缩版本只为能放入缓存的文件生成，否则每次请求都要重新压缩。
+     * sendfile 模式下没有常驻的映射，临时映射一次用来压缩
+     */
+    entry->compressible = cacheable && isCompressible(path, size);
+    entry->bytes = size;
+    if(entry->compressible)
+    {
+        char* data = entry->addr;
+        if(!data)
+        {
+            void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+            data = (addr == MAP_FAILED ? nullptr : static_cast<char*>(addr));
+        }
+
+        for(int i = ENCODING_IDENTITY + 1; data && i < ENCODING_COUNT; ++i)
+        {
+            ENCODING encoding = static_cast<ENCODING>(i);
+            FileEntry::Variant& variant = entry->variants[encoding];
+            if(!(supportedEncodings() & (1 << encoding)) || !compress(encoding, data, size, variant.body))
+            {
+                continue;
+            }
+
+            /* 没有变小的压缩版本不使用 */
+            if(variant.body.size() >= size)
+            {
+                std::string().swap(variant.body);
+                continue;
+            }
+
+            buildVariant(*entry, encoding, variant.body.size());
+            entry->bytes += variant.body.size();
+        }
+
+        if(data && data != entry->addr)
+        {
+            munmap(data, size);
+        }
+    }
+    buildVariant(*entry, ENCODING_IDENTITY, size);
+
+    std::lock_guard<std::mutex> locker(mtx);
+
+    /**
+     * 不放入缓存的情况（这次请求照常使用）：
+     * 加载期间有文件变化、目录没有被监视、文件太大
+     */
+    if(version != startVersion || !cacheable)
+    {
+        return entry;
+    }
+
+    invalidate(path);
+    lru.push_front(entry);
+    entries[path] = lru.begin();
+    totalBytes += entry->bytes;
+    evict();
+
+    return entry;
+}
+
+void FileCache::invalidate(const std::string& path)
+{
+    auto it = entries.find(path);
+    if(it == entries.end())
+    {
+        return;
+    }
+
+    /* 正在发送的连接仍然持有引用，发送完才会真正释放 */
+    totalBytes -= (*it->second)->bytes;
+    lru.erase(it->second);
+    entries.erase(it);
+}
+
+void FileCache::invalidateAll()
+{
+    lru.clear();
+    entries.clear();
+    totalBytes = 0;
+}
+
+void FileCache::evict()
+{
+    while(!lru.empty() && (totalBytes > maxBytes || (int)entries.size() > maxEntries))
+    {
+        invalidate(lru.back()->path);
+    }
+}
+
+void FileCache::watch()
+{
+    /* inotify 事件按 inotify_event 对齐 */
+    alignas(struct inotify_event) char buf[4096];
+
+    pollfd fds[2];
+    fds[0].fd = inotifyFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = stopFd;
+    fds[1].events = POLLIN;
+
+    while(true)
+    {
+        int ret = poll(fds, 2, -1);
+        if(ret < 0)
+        {
+            if(errno == EINTR) continue;
+            break;
+        }
+
+        if(fds[1].revents & POLLIN)
+        {
+            break;
+        }
+
+        ssize_t len = read(inotifyFd, buf, sizeof(buf));
+        if(len <= 0)
+        {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> locker(mtx);
+        ++version;
+
+        for(char* ptr = buf; ptr < buf + len; )
+        {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            /* 事件队列溢出，丢失的事件无法确定，全部失效 */
+            if(event->mask & IN_Q_OVERFLOW)
+            {
+                invalidateAll();
+                continue;
+            }
+
+            auto dir = watchFds.find(event->wd);
+            if(dir == watchFds.end())
+            {
+                continue;
+            }
+
+            if(event->len > 0)
+            {
+                #ifdef debug
+                    std::cout << "file changed: " << dir->second << "/" << event->name << std::endl;
+                #endif
+                invalidate(dir->second + "/" + event->name);
+            }
+            else
+            {
+                /* 目录本身被删除或移走 */
+                invalidateAll();
+            }
+
+            if(event->mask & IN_IGNORED)
+            {
+                watchedDirs.erase(dir->second);
+                watchFds.erase(dir);
+            }
+        }
+    }
+}
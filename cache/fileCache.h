@@ -0,0 +1,125 @@
+/**
+ * FileCache: 静态文件缓存
+ *  以文件路径为键，缓存打开的 fd、映射的内存、stat 信息和回复头，
+ *  条目用 shared_ptr 计数，多个连接共享同一个映射，最后一个引用释放时才关闭。
+ *  rootPath 下的目录由 inotify 监视，文件变化后对应条目失效；
+ *  总字节数和条目数有上限，超过后按 LRU 淘汰。
+ *  文本类文件在加载时生成 gzip（和 brotli）压缩版本，随条目一起失效。
+ */
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <sys/stat.h>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
+#include "../constance.h"
+
+/* 内容编码，值越大优先级越高 */
+enum ENCODING
+{
+    ENCODING_IDENTITY = 0,
+    ENCODING_GZIP,
+    ENCODING_BROTLI,
+    ENCODING_COUNT
+};
+
+struct FileEntry
+{
+    FileEntry();
+    ~FileEntry();
+
+    std::string path;
+    struct stat info;
+    int fd;                     // sendfile 使用，空文件为 -1
+    char* addr;                 // mmap 模式下的映射地址
+
+    char lastModified[32];
+    std::string_view contentType;   // "Content-Type: ...\r\n"，指向编译期的 MIME 表
+    bool compressible;          // 文本类文件，回复都要带 Vary: Accept-Encoding
+    size_t bytes;               // 计入缓存上限的字节数（原文件加压缩版本）
+
+    /* 每种编码一个版本，identity 的内容在 addr/fd，其余在 body 中 */
+    struct Variant
+    {
+        bool ready;             // 没有生成（库不可用或压缩后没有变小）时为 false
+        std::string body;
+        char etag[72];
+        std::string header;     // Content-Type、Content-Encoding、Vary、ETag、Last-Modified 和 Content-Length
+    };
+    Variant variants[ENCODING_COUNT];
+};
+
+typedef std::shared_ptr<FileEntry> FileEntryPtr;
+
+class FileCache
+{
+public:
+    static FileCache* getInstance();
+
+    /* 开始监视 root，mapFiles 为 true 时条目带有 mmap 映射 */
+    bool init(const std::string& root, bool mapFiles, size_t maxBytes, int maxEntries);
+
+    /* 查找缓存，命中时不做任何系统调用 */
+    FileEntryPtr get(const std::string& path);
+
+    /* 打开（并映射）文件，条件允许时放入缓存；失败返回空 */
+    FileEntryPtr load(const std::string& path);
+
+    /* 由文件信息生成 ETag 和 Last-Modified，压缩版本的 ETag 带编码后缀 */
+    static void makeValidators(const struct stat& info, ENCODING encoding, char* etag, size_t etagLen,
+        char* lastModified, size_t lastModifiedLen);
+
+    /* 是否会为这个文件生成压缩版本 */
+    static bool isCompressible(const std::string& path, off_t size);
+
+    /* 编译时可用的编码，按位表示 */
+    static int supportedEncodings();
+
+    /* 停止监视线程 */
+    void stop();
+
+private:
+    FileCache();
+    ~FileCache();
+
+    /* 监视线程：读取 inotify 事件并使条目失效 */
+    void watch();
+    void addWatch(const std::string& dir);
+
+    /* 生成 encoding 版本的 ETag 和回复头 */
+    static void buildVariant(FileEntry& entry, ENCODING encoding, size_t length);
+    /* 压缩 data，失败返回 false */
+    static bool compress(ENCODING encoding, const char* data, size_t len, std::string& out);
+
+    /* 以下需要持有 mtx */
+    void invalidate(const std::string& path);
+    void invalidateAll();
+    void evict();
+
+private:
+    std::mutex mtx;
+    std::list<FileEntryPtr> lru;        // 表头是最近使用的
+    std::unordered_map<std::string, std::list<FileEntryPtr>::iterator> entries;
+    std::unordered_set<std::string> watchedDirs;    // 只缓存被监视目录下的文件
+    std::unordered_map<int, std::string> watchFds;  // inotify wd -> 目录
+
+    size_t totalBytes;
+    size_t maxBytes;
+    int maxEntries;
+    bool mapFiles;
+
+    /* 每次失效加一，加载期间发生过失效的条目不放入缓存 */
+    uint64_t version;
+
+    int inotifyFd;
+    int stopFd;
+    std::thread watcher;
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "config.h"
+
+#include <unistd.h>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <algorithm>
+
+Config::Config()
+{
+    ip = "";
+    port = 0;
+
+    /* 默认每个核一个 reactor，核数超过上限时取上限；-r 显式指定的值才做范围检查 */
+    reactorNum = std::min((int)std::thread::hardware_concurrency(), MAX_REACTOR);
+    if(reactorNum <= 0)
+    {
+        reactorNum = 1;
+    }
+
+    ioBackend = IO_EPOLL;
+
+    backlog = LISTEN_BACKLOG;
+    maxConn = MAX_CONN;
+    maxQueue = MAX_QUEUE_DEPTH;
+    maxRequest = MAX_REQUEST_SIZE;
+    sendMode = SEND_MMAP;
+    tlsPort = 0;
+    workStealing = false;
+    minThreads = POOL_MIN_THREADS;
+    maxThreads = POOL_MAX_THREADS;
+    poolStatus = false;
+}
+
+void Config::usage(const char* prog)
+{
+    std::cout << "usage: " << prog << " <ip> <port> [-r reactorNum] [-i epoll|uring]"
+              << " [-b backlog] [-c maxConn] [-q maxQueue] [-m maxRequest]"
+              << " [-s mmap|sendfile] [-t tlsPort -C certFile -K keyFile] [-w shared|steal]"
+              << " [-p minThreads] [-P maxThreads] [-S]" << std::endl;
+}
+
+bool Config::parseArgs(int argc, char** argv)
+{
+    int opt = 0;
+    const char* str = "r:i:b:c:q:m:s:t:C:K:w:p:P:S";
+    while((opt = getopt(argc, argv, str)) != -1)
+    {
+        switch (opt)
+        {
+            case 'r':
+            {
+                reactorNum = atoi(optarg);
+                break;
+            }
+
+            case 'i':
+            {
+                std::string backend(optarg);
+                if(backend == "epoll")
+                {
+                    ioBackend = IO_EPOLL;
+                }
+                else if(backend == "uring")
+                {
+                    ioBackend = IO_URING;
+                }
+                else
+                {
+                    return false;
+                }
+                break;
+            }
+
+            case 'b':
+            {
+                backlog = atoi(optarg);
+                break;
+            }
+
+            case 'c':
+            {
+                maxConn = atoi(optarg);
+                break;
+            }
+
+            case 'q':
+            {
+                maxQueue = atoi(optarg);
+                break;
+            }
+
+            case 'm':
+            {
+                maxRequest = atoi(optarg);
+                break;
+            }
+
+            case 's':
+            {
+                std::string mode(optarg);
+                if(mode == "mmap")
+                {
+                    sendMode = SEND_MMAP;
+                }
+                else if(mode == "sendfile")
+                {
+                    sendMode = SEND_FILE;
+                }
+                else
+                {
+                    return false;
+                }
+                break;
+            }
+
+            case 't':
+            {
+                tlsPort = atoi(optarg);
+                break;
+            }
+
+            case 'C':
+            {
+                certFile = optarg;
+                break;
+            }
+
+            case 'K':
+            {
+                keyFile = optarg;
+                break;
+            }
+
+            case 'w':
+            {
+                std::string mode(optarg);
+                if(mode == "shared")
+                {
+                    workStealing = false;
+                }
+                else if(mode == "steal")
+                {
+                    workStealing = true;
+                }
+                else
+                {
+                    return false;
+                }
+                break;
+            }
+
+            case 'p':
+            {
+                minThreads = atoi(optarg);
+                break;
+            }
+
+            case 'P':
+            {
+                maxThreads = atoi(optarg);
+                break;
+            }
+
+            case 'S':
+            {
+                poolStatus = true;
+                break;
+            }
+
+            default:
+            {
+                return false;
+            }
+        }
+    }
+
+    /* getopt 会把非选项参数移到最后 */
+    if(argc - optind < 2)
+    {
+        return false;
+    }
+
+    ip = argv[optind];
+    port = atoi(argv[optind + 1]);
+
+    if(reactorNum <= 0 || reactorNum > MAX_REACTOR)
+    {
+        return false;
+    }
+
+    if(backlog <= 0 || maxConn <= 0 || maxConn > MAX_FD || maxQueue <= 0 || maxRequest <= 0)
+    {
+        return false;
+    }
+
+    if(minThreads <= 0 || maxThreads < minThreads || maxThreads > MAX_POOL_THREADS)
+    {
+        return false;
+    }
+
+    /* HTTPS 需要证书和私钥，端口不能和 HTTP 相同 */
+    if(tlsPort < 0 || (tlsPort > 0 && (certFile.empty() || keyFile.empty() || tlsPort == port)))
+    {
+        return false;
+    }
+
+    return true;
+}
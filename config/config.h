@@ -0,0 +1,81 @@
+/**
+ * 服务器启动参数
+ *  用法: ./Webserver <ip> <port> [-r reactorNum] [-i epoll|uring]
+ *                    [-b backlog] [-c maxConn] [-q maxQueue] [-m maxRequest]
+ *                    [-s mmap|sendfile] [-t tlsPort -C certFile -K keyFile] [-w shared|steal]
+ *                    [-p minThreads] [-P maxThreads] [-S]
+ */
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+#include "../constance.h"
+
+/* I/O 后端 */
+enum IO_BACKEND
+{
+    IO_EPOLL = 0,
+    IO_URING
+};
+
+/* 静态文件的发送方式 */
+enum SEND_MODE
+{
+    SEND_MMAP = 0,      // mmap 后和回复头一起 writev
+    SEND_FILE           // 回复头 writev，文件内容 sendfile（io_uring 下为 splice）
+};
+
+class Config
+{
+public:
+    Config();
+    ~Config() {};
+
+    /* 解析命令行参数，失败返回false */
+    bool parseArgs(int argc, char** argv);
+
+    /* 打印用法 */
+    static void usage(const char* prog);
+
+public:
+    std::string ip;
+    int port;
+
+    /* reactor 线程数量，默认等于CPU核数 */
+    int reactorNum;
+
+    /* I/O 后端，默认 epoll */
+    IO_BACKEND ioBackend;
+
+    /* listen 队列长度 */
+    int backlog;
+
+    /* 连接数软上限，超过后直接回复 503 并关闭 */
+    int maxConn;
+
+    /* 线程池排队任务超过该值时暂停 accept，降到一半以下时恢复 */
+    int maxQueue;
+
+    /* 单个请求（含消息体）的最大字节数，读缓冲区按块增长到该值为止 */
+    int maxRequest;
+
+    /* 静态文件发送方式，默认 mmap */
+    SEND_MODE sendMode;
+
+    /* HTTPS 端口，0 表示不监听；证书链和私钥（PEM） */
+    int tlsPort;
+    std::string certFile;
+    std::string keyFile;
+
+    /* 线程池调度方式：所有线程共用一个队列，或者按连接分配到各线程的队列并互相窃取 */
+    bool workStealing;
+
+    /* 线程池的最少（常驻）和最多线程数，中间由排队时间决定 */
+    int minThreads;
+    int maxThreads;
+
+    /* 开启 /status/pool（线程池状态和扩缩容记录），只回复本机的请求，默认关闭 */
+    bool poolStatus;
+};
+
+#endif
@@ -4,15 +4,94 @@
 #ifndef CONSTANCE_H
 #define CONSTANCE_H
 
+#include <cstddef>
+
 /* 定义读缓冲区大小*/
 const int READ_BUFF_SIZE = 2048;
 const int WRITE_BUFF_SIZE = 1024;
 
+/* 连接与缓冲区池 */
+const int BUFF_BLOCK_SIZE = 2048;       // 缓冲区池的块大小，不小于读写缓冲区
+const int BUFF_POOL_MAX_FREE = 4096;    // 缓冲区池最多保留的空闲块
+const int CONN_SLAB_SIZE = 64;          // 每次分配的 HttpConn 个数
+const int MAX_REQUEST_SIZE = 64 * 1024; // 读缓冲区默认上限，请求（含消息体）不能超过该值
+const int MAX_PIPELINE = 16;            // 一批最多处理的流水线请求数，回复合并为一次 writev
+const int MAX_HEADERS = 64;             // 单个请求最多保存的请求头个数
+const int MAX_RANGES = 8;               // Range 请求最多的范围个数，超过时返回整个文件
+const size_t RANGE_MULTIPART_MAX = 1024 * 1024; // multipart 回复在内存中组装，超过时合并成一个范围
+
 
 /* main文件内的内容 */
 const int MAX_FD = 65536;
 const int MAX_EVENT_NUMBER = 10000;
-const int TIMESLOT = 5;     // 时钟间隔时间，5s
+const int CONN_TIMEOUT = 15000;  // 连接空闲超时时间，15s（毫秒）
+const int MAX_REACTOR = 64; // reactor 线程数量上限
+
+/* 接入控制 */
+const int LISTEN_BACKLOG = 1024;    // listen 队列长度
+const int MAX_CONN = 60000;         // 连接数软上限，超过后回复 503
+const int MAX_QUEUE_DEPTH = 1024;   // 线程池任务队列超过该值时暂停 accept
+const int ACCEPT_PAUSE_MS = 10;     // 暂停 accept 期间检查队列的间隔
+
+/* 线程池 */
+const size_t TASK_QUEUE_SIZE = MAX_FD;  // 无锁任务队列的容量，2 的幂；每个连接最多一个任务，不小于 fd 上限就不会满
+const int TASK_SPIN_COUNT = 256;        // 队列空时睡眠之前自旋检查的次数
+const size_t WORKER_QUEUE_SIZE = 1024;  // 工作窃取模式下每个线程的队列容量，2 的幂；满了放进共享队列
+const int POOL_MIN_THREADS = 8;         // 默认最少（常驻）线程数
+const int POOL_MAX_THREADS = 16;        // 默认最多线程数
+const int MAX_POOL_THREADS = 1024;      // 线程数上限
+
+/* 线程池大小控制 */
+const int POOL_TICK_MS = 5;             // 有任务时的调整周期；任务开始排队时会被提前唤醒
+const int POOL_IDLE_TICK_MS = 500;      // 没有任务时的调整周期
+const int POOL_EWMA_TAU_MS = 100;       // 排队时间、执行时间和到达率的 EWMA 时间常数
+const int POOL_WAIT_HIGH_US = 2000;     // 排队时间（实测的或按积压估计的）超过该值时扩容
+const int POOL_WAIT_LOW_US = 200;       // 排队时间低于该值才考虑缩容
+const int POOL_SHRINK_HOLD_MS = 3000;   // 缩容条件持续这么久、且这段时间内没有扩容才缩容
+const double POOL_UP_UTIL = 0.8;        // 扩容时按该利用率估算需要的线程数
+const double POOL_DOWN_UTIL = 0.5;      // 缩容时按该利用率估算，两个利用率之间不调整
+const int POOL_DECISION_LOG = 64;       // 保留最近的调整记录条数
+
+/* 平滑升级 */
+const int DRAIN_CHECK_MS = 100;         // 排空期间检查连接数的间隔
+const int DRAIN_IDLE_TIMEOUT = 1000;    // 排空开始后空闲连接的超时时间（毫秒）
+
+/* 静态文件缓存 */
+const size_t FILE_CACHE_MAX_BYTES = 64 * 1024 * 1024;   // 缓存文件的总字节数上限
+const int FILE_CACHE_MAX_ENTRIES = 1024;                // 缓存的文件个数上限
+const int FILE_CACHE_MAX_SHARE = 8;                     // 超过总上限 1/8 的大文件不缓存
+const size_t FILE_COMPRESS_MIN_SIZE = 256;              // 小于此大小的文本文件不压缩
+const int FILE_GZIP_LEVEL = 9;                          // 压缩版本只生成一次，用最高压缩级别
+const int FILE_BROTLI_QUALITY = 9;                      // brotli 11 级太慢，大文件会卡住工作线程
+
+/* HTTP/2 (h2c) */
+const int HTTP2_MAX_STREAMS = 100;              // 每个连接同时打开的流个数上限（SETTINGS_MAX_CONCURRENT_STREAMS）
+const int HTTP2_DEFAULT_WINDOW = 65535;         // 协议规定的流量控制窗口初始值
+const int HTTP2_WINDOW_UPDATE_MIN = HTTP2_DEFAULT_WINDOW / 2;   // 收到的数据累计到接收窗口的一半才归还（WINDOW_UPDATE）
+const unsigned HTTP2_MAX_FRAME_SIZE = 16384;    // 接收的帧长度上限，和协议默认值相同
+const size_t HTTP2_HEADER_TABLE_SIZE = 4096;    // HPACK 动态表大小
+const size_t HTTP2_MAX_HEADER_BLOCK = 64 * 1024;    // 一个头部块（含 CONTINUATION）的上限
+const size_t HTTP2_MAX_HEADER_LIST = 64 * 1024;     // 解码后的头部列表上限，每项按 名字 + 值 + 32 计算（SETTINGS_MAX_HEADER_LIST_SIZE）
+const size_t HTTP2_MAX_HEADER_FIELDS = MAX_HEADERS + 4;    // 一个头部块最多的字段数：请求头加上 4 个伪头部
+
+/* WebSocket */
+const size_t WS_MAX_MESSAGE = 32 * 1024;    // 一条消息（含所有分片）的上限，超过时以 1009 关闭；帧要能放进读缓冲区
+const size_t WS_MAX_OUTBOX = 1024;          // 发送队列的帧数上限，跟不上广播的连接被关闭
+const int WS_IDLE_TIMEOUT = 300000;         // WebSocket 连接空闲超时时间，5min（毫秒）
+
+/* 上传 */
+const size_t UPLOAD_MAX_SIZE = 1024UL * 1024 * 1024;    // 上传文件的大小上限，1GB
+const size_t UPLOAD_SPLICE_CHUNK = 65536;               // 每次从套接字 splice 到管道的最大字节数（管道默认容量）
+
+/* HTTPS */
+const size_t TLS_RECORD_SIZE = 16384;       // 用户空间加密时凑满一个 TLS 记录再写，也是每次解密读出的上限
+const long TLS_SESSION_TIMEOUT = 86400;     // 会话票据的有效期，1 天（秒）
+const size_t TLS_NUM_TICKETS = 2;           // TLS 1.3 握手后发给客户端的票据个数
+
+/* io_uring 后端 */
+const unsigned URING_ENTRIES = 4096;    // 提交队列大小
+const unsigned URING_BUF_COUNT = 512;   // recv 提供缓冲区个数，必须是 2 的幂
+const unsigned URING_SPLICE_CHUNK = 65536;  // sendfile 模式每次 splice 的最大字节数（管道默认容量）
 
 /* DEBUG 下使用*/
 // #define debug
@@ -0,0 +1,215 @@
+#include "chunked.h"
+#include "httpScan.h"
+
+#include <algorithm>
+
+/* 块长度最多 15 位十六进制，不会溢出 */
+static const int MAX_SIZE_DIGITS = 15;
+
+static int hexValue(char c)
+{
+    if(c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+ChunkedDecoder::ChunkedDecoder()
+{
+    reset();
+}
+
+void ChunkedDecoder::reset()
+{
+    state = STATE_SIZE;
+    remain = 0;
+    digits = 0;
+}
+
+ChunkedDecoder::STATUS ChunkedDecoder::decode(const char* data, size_t len, size_t& consumed,
+                                              std::string& body, size_t maxBody)
+{
+    size_t i = 0;
+    while(i < len)
+    {
+        char c = data[i];
+        switch(state)
+        {
+            case STATE_SIZE:
+            {
+                int value = hexValue(c);
+                if(value >= 0)
+                {
+                    if(++digits > MAX_SIZE_DIGITS)
+                    {
+                        consumed = i;
+                        return CHUNK_BAD;
+                    }
+                    remain = (remain << 4) | value;
+                    ++i;
+                    break;
+                }
+
+                /* 长度后面只能是块扩展或块头结尾 */
+                if(digits == 0 || (c != ';' && c != ' ' && c != '\t' && c != '\r'))
+                {
+                    consumed = i;
+                    return CHUNK_BAD;
+                }
+                state = (c == '\r' ? STATE_SIZE_LF : STATE_EXT);
+                ++i;
+                break;
+            }
+
+            case STATE_EXT:
+            case STATE_TRAILER:
+            {
+                /* 忽略到行尾，单独的 '\n' 不合法 */
+                size_t end = i + scanLineEnd(data + i, len - i);
+                if(end == len)
+                {
+                    i = len;
+                    break;
+                }
+                if(data[end] == '\n')
+                {
+                    consumed = end;
+                    return CHUNK_BAD;
+                }
+                state = (state == STATE_EXT ? STATE_SIZE_LF : STATE_TRAILER_LF);
+                i = end + 1;
+                break;
+            }
+
+            case STATE_SIZE_LF:
+            {
+                if(c != '\n')
+                {
+                    consumed = i;
+                    return CHUNK_BAD;
+                }
+                ++i;
+
+                if(remain == 0)
+                {
+                    state = STATE_TRAILER_START;
+                }
+                else if(remain > maxBody - std::min(body.size(), maxBody))
+                {
+                    consumed = i;
+                    return CHUNK_BAD;
+                }
+                else
+                {
+                    state = STATE_DATA;
+                }
+                break;
+            }
+
+            case STATE_DATA:
+            {
+                size_t n = std::min((uint64_t)(len - i), remain);
+                body.append(data + i, n);
+                remain -= n;
+                i += n;
+                if(remain == 0)
+                {
+                    state = STATE_DATA_CR;
+                }
+                break;
+            }
+
+            case STATE_DATA_CR:
+            case STATE_TRAILER_LF:
+            case STATE_END_LF:
+            case STATE_DATA_LF:
+            {
+                char expect = (state == STATE_DATA_CR ? '\r' : '\n');
+                if(c != expect)
+                {
+                    consumed = i;
+                    return CHUNK_BAD;
+                }
+                ++i;
+
+                if(state == STATE_DATA_CR)
+                {
+                    state = STATE_DATA_LF;
+                }
+                else if(state == STATE_DATA_LF)
+                {
+                    state = STATE_SIZE;
+                    digits = 0;
+                }
+                else if(state == STATE_TRAILER_LF)
+                {
+                    state = STATE_TRAILER_START;
+                }
+                else
+                {
+                    consumed = i;
+                    return CHUNK_DONE;
+                }
+                break;
+            }
+
+            case STATE_TRAILER_START:
+            {
+                /* 空行结束消息体，否则是一个 trailer 字段 */
+                state = (c == '\r' ? STATE_END_LF : STATE_TRAILER);
+                if(c == '\r')
+                {
+                    ++i;
+                }
+                break;
+            }
+        }
+    }
+
+    consumed = len;
+    return CHUNK_MORE;
+}
+
+void ChunkedEncoder::begin(std::string& out)
+{
+    out.assign(RESERVE, ' ');
+}
+
+size_t ChunkedEncoder::finish(std::string& out, bool last)
+{
+    size_t len = out.size() - RESERVE;
+    size_t start = RESERVE;
+
+    /* 长度为 0 的块就是结束块，没有输出时不写块头 */
+    if(len > 0)
+    {
+        static const char hex[] = "0123456789abcdef";
+        char head[RESERVE];
+        size_t pos = RESERVE;
+        head[--pos] = '\n';
+        head[--pos] = '\r';
+        for(uint64_t value = len; value > 0 && pos > 0; value >>= 4)
+        {
+            head[--pos] = hex[value & 0xf];
+        }
+
+        start = pos;
+        out.replace(start, RESERVE - start, head + start, RESERVE - start);
+        out.append("\r\n");
+    }
+
+    if(last)
+    {
+        out.append("0\r\n\r\n");
+    }
+    return start;
+}
@@ -0,0 +1,72 @@
+/**
+ * 分块传输编码（Transfer-Encoding: chunked）
+ *  ChunkedDecoder 解码请求的消息体：状态保存在对象里，数据可以分任意多次到达，
+ *  每次只扫描新到的字节，不需要等整个消息体收全再解析。
+ *  ChunkedEncoder 给流式回复的一段输出加上块头和块尾：块头的位置预留在输出的前面，
+ *  生成函数直接追加输出，不需要再复制一次。
+ */
+#ifndef CHUNKED_H
+#define CHUNKED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class ChunkedDecoder
+{
+public:
+    enum STATUS
+    {
+        CHUNK_MORE,     // 消息体还没有结束，等待更多数据
+        CHUNK_DONE,     // 最后一块和 trailer 都已经收到
+        CHUNK_BAD       // 格式错误或超过上限
+    };
+
+    ChunkedDecoder();
+
+    /* 开始一个新的消息体 */
+    void reset();
+
+    /**
+     * 解码 data 中的数据，块的内容追加到 body，body 不能超过 maxBody；
+     * consumed 为用掉的字节数，CHUNK_DONE 之后的数据（流水线的下一个请求）不会被用掉
+     */
+    STATUS decode(const char* data, size_t len, size_t& consumed, std::string& body, size_t maxBody);
+
+private:
+    enum STATE
+    {
+        STATE_SIZE,         // 十六进制的块长度
+        STATE_EXT,          // 块扩展，忽略
+        STATE_SIZE_LF,      // 块头结尾的 '\n'
+        STATE_DATA,         // 块的内容
+        STATE_DATA_CR,      // 块内容之后的 "\r\n"
+        STATE_DATA_LF,
+        STATE_TRAILER_START,    // trailer 的一行开头，空行表示结束
+        STATE_TRAILER,          // trailer 字段，忽略
+        STATE_TRAILER_LF,
+        STATE_END_LF            // 结束空行的 '\n'
+    };
+
+    STATE state;
+    uint64_t remain;    // 当前块还没有收到的字节数（解析块头时是块长度）
+    int digits;         // 块长度已经读到的位数
+};
+
+class ChunkedEncoder
+{
+public:
+    /* 输出前面预留的块头位置：最多 8 位十六进制长度和 "\r\n" */
+    static const size_t RESERVE = 10;
+
+    /* 开始一段输出：清空 out，预留块头的位置 */
+    static void begin(std::string& out);
+
+    /**
+     * 在预留的位置填写块头，追加块尾；last 为 true 时再追加结束块。
+     * 返回编码后的数据在 out 中的起始位置，没有输出也不是最后一段时返回 out.size()
+     */
+    static size_t finish(std::string& out, bool last);
+};
+
+#endif
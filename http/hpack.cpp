@@ -0,0 +1,554 @@
+#include "hpack.h"
+
+#include <cstdio>
+#include <cstdint>
+
+using std::string;
+using std::string_view;
+
+/* RFC 7541 附录 A 的静态表，索引从 1 开始 */
+static const struct
+{
+    string_view name;
+    string_view value;
+} staticTable[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+static const size_t STATIC_COUNT = sizeof(staticTable) / sizeof(staticTable[0]);
+
+/* RFC 7541 附录 B 的 Huffman 编码，下标为符号，256 是 EOS */
+static const struct
+{
+    uint32_t code;
+    uint8_t bits;
+} huffmanCodes[257] = {
+    { 0x1ff8, 13 }, { 0x7fffd8, 23 }, { 0xfffffe2, 28 }, { 0xfffffe3, 28 },
+    { 0xfffffe4, 28 }, { 0xfffffe5, 28 }, { 0xfffffe6, 28 }, { 0xfffffe7, 28 },
+    { 0xfffffe8, 28 }, { 0xffffea, 24 }, { 0x3ffffffc, 30 }, { 0xfffffe9, 28 },
+    { 0xfffffea, 28 }, { 0x3ffffffd, 30 }, { 0xfffffeb, 28 }, { 0xfffffec, 28 },
+    { 0xfffffed, 28 }, { 0xfffffee, 28 }, { 0xfffffef, 28 }, { 0xffffff0, 28 },
+    { 0xffffff1, 28 }, { 0xffffff2, 28 }, { 0x3ffffffe, 30 }, { 0xffffff3, 28 },
+    { 0xffffff4, 28 }, { 0xffffff5, 28 }, { 0xffffff6, 28 }, { 0xffffff7, 28 },
+    { 0xffffff8, 28 }, { 0xffffff9, 28 }, { 0xffffffa, 28 }, { 0xffffffb, 28 },
+    { 0x14, 6 }, { 0x3f8, 10 }, { 0x3f9, 10 }, { 0xffa, 12 },
+    { 0x1ff9, 13 }, { 0x15, 6 }, { 0xf8, 8 }, { 0x7fa, 11 },
+    { 0x3fa, 10 }, { 0x3fb, 10 }, { 0xf9, 8 }, { 0x7fb, 11 },
+    { 0xfa, 8 }, { 0x16, 6 }, { 0x17, 6 }, { 0x18, 6 },
+    { 0x0, 5 }, { 0x1, 5 }, { 0x2, 5 }, { 0x19, 6 },
+    { 0x1a, 6 }, { 0x1b, 6 }, { 0x1c, 6 }, { 0x1d, 6 },
+    { 0x1e, 6 }, { 0x1f, 6 }, { 0x5c, 7 }, { 0xfb, 8 },
+    { 0x7ffc, 15 }, { 0x20, 6 }, { 0xffb, 12 }, { 0x3fc, 10 },
+    { 0x1ffa, 13 }, { 0x21, 6 }, { 0x5d, 7 }, { 0x5e, 7 },
+    { 0x5f, 7 }, { 0x60, 7 }, { 0x61, 7 }, { 0x62, 7 },
+    { 0x63, 7 }, { 0x64, 7 }, { 0x65, 7 }, { 0x66, 7 },
+    { 0x67, 7 }, { 0x68, 7 }, { 0x69, 7 }, { 0x6a, 7 },
+    { 0x6b, 7 }, { 0x6c, 7 }, { 0x6d, 7 }, { 0x6e, 7 },
+    { 0x6f, 7 }, { 0x70, 7 }, { 0x71, 7 }, { 0x72, 7 },
+    { 0xfc, 8 }, { 0x73, 7 }, { 0xfd, 8 }, { 0x1ffb, 13 },
+    { 0x7fff0, 19 }, { 0x1ffc, 13 }, { 0x3ffc, 14 }, { 0x22, 6 },
+    { 0x7ffd, 15 }, { 0x3, 5 }, { 0x23, 6 }, { 0x4, 5 },
+    { 0x24, 6 }, { 0x5, 5 }, { 0x25, 6 }, { 0x26, 6 },
+    { 0x27, 6 }, { 0x6, 5 }, { 0x74, 7 }, { 0x75, 7 },
+    { 0x28, 6 }, { 0x29, 6 }, { 0x2a, 6 }, { 0x7, 5 },
+    { 0x2b, 6 }, { 0x76, 7 }, { 0x2c, 6 }, { 0x8, 5 },
+    { 0x9, 5 }, { 0x2d, 6 }, { 0x77, 7 }, { 0x78, 7 },
+    { 0x79, 7 }, { 0x7a, 7 }, { 0x7b, 7 }, { 0x7ffe, 15 },
+    { 0x7fc, 11 }, { 0x3ffd, 14 }, { 0x1ffd, 13 }, { 0xffffffc, 28 },
+    { 0xfffe6, 20 }, { 0x3fffd2, 22 }, { 0xfffe7, 20 }, { 0xfffe8, 20 },
+    { 0x3fffd3, 22 }, { 0x3fffd4, 22 }, { 0x3fffd5, 22 }, { 0x7fffd9, 23 },
+    { 0x3fffd6, 22 }, { 0x7fffda, 23 }, { 0x7fffdb, 23 }, { 0x7fffdc, 23 },
+    { 0x7fffdd, 23 }, { 0x7fffde, 23 }, { 0xffffeb, 24 }, { 0x7fffdf, 23 },
+    { 0xffffec, 24 }, { 0xffffed, 24 }, { 0x3fffd7, 22 }, { 0x7fffe0, 23 },
+    { 0xffffee, 24 }, { 0x7fffe1, 23 }, { 0x7fffe2, 23 }, { 0x7fffe3, 23 },
+    { 0x7fffe4, 23 }, { 0x1fffdc, 21 }, { 0x3fffd8, 22 }, { 0x7fffe5, 23 },
+    { 0x3fffd9, 22 }, { 0x7fffe6, 23 }, { 0x7fffe7, 23 }, { 0xffffef, 24 },
+    { 0x3fffda, 22 }, { 0x1fffdd, 21 }, { 0xfffe9, 20 }, { 0x3fffdb, 22 },
+    { 0x3fffdc, 22 }, { 0x7fffe8, 23 }, { 0x7fffe9, 23 }, { 0x1fffde, 21 },
+    { 0x7fffea, 23 }, { 0x3fffdd, 22 }, { 0x3fffde, 22 }, { 0xfffff0, 24 },
+    { 0x1fffdf, 21 }, { 0x3fffdf, 22 }, { 0x7fffeb, 23 }, { 0x7fffec, 23 },
+    { 0x1fffe0, 21 }, { 0x1fffe1, 21 }, { 0x3fffe0, 22 }, { 0x1fffe2, 21 },
+    { 0x7fffed, 23 }, { 0x3fffe1, 22 }, { 0x7fffee, 23 }, { 0x7fffef, 23 },
+    { 0xfffea, 20 }, { 0x3fffe2, 22 }, { 0x3fffe3, 22 }, { 0x3fffe4, 22 },
+    { 0x7ffff0, 23 }, { 0x3fffe5, 22 }, { 0x3fffe6, 22 }, { 0x7ffff1, 23 },
+    { 0x3ffffe0, 26 }, { 0x3ffffe1, 26 }, { 0xfffeb, 20 }, { 0x7fff1, 19 },
+    { 0x3fffe7, 22 }, { 0x7ffff2, 23 }, { 0x3fffe8, 22 }, { 0x1ffffec, 25 },
+    { 0x3ffffe2, 26 }, { 0x3ffffe3, 26 }, { 0x3ffffe4, 26 }, { 0x7ffffde, 27 },
+    { 0x7ffffdf, 27 }, { 0x3ffffe5, 26 }, { 0xfffff1, 24 }, { 0x1ffffed, 25 },
+    { 0x7fff2, 19 }, { 0x1fffe3, 21 }, { 0x3ffffe6, 26 }, { 0x7ffffe0, 27 },
+    { 0x7ffffe1, 27 }, { 0x3ffffe7, 26 }, { 0x7ffffe2, 27 }, { 0xfffff2, 24 },
+    { 0x1fffe4, 21 }, { 0x1fffe5, 21 }, { 0x3ffffe8, 26 }, { 0x3ffffe9, 26 },
+    { 0xffffffd, 28 }, { 0x7ffffe3, 27 }, { 0x7ffffe4, 27 }, { 0x7ffffe5, 27 },
+    { 0xfffec, 20 }, { 0xfffff3, 24 }, { 0xfffed, 20 }, { 0x1fffe6, 21 },
+    { 0x3fffe9, 22 }, { 0x1fffe7, 21 }, { 0x1fffe8, 21 }, { 0x7ffff3, 23 },
+    { 0x3fffea, 22 }, { 0x3fffeb, 22 }, { 0x1ffffee, 25 }, { 0x1ffffef, 25 },
+    { 0xfffff4, 24 }, { 0xfffff5, 24 }, { 0x3ffffea, 26 }, { 0x7ffff4, 23 },
+    { 0x3ffffeb, 26 }, { 0x7ffffe6, 27 }, { 0x3ffffec, 26 }, { 0x3ffffed, 26 },
+    { 0x7ffffe7, 27 }, { 0x7ffffe8, 27 }, { 0x7ffffe9, 27 }, { 0x7ffffea, 27 },
+    { 0x7ffffeb, 27 }, { 0xffffffe, 28 }, { 0x7ffffec, 27 }, { 0x7ffffed, 27 },
+    { 0x7ffffee, 27 }, { 0x7ffffef, 27 }, { 0x7fffff0, 27 }, { 0x3ffffee, 26 },
+    { 0x3fffffff, 30 },
+};
+
+/* 解码用的二叉树，第一次使用时由编码表构造 */
+struct HuffmanNode
+{
+    int child[2];
+    int sym;            // 叶子的符号，内部节点为 -1
+};
+
+static const std::vector<HuffmanNode>& huffmanTree()
+{
+    static const std::vector<HuffmanNode> tree = []()
+    {
+        std::vector<HuffmanNode> nodes(1, HuffmanNode{{-1, -1}, -1});
+        for(int sym = 0; sym < 257; ++sym)
+        {
+            int node = 0;
+            for(int i = huffmanCodes[sym].bits - 1; i >= 0; --i)
+            {
+                int bit = (huffmanCodes[sym].code >> i) & 1;
+                if(nodes[node].child[bit] == -1)
+                {
+                    nodes[node].child[bit] = nodes.size();
+                    nodes.push_back(HuffmanNode{{-1, -1}, -1});
+                }
+                node = nodes[node].child[bit];
+            }
+            nodes[node].sym = sym;
+        }
+        return nodes;
+    }();
+    return tree;
+}
+
+static bool huffmanDecode(const uint8_t* data, size_t len, string& out)
+{
+    const std::vector<HuffmanNode>& tree = huffmanTree();
+    int node = 0;
+    int depth = 0;
+    bool allOnes = true;
+    for(size_t i = 0; i < len; ++i)
+    {
+        for(int shift = 7; shift >= 0; --shift)
+        {
+            int bit = (data[i] >> shift) & 1;
+            node = tree[node].child[bit];
+            if(node == -1)
+            {
+                return false;
+            }
+            ++depth;
+            allOnes = allOnes && bit;
+
+            if(tree[node].sym >= 0)
+            {
+                /* 字符串中不能出现 EOS */
+                if(tree[node].sym == 256)
+                {
+                    return false;
+                }
+                out.push_back(static_cast<char>(tree[node].sym));
+                node = 0;
+                depth = 0;
+                allOnes = true;
+            }
+        }
+    }
+
+    /* 结尾的填充不超过 7 位，且必须是 EOS 的前缀（全 1） */
+    return depth <= 7 && allOnes;
+}
+
+/* 带 prefix 位前缀的整数 */
+static bool decodeInt(const uint8_t*& p, const uint8_t* end, int prefix, size_t& value)
+{
+    if(p == end)
+    {
+        return false;
+    }
+
+    size_t mask = (1u << prefix) - 1;
+    value = *p++ & mask;
+    if(value < mask)
+    {
+        return true;
+    }
+
+    for(int shift = 0; p != end && shift <= 28; shift += 7)
+    {
+        uint8_t byte = *p++;
+        value += (size_t)(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void encodeInt(string& out, uint8_t flags, int prefix, size_t value)
+{
+    size_t mask = (1u << prefix) - 1;
+    if(value < mask)
+    {
+        out.push_back(static_cast<char>(flags | value));
+        return;
+    }
+
+    out.push_back(static_cast<char>(flags | mask));
+    value -= mask;
+    while(value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool decodeString(const uint8_t*& p, const uint8_t* end, string& out)
+{
+    if(p == end)
+    {
+        return false;
+    }
+
+    bool huffman = *p & 0x80;
+    size_t len = 0;
+    if(!decodeInt(p, end, 7, len) || len > (size_t)(end - p))
+    {
+        return false;
+    }
+
+    out.clear();
+    if(huffman)
+    {
+        if(!huffmanDecode(p, len, out))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        out.assign(reinterpret_cast<const char*>(p), len);
+    }
+    p += len;
+    return true;
+}
+
+/* 只输出原始字符串：回复头大多是短的 ASCII，Huffman 省下的字节抵不上编码的开销 */
+static void encodeString(string& out, string_view str)
+{
+    encodeInt(out, 0x00, 7, str.size());
+    out.append(str.data(), str.size());
+}
+
+
+HpackTable::HpackTable(size_t maxSize)
+    : size(0), maxSize(maxSize)
+{
+
+}
+
+bool HpackTable::get(size_t index, string_view& name, string_view& value) const
+{
+    if(index == 0)
+    {
+        return false;
+    }
+
+    if(index <= STATIC_COUNT)
+    {
+        name = staticTable[index - 1].name;
+        value = staticTable[index - 1].value;
+        return true;
+    }
+
+    index -= STATIC_COUNT + 1;
+    if(index >= entries.size())
+    {
+        return false;
+    }
+    name = entries[index].first;
+    value = entries[index].second;
+    return true;
+}
+
+size_t HpackTable::find(string_view name, string_view value, size_t& nameIndex) const
+{
+    nameIndex = 0;
+    for(size_t i = 0; i < STATIC_COUNT; ++i)
+    {
+        if(staticTable[i].name == name)
+        {
+            if(staticTable[i].value == value)
+            {
+                return i + 1;
+            }
+            if(nameIndex == 0)
+            {
+                nameIndex = i + 1;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < entries.size(); ++i)
+    {
+        if(entries[i].first == name)
+        {
+            if(entries[i].second == value)
+            {
+                return STATIC_COUNT + i + 1;
+            }
+            if(nameIndex == 0)
+            {
+                nameIndex = STATIC_COUNT + i + 1;
+            }
+        }
+    }
+    return 0;
+}
+
+void HpackTable::add(string_view name, string_view value)
+{
+    size_t entrySize = name.size() + value.size() + 32;
+
+    /* 比整个表还大的项清空表，但不加入 */
+    if(entrySize > maxSize)
+    {
+        evict(0);
+        return;
+    }
+
+    evict(maxSize - entrySize);
+    entries.emplace_front(string(name), string(value));
+    size += entrySize;
+}
+
+void HpackTable::setMaxSize(size_t newSize)
+{
+    maxSize = newSize;
+    evict(maxSize);
+}
+
+void HpackTable::evict(size_t limit)
+{
+    while(size > limit && !entries.empty())
+    {
+        size -= entries.back().first.size() + entries.back().second.size() + 32;
+        entries.pop_back();
+    }
+}
+
+
+HpackDecoder::HpackDecoder(size_t maxSize, size_t maxListSize, size_t maxCount)
+    : table(maxSize), settingsSize(maxSize), maxListSize(maxListSize), maxCount(maxCount)
+{
+
+}
+
+bool HpackDecoder::decode(const uint8_t* data, size_t len, std::vector<HpackHeader>& headers)
+{
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    string_view name;
+    string_view value;
+    size_t listSize = 0;
+
+    while(p != end)
+    {
+        uint8_t byte = *p;
+        size_t index = 0;
+        if(byte & 0x80)
+        {
+            /* 索引：先按长度计入上限再复制 */
+            if(!decodeInt(p, end, 7, index) || !table.get(index, name, value))
+            {
+                return false;
+            }
+            listSize += name.size() + value.size() + 32;
+            if(listSize > maxListSize || headers.size() >= maxCount)
+            {
+                return false;
+            }
+            headers.emplace_back(string(name), string(value));
+        }
+        else if((byte & 0xe0) == 0x20)
+        {
+            /* 动态表大小更新，不能超过我们通告的上限 */
+            if(!decodeInt(p, end, 5, index) || index > settingsSize)
+            {
+                return false;
+            }
+            table.setMaxSize(index);
+        }
+        else
+        {
+            /* 字面值：01 加入动态表，0000 不加入，0001 永不加入 */
+            bool incremental = (byte & 0xc0) == 0x40;
+            if(!decodeInt(p, end, incremental ? 6 : 4, index))
+            {
+                return false;
+            }
+
+            HpackHeader header;
+            if(index == 0)
+            {
+                if(!decodeString(p, end, header.first))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                if(!table.get(index, name, value))
+                {
+                    return false;
+                }
+                header.first.assign(name.data(), name.size());
+            }
+
+            if(!decodeString(p, end, header.second))
+            {
+                return false;
+            }
+
+            listSize += header.first.size() + header.second.size() + 32;
+            if(listSize > maxListSize || headers.size() >= maxCount)
+            {
+                return false;
+            }
+
+            if(incremental)
+            {
+                table.add(header.first, header.second);
+            }
+            headers.push_back(std::move(header));
+        }
+    }
+
+    return true;
+}
+
+
+HpackEncoder::HpackEncoder(size_t maxSize)
+    : table(maxSize), pendingSize(SIZE_MAX)
+{
+
+}
+
+void HpackEncoder::setMaxTableSize(size_t size)
+{
+    /* 只会缩小：我们的表从不超过初始大小 */
+    if(size < table.getMaxSize())
+    {
+        table.setMaxSize(size);
+        pendingSize = size;
+    }
+}
+
+void HpackEncoder::begin(string& out)
+{
+    if(pendingSize != SIZE_MAX)
+    {
+        encodeInt(out, 0x20, 5, pendingSize);
+        pendingSize = SIZE_MAX;
+    }
+}
+
+void HpackEncoder::encode(string& out, string_view name, string_view value, bool index)
+{
+    size_t nameIndex = 0;
+    size_t found = table.find(name, value, nameIndex);
+    if(found)
+    {
+        encodeInt(out, 0x80, 7, found);
+        return;
+    }
+
+    if(index)
+    {
+        encodeInt(out, 0x40, 6, nameIndex);
+    }
+    else
+    {
+        encodeInt(out, 0x00, 4, nameIndex);
+    }
+    if(nameIndex == 0)
+    {
+        encodeString(out, name);
+    }
+    encodeString(out, value);
+
+    if(index)
+    {
+        table.add(name, value);
+    }
+}
+
+void HpackEncoder::encodeStatus(string& out, int code)
+{
+    /* 常见的状态码在静态表中，只需一个字节 */
+    char buf[8];
+    int len = snprintf(buf, sizeof(buf), "%d", code);
+    encode(out, ":status", string_view(buf, len), false);
+}
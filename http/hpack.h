@@ -0,0 +1,90 @@
+/**
+ * HPACK (RFC 7541): HTTP/2 的头部压缩
+ *  静态表 61 项，动态表按先进先出淘汰；解码支持 Huffman，
+ *  编码只输出原始字符串，常用的回复头加入动态表，后续回复只需一个字节。
+ *  编码器和解码器各自维护一张动态表，都只在连接所在的线程中使用。
+ */
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <utility>
+
+typedef std::pair<std::string, std::string> HpackHeader;
+
+class HpackTable
+{
+public:
+    explicit HpackTable(size_t maxSize);
+
+    /* 按索引（从 1 开始，先静态表后动态表）取一项，索引无效时返回 false */
+    bool get(size_t index, std::string_view& name, std::string_view& value) const;
+
+    /* 查找名字和值都相同的项，返回索引；只有名字相同时 nameIndex 为名字的索引，都没有时返回 0 */
+    size_t find(std::string_view name, std::string_view value, size_t& nameIndex) const;
+
+    /* 加入动态表，放不下时淘汰最早的项 */
+    void add(std::string_view name, std::string_view value);
+
+    /* 修改动态表上限，超出的项被淘汰 */
+    void setMaxSize(size_t size);
+    size_t getMaxSize() const { return maxSize; }
+
+private:
+    void evict(size_t limit);
+
+private:
+    std::deque<HpackHeader> entries;    // 最新的在前面
+    size_t size;                        // 每项按 名字 + 值 + 32 计算
+    size_t maxSize;
+};
+
+class HpackDecoder
+{
+public:
+    /**
+     * maxSize: 通过 SETTINGS_HEADER_TABLE_SIZE 通告的上限
+     * maxListSize: 解码后的头部列表上限（每项 名字 + 值 + 32），maxCount: 字段个数上限
+     */
+    HpackDecoder(size_t maxSize, size_t maxListSize, size_t maxCount);
+
+    /**
+     * 解码一个完整的头部块，格式错误或者超过上限时返回 false（连接错误 COMPRESSION_ERROR）。
+     * 超过上限时马上停止：很小的头部块反复引用动态表中的大项，展开后可以有几百 MB
+     */
+    bool decode(const uint8_t* data, size_t len, std::vector<HpackHeader>& headers);
+
+private:
+    HpackTable table;
+    size_t settingsSize;
+    size_t maxListSize;
+    size_t maxCount;
+};
+
+class HpackEncoder
+{
+public:
+    explicit HpackEncoder(size_t maxSize);
+
+    /* 对端修改了 SETTINGS_HEADER_TABLE_SIZE，下一个头部块开头通知对端 */
+    void setMaxTableSize(size_t size);
+
+    /* 开始一个新的头部块 */
+    void begin(std::string& out);
+
+    /* 编码一个回复头，名字必须是小写；index 为 true 时加入动态表 */
+    void encode(std::string& out, std::string_view name, std::string_view value, bool index);
+
+    /* 编码 :status */
+    void encodeStatus(std::string& out, int code);
+
+private:
+    HpackTable table;
+    size_t pendingSize;     // 等待通知的表大小，没有时为 SIZE_MAX
+};
+
+#endif
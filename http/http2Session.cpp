@@ -0,0 +1,1031 @@
+#include "http2Session.h"
+#include "../pool/bufferPool/bufferPool.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+using std::string;
+using std::string_view;
+
+/* 客户端连接前言 */
+static const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const size_t PREFACE_LEN = sizeof(PREFACE) - 1;
+
+static const size_t FRAME_HEADER_LEN = 9;
+
+/* 帧类型 */
+enum FRAME_TYPE
+{
+    FRAME_DATA = 0x0,
+    FRAME_HEADERS = 0x1,
+    FRAME_PRIORITY = 0x2,
+    FRAME_RST_STREAM = 0x3,
+    FRAME_SETTINGS = 0x4,
+    FRAME_PUSH_PROMISE = 0x5,
+    FRAME_PING = 0x6,
+    FRAME_GOAWAY = 0x7,
+    FRAME_WINDOW_UPDATE = 0x8,
+    FRAME_CONTINUATION = 0x9
+};
+
+/* 帧标志 */
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+
+/* SETTINGS 参数 */
+enum SETTINGS_ID
+{
+    SETTINGS_HEADER_TABLE_SIZE = 0x1,
+    SETTINGS_ENABLE_PUSH = 0x2,
+    SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+    SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+    SETTINGS_MAX_FRAME_SIZE = 0x5,
+    SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+};
+
+static const int64_t MAX_WINDOW = 0x7fffffff;
+
+static uint32_t read32(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void write32(uint8_t* p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+/* HTTP2-Settings 是不带填充的 base64url，也接受普通 base64 */
+static bool base64UrlDecode(string_view str, string& out)
+{
+    uint32_t bits = 0;
+    int count = 0;
+    for(char c : str)
+    {
+        int value;
+        if(c >= 'A' && c <= 'Z') value = c - 'A';
+        else if(c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if(c >= '0' && c <= '9') value = c - '0' + 52;
+        else if(c == '-' || c == '+') value = 62;
+        else if(c == '_' || c == '/') value = 63;
+        else if(c == '=') break;
+        else return false;
+
+        bits = (bits << 6) | value;
+        count += 6;
+        if(count >= 8)
+        {
+            count -= 8;
+            out.push_back(static_cast<char>((bits >> count) & 0xff));
+        }
+    }
+    return true;
+}
+
+/* HTTP/2 禁止的连接相关的头 */
+static bool isConnectionHeader(string_view name)
+{
+    return name == "connection" || name == "keep-alive" || name == "proxy-connection"
+        || name == "transfer-encoding" || name == "upgrade";
+}
+
+/* 头的名字转成小写，超过 buf 的部分截断 */
+static string_view lowerName(string_view name, char* buf, size_t size)
+{
+    size_t len = std::min(name.size(), size);
+    for(size_t i = 0; i < len; ++i)
+    {
+        char c = name[i];
+        buf[i] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+    return string_view(buf, len);
+}
+
+
+Http2Session::Http2Session(HttpConn* conn)
+    : conn(conn), decoder(HTTP2_HEADER_TABLE_SIZE, HTTP2_MAX_HEADER_LIST, HTTP2_MAX_HEADER_FIELDS), encoder(HTTP2_HEADER_TABLE_SIZE),
+      lastStreamId(0), nextStreamId(0),
+      connWindow(HTTP2_DEFAULT_WINDOW), connConsumed(0), peerInitialWindow(HTTP2_DEFAULT_WINDOW), peerMaxFrame(HTTP2_MAX_FRAME_SIZE),
+      prefaceDone(false), goawaySent(false), goawayRecv(false), failed(false),
+      headerStreamId(0), headerEndStream(false), outputIdx(0)
+{
+    /* 服务器的连接前言：SETTINGS，其余参数使用默认值 */
+    uint8_t payload[12];
+    payload[0] = 0;
+    payload[1] = SETTINGS_MAX_CONCURRENT_STREAMS;
+    write32(payload + 2, HTTP2_MAX_STREAMS);
+    payload[6] = 0;
+    payload[7] = SETTINGS_MAX_HEADER_LIST_SIZE;
+    write32(payload + 8, HTTP2_MAX_HEADER_LIST);
+    writeFrame(FRAME_SETTINGS, 0, 0, payload, sizeof(payload));
+}
+
+int Http2Session::matchPreface(ChainBuffer& buffer)
+{
+    char head[PREFACE_LEN];
+    size_t len = std::min(buffer.size(), PREFACE_LEN);
+    buffer.copyOut(0, len, head);
+    if(memcmp(head, PREFACE, len) != 0)
+    {
+        return -1;
+    }
+    return len == PREFACE_LEN ? 1 : 0;
+}
+
+bool Http2Session::upgrade(string_view settings)
+{
+    string payload;
+    while(!settings.empty() && (settings.back() == ' ' || settings.back() == '\t'))
+    {
+        settings.remove_suffix(1);
+    }
+    if(!base64UrlDecode(settings, payload) || payload.size() % 6 != 0
+        || !applySettings(reinterpret_cast<const uint8_t*>(payload.data()), payload.size()))
+    {
+        return false;
+    }
+
+    /* 流 1 是升级前的请求，已经接收完，由 process 处理 */
+    Stream& stream = streams[1];
+    stream.id = 1;
+    stream.window = peerInitialWindow;
+    stream.endStream = true;
+    stream.method = (conn->m_method == HttpConn::POST ? "POST" : "GET");
+    stream.path = string(conn->m_url);
+    stream.authority = string(conn->m_host);
+
+    char name[64];
+    for(int i = 0; i < conn->headerCount; ++i)
+    {
+        string_view key = lowerName(conn->headers[i].key, name, sizeof(name));
+        if(isConnectionHeader(key) || key == "http2-settings" || key == "host")
+        {
+            continue;
+        }
+        stream.headers.emplace_back(string(key), string(conn->headers[i].value));
+    }
+    lastStreamId = 1;
+
+    return true;
+}
+
+bool Http2Session::process()
+{
+    /* 上一批已经发送完，结束的流可以释放了 */
+    for(auto it = streams.begin(); it != streams.end(); )
+    {
+        if(it->second.closed)
+        {
+            it = streams.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    /* 升级时的流 1 */
+    for(auto& it : streams)
+    {
+        if(it.second.endStream && !it.second.responded)
+        {
+            dispatch(it.second);
+        }
+    }
+
+    ChainBuffer& buffer = conn->readBuffer;
+    if(!prefaceDone && !failed)
+    {
+        int match = matchPreface(buffer);
+        if(match < 0)
+        {
+            connError(PROTOCOL_ERROR);
+        }
+        else if(match > 0)
+        {
+            buffer.consume(PREFACE_LEN);
+            prefaceDone = true;
+        }
+    }
+
+    /* 逐帧解析，不完整的帧留在读缓冲区中等待后面的数据 */
+    while(prefaceDone && !failed && buffer.size() >= FRAME_HEADER_LEN)
+    {
+        uint8_t head[FRAME_HEADER_LEN];
+        buffer.copyOut(0, FRAME_HEADER_LEN, reinterpret_cast<char*>(head));
+
+        size_t len = ((size_t)head[0] << 16) | ((size_t)head[1] << 8) | head[2];
+        if(len > HTTP2_MAX_FRAME_SIZE)
+        {
+            connError(FRAME_SIZE_ERROR);
+            break;
+        }
+        if(buffer.size() < FRAME_HEADER_LEN + len)
+        {
+            break;
+        }
+
+        frame.resize(len);
+        buffer.copyOut(FRAME_HEADER_LEN, len, reinterpret_cast<char*>(frame.data()));
+        buffer.consume(FRAME_HEADER_LEN + len);
+
+        uint32_t streamId = read32(head + 5) & 0x7fffffff;
+        if(!handleFrame(head[3], head[4], streamId, frame.data(), len))
+        {
+            break;
+        }
+    }
+
+    if(failed)
+    {
+        buffer.clear();
+    }
+
+    /* 进程退出：通知客户端不再接受新的流，已经打开的流处理完再关闭 */
+    if(HttpConn::draining && !goawaySent)
+    {
+        uint8_t payload[8];
+        write32(payload, lastStreamId);
+        write32(payload + 4, NO_ERROR);
+        writeFrame(FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+        goawaySent = true;
+    }
+
+    /* 升级时流 1 的消息体等收到客户端的连接前言（和 SETTINGS）之后再发送 */
+    if(flushOutput() && !failed && prefaceDone)
+    {
+        scheduleData();
+    }
+
+    /* 最后不满一块的帧，flushOutput 和 scheduleData 保证还有一项的位置 */
+    if(conn->writeIdx > 0)
+    {
+        queueBlock();
+    }
+
+    if(failed)
+    {
+        return false;
+    }
+
+    /* GOAWAY 之后所有的流都结束了 */
+    return !((goawaySent || goawayRecv) && activeStreams() == 0 && output.empty());
+}
+
+bool Http2Session::hasPending()
+{
+    return !output.empty() || (!failed && prefaceDone && canSendData());
+}
+
+bool Http2Session::handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len)
+{
+    /* 头部块没有结束时只能收到同一个流的 CONTINUATION */
+    if(headerStreamId != 0 && (type != FRAME_CONTINUATION || streamId != headerStreamId))
+    {
+        return connError(PROTOCOL_ERROR);
+    }
+
+    switch(type)
+    {
+    case FRAME_DATA:
+    {
+        return onData(flags, streamId, payload, len);
+    }
+
+    case FRAME_HEADERS:
+    case FRAME_CONTINUATION:
+    {
+        return onHeaders(type, flags, streamId, payload, len);
+    }
+
+    case FRAME_PRIORITY:
+    {
+        /* 不按优先级调度，各个流轮流发送 */
+        if(streamId == 0)
+        {
+            return connError(PROTOCOL_ERROR);
+        }
+        if(len != 5)
+        {
+            writeRst(streamId, FRAME_SIZE_ERROR);
+        }
+        return true;
+    }
+
+    case FRAME_RST_STREAM:
+    {
+        if(streamId == 0)
+        {
+            return connError(PROTOCOL_ERROR);
+        }
+        if(len != 4)
+        {
+            return connError(FRAME_SIZE_ERROR);
+        }
+
+        /* 不再发送，下一次 process 时释放 */
+        auto it = streams.find(streamId);
+        if(it != streams.end())
+        {
+            it->second.closed = true;
+        }
+        return true;
+    }
+
+    case FRAME_SETTINGS:
+    {
+        return onSettings(flags, streamId, payload, len);
+    }
+
+    case FRAME_PUSH_PROMISE:
+    {
+        /* 客户端不能推送 */
+        return connError(PROTOCOL_ERROR);
+    }
+
+    case FRAME_PING:
+    {
+        if(streamId != 0)
+        {
+            return connError(PROTOCOL_ERROR);
+        }
+        if(len != 8)
+        {
+            return connError(FRAME_SIZE_ERROR);
+        }
+        if(!(flags & FLAG_ACK))
+        {
+            writeFrame(FRAME_PING, FLAG_ACK, 0, payload, len);
+        }
+        return true;
+    }
+
+    case FRAME_GOAWAY:
+    {
+        if(streamId != 0)
+        {
+            return connError(PROTOCOL_ERROR);
+        }
+        goawayRecv = true;
+        return true;
+    }
+
+    case FRAME_WINDOW_UPDATE:
+    {
+        return onWindowUpdate(streamId, payload, len);
+    }
+
+    default:
+    {
+        /* 未知类型的帧忽略 */
+        return true;
+    }
+    }
+}
+
+bool Http2Session::onSettings(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len)
+{
+    if(streamId != 0)
+    {
+        return connError(PROTOCOL_ERROR);
+    }
+
+    if(flags & FLAG_ACK)
+    {
+        return len == 0 || connError(FRAME_SIZE_ERROR);
+    }
+
+    if(len % 6 != 0)
+    {
+        return connError(FRAME_SIZE_ERROR);
+    }
+
+    if(!applySettings(payload, len))
+    {
+        return false;
+    }
+    writeFrame(FRAME_SETTINGS, FLAG_ACK, 0, nullptr, 0);
+    return true;
+}
+
+bool Http2Session::applySettings(const uint8_t* payload, size_t len)
+{
+    for(size_t i = 0; i + 6 <= len; i += 6)
+    {
+        uint16_t id = ((uint16_t)payload[i] << 8) | payload[i + 1];
+        uint32_t value = read32(payload + i + 2);
+
+        switch(id)
+        {
+        case SETTINGS_HEADER_TABLE_SIZE:
+        {
+            encoder.setMaxTableSize(value);
+            break;
+        }
+
+        case SETTINGS_ENABLE_PUSH:
+        {
+            if(value > 1)
+            {
+                return connError(PROTOCOL_ERROR);
+            }
+            break;
+        }
+
+        case SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            if(value > MAX_WINDOW)
+            {
+                return connError(FLOW_CONTROL_ERROR);
+            }
+
+            /* 已经打开的流按差值调整，窗口可能变成负数 */
+            for(auto& it : streams)
+            {
+                it.second.window += (int64_t)value - peerInitialWindow;
+            }
+            peerInitialWindow = value;
+            break;
+        }
+
+        case SETTINGS_MAX_FRAME_SIZE:
+        {
+            if(value < HTTP2_MAX_FRAME_SIZE || value > 0xffffff)
+            {
+                return connError(PROTOCOL_ERROR);
+            }
+            peerMaxFrame = value;
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool Http2Session::onHeaders(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len)
+{
+    if(type == FRAME_HEADERS)
+    {
+        /* 客户端只能打开奇数 ID 的流 */
+        if(streamId == 0 || !(streamId & 1))
+        {
+            return connError(PROTOCOL_ERROR);
+        }
+
+        size_t pad = 0;
+        if(flags & FLAG_PADDED)
+        {
+            if(len < 1)
+            {
+                return connError(FRAME_SIZE_ERROR);
+            }
+            pad = payload[0];
+            ++payload;
+            --len;
+        }
+        if(flags & FLAG_PRIORITY)
+        {
+            if(len < 5)
+            {
+                return connError(FRAME_SIZE_ERROR);
+            }
+            payload += 5;
+            len -= 5;
+        }
+        if(pad > len)
+        {
+            return connError(PROTOCOL_ERROR);
+        }
+        len -= pad;
+
+        headerStreamId = streamId;
+        headerEndStream = flags & FLAG_END_STREAM;
+        headerBlock.clear();
+    }
+    else if(headerStreamId == 0)
+    {
+        /* 前面没有 HEADERS 的 CONTINUATION */
+        return connError(PROTOCOL_ERROR);
+    }
+
+    if(headerBlock.size() + len > HTTP2_MAX_HEADER_BLOCK)
+    {
+        return connError(PROTOCOL_ERROR);
+    }
+    headerBlock.append(reinterpret_cast<const char*>(payload), len);
+
+    return !(flags & FLAG_END_HEADERS) || headersDone();
+}
+
+bool Http2Session::headersDone()
+{
+    uint32_t streamId = headerStreamId;
+    headerStreamId = 0;
+
+    /* 即使流被拒绝也要解码，保持动态表和客户端一致 */
+    std::vector<HpackHeader> headers;
+    if(!decoder.decode(reinterpret_cast<const uint8_t*>(headerBlock.data()), headerBlock.size(), headers))
+    {
+        return connError(COMPRESSION_ERROR);
+    }
+
+    if(streamId <= lastStreamId)
+    {
+        /* 已有的流：请求体后面的 trailer，不使用 */
+        auto it = streams.find(streamId);
+        if(it == streams.end() || it->second.endStream || it->second.closed)
+        {
+            writeRst(streamId, STREAM_CLOSED);
+        }
+        else if(!headerEndStream)
+        {
+            writeRst(streamId, PROTOCOL_ERROR);
+            it->second.closed = true;
+        }
+        else
+        {
+            it->second.endStream = true;
+            dispatch(it->second);
+        }
+        return true;
+    }
+
+    lastStreamId = streamId;
+    if(goawaySent || activeStreams() >= HTTP2_MAX_STREAMS)
+    {
+        writeRst(streamId, REFUSED_STREAM);
+        return true;
+    }
+
+    Stream& stream = streams[streamId];
+    stream.id = streamId;
+    stream.window = peerInitialWindow;
+    for(HpackHeader& header : headers)
+    {
+        if(header.first == ":method")
+        {
+            stream.method = std::move(header.second);
+        }
+        else if(header.first == ":path")
+        {
+            stream.path = std::move(header.second);
+        }
+        else if(header.first == ":authority")
+        {
+            stream.authority = std::move(header.second);
+        }
+        else if(header.first.empty() || header.first[0] != ':')
+        {
+            stream.headers.push_back(std::move(header));
+        }
+    }
+
+    if(stream.method.empty() || stream.path.empty())
+    {
+        writeRst(streamId, PROTOCOL_ERROR);
+        stream.closed = true;
+        return true;
+    }
+
+    if(headerEndStream)
+    {
+        stream.endStream = true;
+        dispatch(stream);
+    }
+    return true;
+}
+
+bool Http2Session::onData(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len)
+{
+    if(streamId == 0)
+    {
+        return connError(PROTOCOL_ERROR);
+    }
+
+    /**
+     * 流量控制按整个负载（含填充）计算。收到的数据累计到接收窗口的一半再归还，
+     * 大的请求体不必每个 DATA 帧都回复一个 WINDOW_UPDATE，对端也不会因为窗口用完而停下
+     */
+    size_t total = len;
+    if(flags & FLAG_PADDED)
+    {
+        if(len < 1 || payload[0] >= len)
+        {
+            return connError(PROTOCOL_ERROR);
+        }
+        len -= payload[0] + 1;
+        ++payload;
+    }
+    connConsumed += total;
+    if(connConsumed >= HTTP2_WINDOW_UPDATE_MIN)
+    {
+        writeWindowUpdate(0, connConsumed);
+        connConsumed = 0;
+    }
+
+    auto it = streams.find(streamId);
+    if(it == streams.end() || it->second.endStream || it->second.closed)
+    {
+        if(streamId > lastStreamId)
+        {
+            return connError(PROTOCOL_ERROR);
+        }
+        writeRst(streamId, STREAM_CLOSED);
+        return true;
+    }
+
+    /* 请求体和 HTTP/1.1 一样受 maxRequestSize 限制 */
+    Stream& stream = it->second;
+    if(stream.body.size() + len > HttpConn::maxRequestSize)
+    {
+        writeRst(streamId, CANCEL);
+        stream.closed = true;
+        return true;
+    }
+    stream.body.append(reinterpret_cast<const char*>(payload), len);
+
+    if(flags & FLAG_END_STREAM)
+    {
+        stream.endStream = true;
+        dispatch(stream);
+    }
+    else
+    {
+        /* 请求体接收完之后流的窗口不再需要归还 */
+        stream.consumed += total;
+        if(stream.consumed >= HTTP2_WINDOW_UPDATE_MIN)
+        {
+            writeWindowUpdate(streamId, stream.consumed);
+            stream.consumed = 0;
+        }
+    }
+    return true;
+}
+
+bool Http2Session::onWindowUpdate(uint32_t streamId, const uint8_t* payload, size_t len)
+{
+    if(len != 4)
+    {
+        return connError(FRAME_SIZE_ERROR);
+    }
+
+    uint32_t increment = read32(payload) & 0x7fffffff;
+    if(streamId == 0)
+    {
+        if(increment == 0)
+        {
+            return connError(PROTOCOL_ERROR);
+        }
+        connWindow += increment;
+        return connWindow <= MAX_WINDOW || connError(FLOW_CONTROL_ERROR);
+    }
+
+    auto it = streams.find(streamId);
+    if(it == streams.end() || it->second.closed)
+    {
+        return true;
+    }
+
+    Stream& stream = it->second;
+    stream.window += increment;
+    if(increment == 0 || stream.window > MAX_WINDOW)
+    {
+        writeRst(streamId, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+        stream.closed = true;
+    }
+    return true;
+}
+
+void Http2Session::dispatch(Stream& stream)
+{
+    /* 回复头写在单独的缓冲块里，不影响正在组装的帧 */
+    char* frameBuffer = conn->writeBuffer;
+    int frameIdx = conn->writeIdx;
+    conn->writeBuffer = nullptr;
+    conn->resetRequest();
+
+    /* HEAD 按 GET 路由，下面去掉消息体；其他方法和 HTTP/1.1 一样回复 405 或 501 */
+    if(stream.method == "GET" || stream.method == "HEAD")
+    {
+        conn->m_method = HttpConn::GET;
+    }
+    else
+    {
+        conn->m_method = (stream.method == "POST" ? HttpConn::POST : HttpConn::OTHER);
+    }
+    conn->m_url = stream.path;
+    conn->m_host = stream.authority;
+    conn->isKeepLive = true;
+    for(const HpackHeader& header : stream.headers)
+    {
+        if(conn->headerCount == MAX_HEADERS)
+        {
+            break;
+        }
+        conn->headers[conn->headerCount].key = header.first;
+        conn->headers[conn->headerCount].value = header.second;
+        ++conn->headerCount;
+    }
+    conn->requestBody.swap(stream.body);
+
+    /* 和 HTTP/1.1 相同的路由、缓存和回复头 */
+    bool ok = conn->processWrite(conn->do_request());
+    string block;
+    if(ok)
+    {
+        string_view text(conn->writeBuffer, conn->writeIdx);
+
+        /* 状态行 "HTTP/1.1 200 OK" 只取状态码 */
+        int status = 500;
+        if(text.size() > 12)
+        {
+            std::from_chars(text.data() + 9, text.data() + 12, status);
+        }
+        size_t lineEnd = text.find("\r\n");
+        text.remove_prefix(lineEnd == string_view::npos ? text.size() : lineEnd + 2);
+
+        encoder.begin(block);
+        encoder.encodeStatus(block, status);
+        encodeHeaders(text, block);
+
+        /* 固定回复的头在 fixedBody 里，空行之后才是消息体 */
+        string_view fixed = conn->fixedBody;
+        if(!fixed.empty())
+        {
+            size_t end = fixed.find("\r\n\r\n");
+            if(end != string_view::npos)
+            {
+                encodeHeaders(fixed.substr(0, end + 2), block);
+                conn->fixedBody = fixed.substr(end + 4);
+            }
+        }
+
+        stream.data = conn->takeBody(stream.resp);
+    }
+
+    BufferPool::getInstance()->put(conn->writeBuffer);
+    conn->requestBody.clear();
+    conn->resetRequest();
+    conn->writeBuffer = frameBuffer;
+    conn->writeIdx = frameIdx;
+
+    if(!ok)
+    {
+        writeRst(stream.id, INTERNAL_ERROR);
+        stream.closed = true;
+        return;
+    }
+
+    /* HEAD 的回复只有头（HTTP/1.1 的解析器把 HEAD 当作 GET，这里不发送消息体） */
+    if(stream.method == "HEAD")
+    {
+        stream.resp.file.reset();
+        stream.resp.fileSize = 0;
+    }
+
+    /* 头部块超过对端的帧长度时拆成 HEADERS 和若干 CONTINUATION */
+    bool noBody = (stream.resp.fileSize == 0);
+    size_t offset = 0;
+    do
+    {
+        size_t len = std::min<size_t>(block.size() - offset, peerMaxFrame);
+        uint8_t flags = 0;
+        if(offset == 0 && noBody)
+        {
+            flags |= FLAG_END_STREAM;
+        }
+        if(offset + len == block.size())
+        {
+            flags |= FLAG_END_HEADERS;
+        }
+        writeFrame(offset == 0 ? FRAME_HEADERS : FRAME_CONTINUATION, flags, stream.id, block.data() + offset, len);
+        offset += len;
+    } while(offset < block.size());
+
+    stream.responded = true;
+    stream.closed = noBody;
+}
+
+void Http2Session::encodeHeaders(string_view text, string& block)
+{
+    char name[64];
+    while(!text.empty())
+    {
+        size_t end = text.find("\r\n");
+        string_view line = text.substr(0, end);
+        text.remove_prefix(end == string_view::npos ? text.size() : end + 2);
+
+        size_t colon = line.find(':');
+        if(colon == string_view::npos)
+        {
+            continue;
+        }
+
+        /* HTTP/2 的头名字是小写，连接相关的头不能出现 */
+        string_view key = lowerName(line.substr(0, colon), name, sizeof(name));
+        if(isConnectionHeader(key))
+        {
+            continue;
+        }
+        string_view value = line.substr(colon + 1);
+        while(!value.empty() && value[0] == ' ')
+        {
+            value.remove_prefix(1);
+        }
+
+        /* 同一个连接上的回复大多相同的头加入动态表，之后只需一个字节 */
+        bool index = (key == "content-type" || key == "content-encoding" || key == "vary"
+            || key == "accept-ranges" || key == "date");
+        encoder.encode(block, key, value, index);
+    }
+}
+
+void Http2Session::writeFrame(uint8_t type, uint8_t flags, uint32_t streamId, const void* payload, size_t len)
+{
+    uint8_t head[FRAME_HEADER_LEN];
+    head[0] = len >> 16;
+    head[1] = len >> 8;
+    head[2] = len;
+    head[3] = type;
+    head[4] = flags;
+    write32(head + 5, streamId & 0x7fffffff);
+
+    output.append(reinterpret_cast<const char*>(head), sizeof(head));
+    if(len > 0)
+    {
+        output.append(static_cast<const char*>(payload), len);
+    }
+}
+
+void Http2Session::writeRst(uint32_t streamId, ERROR_CODE code)
+{
+    uint8_t payload[4];
+    write32(payload, code);
+    writeFrame(FRAME_RST_STREAM, 0, streamId, payload, sizeof(payload));
+}
+
+void Http2Session::writeWindowUpdate(uint32_t streamId, uint32_t increment)
+{
+    uint8_t payload[4];
+    write32(payload, increment);
+    writeFrame(FRAME_WINDOW_UPDATE, 0, streamId, payload, sizeof(payload));
+}
+
+bool Http2Session::connError(ERROR_CODE code)
+{
+    #ifdef debug
+        std::cout << "http2 connection error: " << code << std::endl;
+    #endif
+
+    uint8_t payload[8];
+    write32(payload, lastStreamId);
+    write32(payload + 4, code);
+    writeFrame(FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+
+    goawaySent = true;
+    failed = true;
+    return false;
+}
+
+bool Http2Session::flushOutput()
+{
+    while(outputIdx < output.size())
+    {
+        size_t room = WRITE_BUFF_SIZE - 1 - conn->writeIdx;
+        if(room == 0)
+        {
+            /* 最后一项留给 process 结束时剩下的内容 */
+            if(conn->respCount >= MAX_PIPELINE - 1)
+            {
+                return false;
+            }
+            queueBlock();
+            continue;
+        }
+
+        size_t len = std::min(room, output.size() - outputIdx);
+        conn->addBytes(string_view(output.data() + outputIdx, len));
+        outputIdx += len;
+    }
+
+    output.clear();
+    outputIdx = 0;
+    return true;
+}
+
+void Http2Session::scheduleData()
+{
+    /* 从上次停下的流开始，每个流每轮最多一帧 */
+    bool progress = true;
+    while(progress && connWindow > 0)
+    {
+        progress = false;
+
+        auto it = streams.lower_bound(nextStreamId);
+        for(size_t i = 0; i < streams.size() && connWindow > 0; ++i, ++it)
+        {
+            if(it == streams.end())
+            {
+                it = streams.begin();
+            }
+
+            Stream& stream = it->second;
+            if(!stream.responded || stream.closed || stream.window <= 0)
+            {
+                continue;
+            }
+
+            /* 帧头放不下时先把写缓冲区放入队列；帧头和消息体一起占一项 */
+            if(conn->writeIdx + FRAME_HEADER_LEN >= WRITE_BUFF_SIZE)
+            {
+                if(conn->respCount >= MAX_PIPELINE - 1)
+                {
+                    nextStreamId = stream.id;
+                    return;
+                }
+                queueBlock();
+            }
+            if(conn->respCount >= MAX_PIPELINE)
+            {
+                nextStreamId = stream.id;
+                return;
+            }
+
+            size_t remain = stream.resp.fileSize - stream.sent;
+            size_t len = std::min<int64_t>({(int64_t)remain, (int64_t)peerMaxFrame, connWindow, stream.window});
+            bool last = (len == remain);
+
+            uint8_t head[FRAME_HEADER_LEN];
+            head[0] = len >> 16;
+            head[1] = len >> 8;
+            head[2] = len;
+            head[3] = FRAME_DATA;
+            head[4] = last ? FLAG_END_STREAM : 0;
+            write32(head + 5, stream.id);
+            conn->addBytes(string_view(reinterpret_cast<char*>(head), sizeof(head)));
+
+            /* 内存中的消息体直接指向，sendfile 时从文件的偏移发送 */
+            HttpConn::Response& resp = conn->responses[conn->respCount];
+            resp.file = stream.resp.file;
+            resp.fileOff = stream.resp.fileOff + stream.sent;
+            resp.fileSize = len;
+            conn->queueSegment(stream.data ? stream.data + stream.sent : nullptr, len);
+
+            stream.sent += len;
+            stream.window -= len;
+            connWindow -= len;
+            stream.closed = last;
+            nextStreamId = stream.id + 1;
+            progress = true;
+        }
+    }
+}
+
+bool Http2Session::canSendData()
+{
+    if(connWindow <= 0)
+    {
+        return false;
+    }
+
+    for(auto& it : streams)
+    {
+        if(it.second.responded && !it.second.closed && it.second.window > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Http2Session::queueBlock()
+{
+    HttpConn::Response& resp = conn->responses[conn->respCount];
+    resp.fileOff = 0;
+    resp.fileSize = 0;
+    conn->queueSegment(nullptr, 0);
+}
+
+int Http2Session::activeStreams()
+{
+    int count = 0;
+    for(auto& it : streams)
+    {
+        if(!it.second.closed)
+        {
+            ++count;
+        }
+    }
+    return count;
+}
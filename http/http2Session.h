@@ -0,0 +1,142 @@
+/**
+ * Http2Session: 一个连接上的 HTTP/2 (h2c) 会话
+ *  连接以 prior knowledge（直接发送连接前言）或 HTTP/1.1 Upgrade 进入 HTTP/2。
+ *  帧从 HttpConn 的读缓冲区解析，每个流的请求仍由 HttpConn 的路由、文件缓存
+ *  和回复头处理，回复头转成 HPACK 编码的 HEADERS 帧；消息体按流量控制窗口切成
+ *  DATA 帧，和 HTTP/1.1 一样作为回复队列的一项由 writev/sendfile（或 io_uring）
+ *  发送，文件内容不复制。多个流的 DATA 帧轮流发送。
+ *  会话只在处理该连接的工作线程中使用，不需要加锁。
+ */
+#ifndef HTTP2SESSION_H
+#define HTTP2SESSION_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "httpConn.h"
+#include "hpack.h"
+
+class Http2Session
+{
+public:
+    explicit Http2Session(HttpConn* conn);
+
+    /* 读缓冲区开头和连接前言比较：1 完全匹配，0 是前言的一部分（等待更多数据），-1 不匹配 */
+    static int matchPreface(ChainBuffer& buffer);
+
+    /* HTTP/1.1 Upgrade：settings 是 HTTP2-Settings 头，连接当前的请求作为流 1 */
+    bool upgrade(std::string_view settings);
+
+    /* 处理读缓冲区中的帧，把回复放入连接的发送队列；返回 false 表示发送完后关闭连接 */
+    bool process();
+
+    /* 发送队列满了，还有数据可以立即发送 */
+    bool hasPending();
+
+private:
+    /* 错误码 */
+    enum ERROR_CODE
+    {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        CANCEL = 0x8,
+        COMPRESSION_ERROR = 0x9
+    };
+
+    struct Stream
+    {
+        uint32_t id = 0;
+        int64_t window = 0;         // 发送窗口
+        int64_t consumed = 0;       // 收到、还没有归还的接收窗口
+        bool endStream = false;     // 请求已经接收完
+        bool responded = false;     // 回复头已经生成
+        bool closed = false;        // 回复已经全部放入发送队列，或者被重置
+
+        std::string method;
+        std::string path;
+        std::string authority;
+        std::vector<HpackHeader> headers;
+        std::string body;
+
+        HttpConn::Response resp;    // 回复的消息体：文件引用、偏移和长度
+        char* data = nullptr;       // 消息体在内存中的地址，sendfile 时为空
+        size_t sent = 0;            // 已经放入 DATA 帧的字节数
+    };
+
+    /* 解析一个帧，返回 false 表示连接错误（已经发送 GOAWAY） */
+    bool handleFrame(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len);
+    bool onSettings(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len);
+    bool onHeaders(uint8_t type, uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len);
+    bool onData(uint8_t flags, uint32_t streamId, const uint8_t* payload, size_t len);
+    bool onWindowUpdate(uint32_t streamId, const uint8_t* payload, size_t len);
+
+    /* 应用对端的 SETTINGS 参数 */
+    bool applySettings(const uint8_t* payload, size_t len);
+
+    /* 头部块接收完整：解码并创建流（或作为 trailer 丢弃） */
+    bool headersDone();
+
+    /* 请求接收完整，由 HttpConn 处理并生成回复头 */
+    void dispatch(Stream& stream);
+
+    /* 把 HttpConn 生成的 HTTP/1.1 回复头编码成 HPACK 头部块 */
+    void encodeHeaders(std::string_view text, std::string& block);
+
+    /* 帧写入 output，之后由 flushOutput 复制到连接的写缓冲区 */
+    void writeFrame(uint8_t type, uint8_t flags, uint32_t streamId, const void* payload, size_t len);
+    void writeRst(uint32_t streamId, ERROR_CODE code);
+    void writeWindowUpdate(uint32_t streamId, uint32_t increment);
+
+    /* 连接错误：发送 GOAWAY，之后关闭连接 */
+    bool connError(ERROR_CODE code);
+
+    /* 控制帧和 HEADERS 放入发送队列，队列满时返回 false */
+    bool flushOutput();
+    /* 按流量控制窗口轮流为各个流生成 DATA 帧 */
+    void scheduleData();
+    /* 还有可以发送的 DATA */
+    bool canSendData();
+    /* 写缓冲区中的内容作为没有消息体的一项放入发送队列 */
+    void queueBlock();
+
+    /* 还没有结束的流的个数 */
+    int activeStreams();
+
+private:
+    HttpConn* conn;
+    HpackDecoder decoder;
+    HpackEncoder encoder;
+
+    std::map<uint32_t, Stream> streams;
+    uint32_t lastStreamId;      // 客户端打开的最大流 ID
+    uint32_t nextStreamId;      // 轮流发送 DATA 时下一个开始的流
+
+    int64_t connWindow;         // 连接的发送窗口
+    int64_t connConsumed;       // 连接收到、还没有归还的接收窗口
+    int64_t peerInitialWindow;  // 对端 SETTINGS_INITIAL_WINDOW_SIZE
+    uint32_t peerMaxFrame;      // 对端 SETTINGS_MAX_FRAME_SIZE
+
+    bool prefaceDone;           // 已经收到客户端的连接前言
+    bool goawaySent;
+    bool goawayRecv;
+    bool failed;                // 连接错误，发送完 GOAWAY 后关闭
+
+    /* 没有 END_HEADERS 时后面必须紧跟同一个流的 CONTINUATION */
+    uint32_t headerStreamId;
+    bool headerEndStream;
+    std::string headerBlock;
+
+    std::vector<uint8_t> frame; // 当前帧的负载，从读缓冲区复制出来
+    std::string output;         // 等待放入发送队列的帧
+    size_t outputIdx;
+};
+
+#endif
@@ -1,22 +1,34 @@
 #include "httpConn.h"
+#include "../reactor/eventLoop.h"
+#include "../pool/bufferPool/bufferPool.h"
+#include "httpScan.h"
+#include "httpHeader.h"
+#include "../router/router.h"
+#include "http2Session.h"
+
+#include <charconv>
+#include <strings.h>
+#include <time.h>
+#include <sys/sendfile.h>
+#include <openssl/err.h>
+#include <random>
 
-// 定义http响应的一些状态信息
-const string ok_200_title = "OK";
-const string error_400_title = "Bad Request";
-const string error_400_form = "Your request has bad syntax or is inherently impossible to staisfy.\n";
-const string error_403_title = "Forbidden";
-const string error_403_form = "You do not have permission to get file form this server.\n";
-const string error_404_title = "Not Found";
-const string error_404_form = "The requested file was not found on this server.\n";
-const string error_500_title = "Internal Error";
-const string error_500_form = "There was an unusual problem serving the request file.\n";
-
-
-int HttpConn::epollfd = -1;
 std::atomic_int HttpConn::userCount(0);
+std::atomic_bool HttpConn::draining(false);
+size_t HttpConn::maxRequestSize = MAX_REQUEST_SIZE;
+SEND_MODE HttpConn::sendMode = SEND_MMAP;
 
 string rootPath;
 
+/* 请求格式错误时的完整回复，和过载时的 503 一样预先构造好：这种请求之后总是关闭连接 */
+static const char bad_request_400[] =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Content-Type: text/html; charset=UTF-8\r\n"
+    "Content-Length:68\r\n"
+    "Connection: close\r\n"
+    "\r\n"
+    "Your request has bad syntax or is inherently impossible to satisfy.\n";
+
 /* 保存数据库中的用户信息 */
 std::unordered_map<string, string> usersInfo;
 std::mutex connMutex;
@@ -43,7 +55,6 @@ void addFd(int epollfd, int fd, bool isOneShot = false)
     }
 
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ev);
-    setnoblocking(fd);
 }
 
 void removeFd(int epollfd, int fd)
@@ -65,43 +76,227 @@ void modfd(int epollfd, int fd, int ev)
 
 }
 
+HttpConn::HttpConn()
+{
+    sockfd = -1;
+    loop = nullptr;
+    poolState = 0;
+    writeBuffer = nullptr;
+    pipeFd[0] = -1;
+    pipeFd[1] = -1;
+    pipeBytes = 0;
+    uploadFd = -1;
+    ssl = nullptr;
+    tlsHandshaking = false;
+    ktlsSend = false;
+    ktlsRecv = false;
+
+    respCount = 0;
+    iovCount = 0;
+    iovIdx = 0;
+}
+
+HttpConn::~HttpConn()
+{
+    abortUpload();
+    unmap();
+    clearResponses();
+    closePipe();
+    releaseBuffer();
+    freeSsl();
+}
+
+void HttpConn::releaseBuffer()
+{
+    readBuffer.clear();
+    BufferPool::getInstance()->put(writeBuffer);
+    writeBuffer = nullptr;
+}
+
 void HttpConn::init()
 {
-        m_url = "";
+        resetRequest();
+
+        /* 新连接不占用缓冲区，读到数据时才分配 */
+        releaseBuffer();
+        clearResponses();
+
+        keepConn = false;
+        pendingRequest = false;
+        m_mysql = nullptr; 
+        h2.reset();
+        ws.reset();
+        producer = nullptr;
+}
+
+void HttpConn::resetRequest()
+{
+        m_url = string_view();
         m_method = GET;
-        m_version = "";
-        m_host = "";
+        m_version = "HTTP/1.1";    // 请求行解析失败时回复也要有版本号
+        m_host = string_view();
+        headerCount = 0;
+        lineSpill.clear();
         content_length = 0;
-        isKeepLive = false;
+        isKeepLive = false;        // 解析请求行时按版本设置默认值，请求行错误时关闭连接
+        chunked = false;
         isCGI = false;
-       
-        memset(readBuffer, 0, READ_BUFF_SIZE);
-        memset(writeBuffer, 0, WRITE_BUFF_SIZE);
+        allowMethods = string_view();
 
-        readIdx = 0;
         writeIdx = 0;
         curIdx = 0;
 
         lineIdx = 0;
+        lineEnd = 0;
 
        
         filePath = "";        
-        fileAddr = nullptr;  
-        m_mysql = nullptr; 
-
-        iovCount = 0;
-        bytesHaveSend = 0;
-        bytesToSend = 0;
+        fileEntry.reset();
+        encoding = ENCODING_IDENTITY;
+        vary = false;
+        rangeCount = 0;
+        multipartBody.clear();
+        fixedBody = string_view();
+        generatedBody.clear();
+        wsRoute = nullptr;
 
         curState = CHECK_REQUESTLINE;
 }
 
-void HttpConn::init(const int m_sockfd, const sockaddr_in addr) 
+void HttpConn::queueResponse()
+{
+    Response& resp = responses[respCount];
+    char* body = takeBody(resp);
+    queueSegment(body, resp.fileSize);
+
+    /* 回复已经交给队列，连接是否保持以最后一个请求为准 */
+    keepConn = isKeepLive;
+
+    /* 丢弃这个请求的数据，后面流水线的请求从头开始解析 */
+    readBuffer.consume(curIdx);
+    resetRequest();
+}
+
+char* HttpConn::takeBody(Response& resp)
+{
+    resp.fileOff = 0;
+    resp.fileSize = 0;
+
+    /* 固定回复、压缩版本、multipart 和生成的消息体在内存中，sendfile 模式下也用 writev 发送 */
+    char* body = nullptr;
+    if(!fixedBody.empty())
+    {
+        body = const_cast<char*>(fixedBody.data());
+        resp.fileSize = fixedBody.size();
+    }
+    else if(rangeCount > 1)
+    {
+        resp.body.swap(multipartBody);
+        body = &resp.body[0];
+        resp.fileSize = resp.body.size();
+    }
+    else if(!generatedBody.empty())
+    {
+        resp.body.swap(generatedBody);
+        body = &resp.body[0];
+        resp.fileSize = resp.body.size();
+    }
+    else if(fileEntry && rangeCount == 1)
+    {
+        /* 单个范围：从映射（或 sendfile 的偏移）的中间开始发送 */
+        body = (fileEntry->addr ? fileEntry->addr + ranges[0].first : nullptr);
+        resp.fileOff = ranges[0].first;
+        resp.fileSize = ranges[0].last - ranges[0].first + 1;
+    }
+    else if(fileEntry && encoding == ENCODING_IDENTITY)
+    {
+        body = fileEntry->addr;
+        resp.fileSize = fileEntry->info.st_size;
+    }
+    else if(fileEntry)
+    {
+        body = &fileEntry->variants[encoding].body[0];
+        resp.fileSize = fileEntry->variants[encoding].body.size();
+    }
+
+    /* 发送完之前保持对缓存文件的引用 */
+    resp.file = std::move(fileEntry);
+    return body;
+}
+
+void HttpConn::queueSegment(char* body, size_t len)
+{
+    Response& resp = responses[respCount++];
+    resp.header = writeBuffer;
+
+    /**
+     * 每个回复固定占两项：回复头和文件内容（没有文件时长度为 0）。
+     * sendfile 模式下文件那一项的 iov_base 为空，由 sendfile 发送
+     */
+    iov[iovCount].iov_base = writeBuffer;
+    iov[iovCount].iov_len = writeIdx;
+    ++iovCount;
+
+    iov[iovCount].iov_base = body;
+    iov[iovCount].iov_len = len;
+    ++iovCount;
+
+    bytesToSend += writeIdx + len;
+
+    writeBuffer = nullptr;
+    writeIdx = 0;
+}
+
+void HttpConn::clearResponses()
+{
+    for(int i = 0; i < respCount; ++i)
+    {
+        BufferPool::getInstance()->put(responses[i].header);
+        responses[i].file.reset();
+        string().swap(responses[i].body);
+        responses[i].frame.reset();
+    }
+
+    respCount = 0;
+    iovCount = 0;
+    iovIdx = 0;
+    bytesHaveSend = 0;
+    bytesToSend = 0;
+}
+
+bool HttpConn::isLoopback()
+{
+    /* io_uring 的 multishot accept 不返回对端地址，clntAddr 可能是空的，直接查询套接字 */
+    sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    if(getpeername(sockfd, (struct sockaddr*)&addr, &addrLen) == -1 || addr.sin_family != AF_INET)
+    {
+        return false;
+    }
+    return (ntohl(addr.sin_addr.s_addr) >> 24) == 127;
+}
+
+void HttpConn::init(const int m_sockfd, const sockaddr_in addr, EventLoop* m_loop, bool tls) 
 {
     sockfd = m_sockfd;
     clntAddr = addr;
+    loop = m_loop;
+    poolState = 0;
+
+    /* 握手在第一次可读时由工作线程进行；创建失败时关闭套接字，由事件循环回收连接 */
+    freeSsl();
+    ktlsSend = false;
+    ktlsRecv = false;
+    tlsHandshaking = tls;
+    if(tls)
+    {
+        ssl = TlsContext::getInstance()->newSsl(sockfd);
+        if(!ssl)
+        {
+            shutdown(sockfd, SHUT_RDWR);
+        }
+    }
 
-    addFd(epollfd, sockfd, true);
     ++userCount;
 
     #ifdef debug
@@ -114,12 +309,13 @@ void HttpConn::init(const int m_sockfd, const sockaddr_in addr)
 /* 初始化mysql结果 */
 void HttpConn::initMySQLResult(SqlConnPool* connPool)
 {
-    SqlConnRAII conn(&m_mysql, connPool);
+    MYSQL* mysql = nullptr;
+    SqlConnRAII conn(&mysql, connPool);
     string sql = "select username,passwd FROM user";
-    mysql_query(m_mysql, sql.c_str());
+    mysql_query(mysql, sql.c_str());
 
     //从表中检索完整的结果集
-    MYSQL_RES *result = mysql_store_result(m_mysql);
+    MYSQL_RES *result = mysql_store_result(mysql);
 
     //返回结果集中的列数
     // int num_fields = mysql_num_fields(result);
@@ -141,101 +337,159 @@ void HttpConn::initMySQLResult(SqlConnPool* connPool)
 }
 
 
+/* 不区分大小写比较 */
+static bool equalsIgnoreCase(string_view a, string_view b)
+{
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+/* 去掉首尾的空格和制表符 */
+static string_view trimSpace(string_view str)
+{
+    size_t begin = 0;
+    size_t end = str.size();
+    while(begin < end && (str[begin] == ' ' || str[begin] == '\t'))
+    {
+        ++begin;
+    }
+    while(end > begin && (str[end - 1] == ' ' || str[end - 1] == '\t'))
+    {
+        --end;
+    }
+    return str.substr(begin, end - begin);
+}
+
+/* 逗号分隔的列表（如 Connection、Upgrade）中是否有 token，不区分大小写 */
+static bool hasToken(string_view list, string_view token)
+{
+    while(!list.empty())
+    {
+        size_t comma = scanChar(list.data(), list.size(), ',');
+        if(equalsIgnoreCase(trimSpace(list.substr(0, comma)), token))
+        {
+            return true;
+        }
+        list.remove_prefix(comma == list.size() ? comma : comma + 1);
+    }
+    return false;
+}
+
 HttpConn::LINE_STATUS HttpConn::paraseLine()
 {
     /**
      * 现在所有数据已经读入到readBuffer中，我们要从所有数据中解析出一行。
-     *  一行结束的标志为\r\n
+     *  一行结束的标志为\r\n，逐块用 SIMD 查找 '\r' 或 '\n'
      * */ 
 
-    // LINE_STATUS  lineState = LINE_OPEN;
-    for(; curIdx < readIdx; ++curIdx)
+    size_t readIdx = readBuffer.size();
+    while(curIdx < readIdx)
     {
-
-        if(readBuffer[curIdx] == '\r')
+        size_t len = 0;
+        const char* seg = readBuffer.peek(curIdx, &len);
+        size_t pos = scanLineEnd(seg, len);
+        if(pos == len)
         {
-            /* 以\r 结尾 */
-            if(curIdx + 1 == readIdx)
-            {
-                return LINE_OPEN;
-            }
-            else if(readBuffer[curIdx + 1] == '\n')
-            {
-                /* 设置结束标志 */
-                readBuffer[curIdx++] = '\0';
-                readBuffer[curIdx++] = '\0';
-
-                return LINE_OK;
-            }
+            /* 这一块里没有，继续下一块 */
+            curIdx += len;
+            continue;
+        }
 
+        curIdx += pos;
+        if(seg[pos] == '\n')
+        {
+            /* '\r' 总是先被找到，单独的 '\n' 不合法 */
             return LINE_BAD;
         }
-        else if(readBuffer[curIdx] == '\n')
-        {
-            if(curIdx > 1 && (readBuffer[curIdx - 1] == '\r'))
-            {
-                /* 设置结束标志 */
-                readBuffer[curIdx - 1] = '\0';
-                readBuffer[curIdx++] = '\0';
-
-                return LINE_OK;
-            }
 
-            return LINE_BAD;
+        /* 以\r 结尾，等待后面的数据，下次从 '\r' 重新检查 */
+        if(curIdx + 1 == readIdx)
+        {
+            return LINE_OPEN;
+        }
+        else if(readBuffer[curIdx + 1] == '\n')
+        {
+            lineEnd = curIdx;
+            curIdx += 2;
+            return LINE_OK;
         }
+
+        return LINE_BAD;
     }
 
     return LINE_OPEN;
 }
 
-HttpConn::HTTP_CODE HttpConn::paraseRequestLine(string text)
+string_view HttpConn::getOneLine()
+{
+    size_t len = lineEnd - lineIdx;
+    size_t segLen = 0;
+    const char* seg = readBuffer.peek(lineIdx, &segLen);
+    if(readBuffer.isContiguous(lineIdx, len))
+    {
+        return string_view(seg, len);
+    }
+
+    /**
+     * 跨块的行复制到单独的内存中，解析结果直接指向这里，
+     * 请求处理完之前不能释放。只有请求头超过一块时才会发生
+     */
+    lineSpill.emplace_back(new char[len]);
+    readBuffer.copyOut(lineIdx, len, lineSpill.back().get());
+    return string_view(lineSpill.back().get(), len);
+}
+
+HttpConn::HTTP_CODE HttpConn::paraseRequestLine(string_view text)
 {
     /**
      * 处理请求行
      * 请求行格式如下：
      *  GET /api/user/1001 HTTP/1.1
+     * 解析结果都指向读缓冲区，不复制
      */
 
-    auto idx = text.find_first_of(" ");
-    if(idx == string::npos)
+    auto idx = scanChar(text.data(), text.size(), ' ');
+    if(idx == text.size())
     {
         return BAD_REQUEST;
     }
 
-    string method = text.substr(0, idx);
+    string_view method = text.substr(0, idx);
     if (method.empty()) 
     {
         return BAD_REQUEST;
     }
-    // 统一转为大写（原地修改method）
-    std::transform(method.begin(), method.end(), method.begin(), ::toupper);
 
-    // 简化判断：只需要检查大写形式
-    if (method == "GET") 
+    // 不区分大小写
+    if (equalsIgnoreCase(method, "GET")) 
     {
         m_method = GET;
     } 
-    else if (method == "POST") 
+    else if (equalsIgnoreCase(method, "POST")) 
     {
         m_method = POST;
     } 
+    else if (equalsIgnoreCase(method, "HEAD")) 
+    {
+        // 和 GET 使用同样的路由
+        m_method = GET;
+    } 
     else 
     {
-        // 处理其他方法（如PUT、DELETE等）或默认值
-        m_method = GET; // 或返回错误
+        // 其他方法（如PUT、DELETE等）不按 GET 处理，请求解析完后回复 405 或 501
+        m_method = OTHER;
     }
 
     // 跳过空格，定位到URL起始位置
-    idx = text.find_first_not_of(" ", idx + 1);
-    if (idx == string::npos) 
+    idx = text.find_first_not_of(' ', idx + 1);
+    if (idx == string_view::npos) 
     {
         return BAD_REQUEST; // 跳过空格后无内容（无URL），格式错误
     }
 
     // 查找URL结束位置（下一个空格）
-    auto urlEnd = text.find_first_of(" ", idx);
+    auto urlEnd = idx + scanChar(text.data() + idx, text.size() - idx, ' ');
     // 提取URL：如果没有下一个空格，说明URL到结尾（但HTTP请求行必须有版本，此处应视为错误）
-    if (urlEnd == string::npos) 
+    if (urlEnd == text.size()) 
     {
         return BAD_REQUEST; // 无版本信息，格式错误
     }
@@ -244,43 +498,67 @@ HttpConn::HTTP_CODE HttpConn::paraseRequestLine(string text)
     {
         return BAD_REQUEST;
     }
-    
-    if(m_url == "/")
-    {
-        m_url = "/index.html";
-    }
 
     // 跳过空格，定位到版本起始位置
-    idx = text.find_first_not_of(" ", urlEnd + 1);
-    if (idx == string::npos) 
+    idx = text.find_first_not_of(' ', urlEnd + 1);
+    if (idx == string_view::npos) 
     {
         return BAD_REQUEST; // 跳过空格后无版本内容，格式错误
     }
 
-    // 提取版本（到字符串结尾）
-    m_version = text.substr(idx);
-    std::transform(m_version.begin(), m_version.end(), m_version.begin(), ::toupper);
-
-    if(m_version != "HTTP/1.1" && m_version != "HTTP/1.0")
+    // 提取版本（到字符串结尾），回复时使用规范的写法
+    string_view version = text.substr(idx);
+    if(equalsIgnoreCase(version, "HTTP/1.1"))
+    {
+        m_version = "HTTP/1.1";
+    }
+    else if(equalsIgnoreCase(version, "HTTP/1.0"))
+    {
+        m_version = "HTTP/1.0";
+    }
+    else
     {
         return BAD_REQUEST;
     }
 
+    /* HTTP/1.1 默认保持连接，HTTP/1.0 要由 Connection: keep-alive 明确要求 */
+    isKeepLive = (m_version == "HTTP/1.1");
+
 
     curState = CHECK_HEADER;
     return NO_REQUEST;
 }
 
-HttpConn::HTTP_CODE HttpConn::paraseRequestHeader(string text)
+HttpConn::HTTP_CODE HttpConn::paraseRequestHeader(string_view text)
 {
     /**
      * 处理请求头，请求头格式如下：
-     * 
+     *  Key: value
      */
-    size_t idx = 0;
-    
     if(text.empty())
     {
+        /* 上传的消息体不读进缓冲区，直接写入文件 */
+        size_t maxSize = 0;
+        if(m_method == POST && !h2 &&
+           Router::getInstance()->findUpload(m_url.substr(0, scanChar(m_url.data(), m_url.size(), '?')), filePath, maxSize))
+        {
+            return beginUpload(maxSize);
+        }
+
+        /* 同时带 Content-Length 和 chunked 的请求长度有歧义，可能是请求走私，直接拒绝 */
+        if(chunked)
+        {
+            if(content_length > 0)
+            {
+                return BAD_REQUEST;
+            }
+
+            requestBody.clear();
+            chunkDecoder.reset();
+            curState = CHECK_CONTENT;
+            return NO_REQUEST;
+        }
+
         if(content_length > 0)
         {
             curState = CHECK_CONTENT;
@@ -291,35 +569,56 @@ HttpConn::HTTP_CODE HttpConn::paraseRequestHeader(string text)
         return GET_REQUEST;
     }
 
-    idx = text.find_first_of(":");
-    if(idx == string::npos)
+    size_t idx = scanChar(text.data(), text.size(), ':');
+    if(idx == text.size())
     {
         return BAD_REQUEST;
     }
 
-    string key = text.substr(0, idx);
-    string value = text.substr(idx + 2);
+    string_view key = text.substr(0, idx);
+    string_view value = trimSpace(text.substr(idx + 1));
 
+    /* 全部保存下来，其余字段在处理请求时按需查找 */
+    if(headerCount >= MAX_HEADERS)
+    {
+        return BAD_REQUEST;
+    }
+    headers[headerCount].key = key;
+    headers[headerCount].value = value;
+    ++headerCount;
 
-    if(key =="Host")
+    if(equalsIgnoreCase(key, "Host"))
     {
         m_host = value;
     }
-    else if(key == "Content-Length")
+    else if(equalsIgnoreCase(key, "Content-Length"))
     {
-
-        content_length = std::stoi(value);
-        
-        if(content_length < 0)
+        auto ret = std::from_chars(value.data(), value.data() + value.size(), content_length);
+        if(ret.ec != std::errc() || ret.ptr != value.data() + value.size())
+        {
+            return BAD_REQUEST;
+        }
+    }
+    else if(equalsIgnoreCase(key, "Transfer-Encoding"))
+    {
+        /* 只支持 chunked 这一种编码，其他编码无法解码，也就不知道消息体在哪里结束 */
+        if(!equalsIgnoreCase(value, "chunked"))
         {
             return BAD_REQUEST;
         }
+        chunked = true;
     }
-    else if (key == "Connection") 
+    else if (equalsIgnoreCase(key, "Connection")) 
     {
-        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
-        // std::cout << value << std::endl;
-        isKeepLive = (value == "keep-alive" ? true : false);
+        /* 可能是列表，比如 "keep-alive, Upgrade"；close 优先 */
+        if(hasToken(value, "close"))
+        {
+            isKeepLive = false;
+        }
+        else if(hasToken(value, "keep-alive"))
+        {
+            isKeepLive = true;
+        }
     }
     else
     {
@@ -329,190 +628,887 @@ HttpConn::HTTP_CODE HttpConn::paraseRequestHeader(string text)
     return NO_REQUEST;
 }
 
-HttpConn::HTTP_CODE HttpConn::paraseRequestContent(string text)
+HttpConn::HTTP_CODE HttpConn::paraseRequestContent()
 {
-    // 处理post提交的内容
-    if(readIdx >= (curIdx + content_length))
+    /* 分块的消息体：边到达边解码，curIdx 停在已经解码的位置 */
+    if(chunked)
     {
-        if(!text.empty())
+        size_t readIdx = readBuffer.size();
+        while(curIdx < readIdx)
         {
-            requestBody = text;
-            return GET_REQUEST;
+            size_t len = 0;
+            const char* seg = readBuffer.peek(curIdx, &len);
+
+            size_t used = 0;
+            ChunkedDecoder::STATUS status = chunkDecoder.decode(seg, len, used, requestBody, maxRequestSize);
+            curIdx += used;
+            if(status == ChunkedDecoder::CHUNK_DONE)
+            {
+                return GET_REQUEST;
+            }
+            else if(status == ChunkedDecoder::CHUNK_BAD)
+            {
+                return BAD_REQUEST;
+            }
         }
+
+        return NO_REQUEST;
+    }
+
+    // 处理post提交的内容
+    if(readBuffer.size() >= (curIdx + content_length))
+    {
+        requestBody = readBuffer.getString(curIdx, content_length);
+        curIdx += content_length;
+        return GET_REQUEST;
     }
 
     return NO_REQUEST;
 }
 
-HttpConn::HTTP_CODE HttpConn::do_request()
+HttpConn::HTTP_CODE HttpConn::beginUpload(size_t maxSize)
 {
-    char flag = 'a';
-    string fileName = "";
-    auto idx = m_url.find_last_of("/");
+    /* 文件名不合法；splice 要预先知道长度，不支持分块编码的上传 */
+    if(filePath.empty() || chunked)
+    {
+        return BAD_REQUEST;
+    }
 
-    if(idx == string::npos)
+    if(content_length > maxSize)
     {
-        fileName = m_url;  
+        return REQUEST_TOO_LARGE;
     }
-    else 
+
+    /* 临时文件和目标文件在同一个目录下，rename 才是原子的 */
+    size_t slash = filePath.rfind('/');
+    uploadTemp.assign(filePath, 0, slash + 1);
+    uploadTemp.append(".");
+    uploadTemp.append(filePath, slash + 1, string::npos);
+    uploadTemp.append(".XXXXXX");
+    uploadFd = mkostemp(&uploadTemp[0], O_CLOEXEC);
+    if(uploadFd == -1)
+    {
+        /* 消息体还没有读，不知道下一个请求从哪里开始 */
+        isKeepLive = false;
+        return INTERNAL_ERROR;
+    }
+
+    /* mkostemp 创建的文件只有所有者可读，上传的文件还要能作为静态文件访问 */
+    fchmod(uploadFd, 0644);
+    /* 预先分配空间，大文件不会边写边分配，失败也不影响写入 */
+    if(content_length > 0)
+    {
+        fallocate(uploadFd, FALLOC_FL_KEEP_SIZE, 0, content_length);
+    }
+    uploadRemain = content_length;
+
+    /* 和请求头一起读到的那部分消息体已经在缓冲区里，直接写入文件（最多一个读缓冲区） */
+    size_t buffered = std::min(readBuffer.size() - curIdx, content_length);
+    while(buffered > 0)
     {
-        if(idx + 1 < m_url.size())
+        size_t len = 0;
+        const char* seg = readBuffer.peek(curIdx, &len);
+        ssize_t n = write(uploadFd, seg, std::min(len, buffered));
+        if(n <= 0)
         {
-            flag = m_url[idx + 1];
+            abortUpload();
+            isKeepLive = false;
+            return INTERNAL_ERROR;
         }
-        // POST请求
-        if((flag == '2' || flag == '3'))
+        curIdx += n;
+        buffered -= n;
+        uploadRemain -= n;
+    }
+
+    /* 客户端等 100 Continue 再发送消息体；前面还有回复没发出去时不能插队，客户端等待超时后会自己发送 */
+    if(uploadRemain > 0 && respCount == 0 && equalsIgnoreCase(getHeader("Expect"), "100-continue"))
+    {
+        static const char cont[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        if(ssl && !ktlsSend)
+        {
+            size_t written = 0;
+            SSL_write_ex(ssl, cont, sizeof(cont) - 1, &written);
+        }
+        else
         {
+            send(sockfd, cont, sizeof(cont) - 1, MSG_NOSIGNAL);
+        }
+    }
 
-            // 将user=123&passwd=123提取出来
-            auto nameIdx = requestBody.find_first_of("=");
-            auto split = requestBody.find_first_of("&");
-            auto pwdIdx = requestBody.find_last_of("=");
-            string name = requestBody.substr(nameIdx + 1, split - nameIdx);
-            string pwd = requestBody.substr(pwdIdx + 1);
-            
-            /* 注册 */
-            if(flag == '3')
-            {
-                // 修正后的SQL拼接
-                string sql = "insert into user(username, passwd) values('";
-                sql += name + "', '" + pwd + "')";  // 补充逗号和单引号
+    return transferUpload();
+}
 
-                // 用户名已经存在了
-                if(usersInfo.count(name))
-                {
-                    m_url = "/registerError.html";
-                }
-                /* 新用户 */
-                else
-                {
-                    std::lock_guard<std::mutex> locker(connMutex);
-                    int ret = mysql_query(m_mysql, sql.c_str());
-                    usersInfo.insert(std::make_pair(name, pwd));
-
-                    if(!ret)
-                    {
-                        m_url = "/log.html";
-                    }
-                    else
-                    {
-                        #ifdef debug
-                            std::cout << " mysql_errno(m_mysql) : " << mysql_errno(m_mysql) << std::endl;
-                        #endif
-                        m_url = "/registerError.html";
-                    }
-                }
-            }
+HttpConn::HTTP_CODE HttpConn::transferUpload()
+{
+    /* 接收方向由 OpenSSL 在用户空间解密，明文只能经用户空间写入文件 */
+    if(ssl && !ktlsRecv)
+    {
+        return transferTlsUpload();
+    }
 
-            /* 登录 */
-            else 
-            {
-                auto m_pwd = usersInfo.find(name);
-                if(m_pwd != usersInfo.end() && m_pwd->second == pwd)
-                {
-                    m_url = "/welcome.html";
-                }
-                else
-                {
-                    m_url = "/logError.html";
-                }
-            }
-        }
+    int* pipeFd = getPipe();
+    if(!pipeFd)
+    {
+        abortUpload();
+        isKeepLive = false;
+        return INTERNAL_ERROR;
+    }
 
-        // GET 请求
-        switch (flag)
+    while(uploadRemain > 0 || pipeBytes > 0)
+    {
+        /* 管道空了，从套接字再取一段：只移动页的引用，数据不复制到用户空间 */
+        if(pipeBytes == 0)
         {
-            case '0':   // 注册界面   
+            ssize_t n = splice(sockfd, nullptr, pipeFd[1], nullptr, std::min(uploadRemain, UPLOAD_SPLICE_CHUNK),
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if(n > 0)
             {
-                fileName = "/register.html";
-                break;
+                pipeBytes = n;
+                uploadRemain -= n;
+                continue;
             }
 
-            case '1':   // 登录界面
-            {
-                fileName = "/log.html";
-                break;
-            }
-            case '5':
+            /* 读空了，进度保存在 uploadRemain 中，可读时接着处理 */
+            if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
             {
-                fileName = "/picture.html";
-                break;
+                return NO_REQUEST;
             }
 
-            case '6' :
+            /* 消息体还没有收全，客户端关闭了连接 */
+            abortUpload();
+            return CLOSED_CONNECTION;
+        }
+
+        ssize_t n = splice(pipeFd[0], nullptr, uploadFd, nullptr, pipeBytes, SPLICE_F_MOVE);
+        if(n <= 0)
+        {
+            if(n == -1 && errno == EINTR)
             {
-                fileName = "/video.html";
-                break;
+                continue;
             }
 
-            case '7':
+            /* 磁盘满等写入错误，剩下的消息体不再接收 */
+            abortUpload();
+            isKeepLive = false;
+            return INTERNAL_ERROR;
+        }
+        pipeBytes -= n;
+    }
+
+    return finishUpload();
+}
+
+HttpConn::HTTP_CODE HttpConn::transferTlsUpload()
+{
+    static thread_local char record[TLS_RECORD_SIZE];
+
+    while(uploadRemain > 0)
+    {
+        ssize_t n = tlsRead(record, std::min(uploadRemain, TLS_RECORD_SIZE));
+        if(n <= 0)
+        {
+            if(n == -1 && errno == EAGAIN)
             {
-                fileName = "/fans.html";
-                break;
+                return NO_REQUEST;
             }
-                
-            default:
+
+            abortUpload();
+            return CLOSED_CONNECTION;
+        }
+        uploadRemain -= n;
+
+        for(ssize_t off = 0; off < n; )
+        {
+            ssize_t ret = write(uploadFd, record + off, n - off);
+            if(ret <= 0)
             {
-                fileName = m_url;
-                break;
+                abortUpload();
+                isKeepLive = false;
+                return INTERNAL_ERROR;
             }
+            off += ret;
         }
-
     }
 
+    return finishUpload();
+}
 
-    filePath = rootPath + fileName;
-    #ifdef debug
-        std::cout << "filePath: " << filePath << std::endl;
-    #endif
-
-    int ret = stat(filePath.c_str(), &fileInfo);
-    if(ret == -1)
+HttpConn::HTTP_CODE HttpConn::finishUpload()
+{
+    /* 改名之后其他请求才能看到这个文件，不会读到写了一半的内容 */
+    close(uploadFd);
+    uploadFd = -1;
+    if(rename(uploadTemp.c_str(), filePath.c_str()) == -1)
     {
-        return NO_RESOURCE;
+        unlink(uploadTemp.c_str());
+        return INTERNAL_ERROR;
     }
 
-    // 检查是否为普通文件（非目录、管道等）
-    if (!S_ISREG(fileInfo.st_mode)) 
-    {
-        return BAD_REQUEST; // 不是普通文件
-    }
+    return FILE_CREATED;
+}
 
-    // 检查权限
-    if(!(fileInfo.st_mode & S_IROTH))
+void HttpConn::abortUpload()
+{
+    if(uploadFd == -1)
     {
-        return FORBIDDEN_REQUEST;
+        return;
     }
 
+    close(uploadFd);
+    uploadFd = -1;
+    unlink(uploadTemp.c_str());
 
-    // 获得文件描述符
-    int fd = open(filePath.c_str(), O_RDONLY);
-    if(fd == -1)
+    /* 管道里剩下的是这个消息体的数据 */
+    if(pipeBytes > 0)
     {
-        return INTERNAL_ERROR;
+        closePipe();
     }
+}
 
-    // 把文件内容映射到内存中
-    fileAddr = static_cast<char*>(mmap(nullptr, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0));
-    
-    // 关闭文件描述符
-    close(fd);
-
-    return FILE_REQUETS;
+/* 从 "user=123&passwd=123" 中取出用户名和密码 */
+static void parseUserPwd(const string& body, string& name, string& pwd)
+{
+    auto nameIdx = body.find_first_of("=");
+    auto split = body.find_first_of("&");
+    auto pwdIdx = body.find_last_of("=");
+    name = body.substr(nameIdx + 1, split - nameIdx);
+    pwd = body.substr(pwdIdx + 1);
 }
 
-void HttpConn::unmap()
+string_view HttpConn::doLogin(HttpConn* conn)
 {
-    if(fileAddr)
+    string name, pwd;
+    parseUserPwd(conn->requestBody, name, pwd);
+
+    std::lock_guard<std::mutex> locker(connMutex);
+    auto m_pwd = usersInfo.find(name);
+    if(m_pwd != usersInfo.end() && m_pwd->second == pwd)
     {
-        munmap(fileAddr, fileInfo.st_size);
-        fileAddr = nullptr;
+        return "/welcome.html";
     }
+    return "/logError.html";
 }
 
-bool HttpConn::addResponse(const char* format, ...)
+string_view HttpConn::doRegister(HttpConn* conn)
 {
-    if(writeIdx >= WRITE_BUFF_SIZE) return false;
+    string name, pwd;
+    parseUserPwd(conn->requestBody, name, pwd);
+
+    // 用户名已经存在了
+    std::lock_guard<std::mutex> locker(connMutex);
+    if(usersInfo.count(name))
+    {
+        return "/registerError.html";
+    }
+
+    /* 新用户 */
+    string sql = "insert into user(username, passwd) values('";
+    sql += name + "', '" + pwd + "')";
+    int ret = mysql_query(conn->m_mysql, sql.c_str());
+    usersInfo.insert(std::make_pair(name, pwd));
+    if(ret)
+    {
+        #ifdef debug
+            std::cout << " mysql_errno(m_mysql) : " << mysql_errno(conn->m_mysql) << std::endl;
+        #endif
+        return "/registerError.html";
+    }
+
+    return "/log.html";
+}
+
+HttpConn::HTTP_CODE HttpConn::do_request()
+{
+    /* 查询字符串不参与路由 */
+    string_view path = m_url.substr(0, scanChar(m_url.data(), m_url.size(), '?'));
+
+    /* 不支持的方法：路径有其他方法的路由时回复 405，否则 501，也不做协议升级 */
+    if(m_method == OTHER)
+    {
+        allowMethods = Router::getInstance()->allowedMethods(path);
+        return allowMethods.empty() ? NOT_IMPLEMENTED : METHOD_NOT_ALLOWED;
+    }
+
+    /* 升级到 h2c 时这个请求由 HTTP/2 的流 1 处理 */
+    if(!h2 && isUpgradeH2c())
+    {
+        return SWITCH_PROTOCOL;
+    }
+
+    if(!h2 && isUpgradeWebSocket(path))
+    {
+        return SWITCH_PROTOCOL;
+    }
+
+    if(!Router::getInstance()->dispatch(this, m_method, path, filePath))
+    {
+        return NO_RESOURCE;
+    }
+
+    /* 流式回复没有对应的文件；HTTP/2 的流不分块，一次生成全部输出 */
+    if(producer)
+    {
+        if(h2)
+        {
+            string out;
+            bool more = true;
+            while(more)
+            {
+                ChunkedEncoder::begin(out);
+                more = producer(out);
+                generatedBody.append(out, ChunkedEncoder::RESERVE, string::npos);
+            }
+            producer = nullptr;
+        }
+        return STREAM_REQUEST;
+    }
+    #ifdef debug
+        std::cout << "filePath: " << filePath << std::endl;
+    #endif
+
+    /* 命中缓存时不需要任何文件系统调用 */
+    FileCache* fileCache = FileCache::getInstance();
+    /* 范围是按原始文件计算的，范围请求不使用压缩版本 */
+    int accepted = (getHeader("Range").empty() ? acceptEncodings() : 1 << ENCODING_IDENTITY);
+    fileEntry = fileCache->get(filePath);
+    if(!fileEntry)
+    {
+        int ret = stat(filePath.c_str(), &fileInfo);
+        if(ret == -1)
+        {
+            return NO_RESOURCE;
+        }
+
+        // 检查是否为普通文件（非目录、管道等）
+        if (!S_ISREG(fileInfo.st_mode)) 
+        {
+            return BAD_REQUEST; // 不是普通文件
+        }
+
+        // 检查权限
+        if(!(fileInfo.st_mode & S_IROTH))
+        {
+            return FORBIDDEN_REQUEST;
+        }
+
+        // 客户端缓存仍然有效时不需要打开文件，压缩版本的 ETag 按将要选择的编码推算
+        vary = FileCache::isCompressible(filePath, fileInfo.st_size);
+        int predicted = (vary ? accepted & FileCache::supportedEncodings() : 1 << ENCODING_IDENTITY);
+        for(int i = ENCODING_COUNT - 1; i >= ENCODING_IDENTITY; --i)
+        {
+            if(predicted & (1 << i))
+            {
+                encoding = static_cast<ENCODING>(i);
+                break;
+            }
+        }
+        FileCache::makeValidators(fileInfo, encoding, etag, sizeof(etag), lastModified, sizeof(lastModified));
+        if(m_method == GET && isNotModified())
+        {
+            return NOT_MODIFIED;
+        }
+
+        // 打开（映射）文件，放入缓存
+        fileEntry = fileCache->load(filePath);
+        if(!fileEntry)
+        {
+            return INTERNAL_ERROR;
+        }
+    }
+
+    /* 选择客户端接受且已经生成的优先级最高的编码 */
+    fileInfo = fileEntry->info;
+    vary = fileEntry->compressible;
+    encoding = ENCODING_IDENTITY;
+    for(int i = ENCODING_COUNT - 1; i > ENCODING_IDENTITY; --i)
+    {
+        if((accepted & (1 << i)) && fileEntry->variants[i].ready)
+        {
+            encoding = static_cast<ENCODING>(i);
+            break;
+        }
+    }
+    memcpy(etag, fileEntry->variants[encoding].etag, sizeof(etag));
+    memcpy(lastModified, fileEntry->lastModified, sizeof(lastModified));
+
+    /* 304 和 416 没有文件内容 */
+    if(m_method == GET && isNotModified())
+    {
+        fileEntry.reset();
+        return NOT_MODIFIED;
+    }
+
+    HTTP_CODE code = parseRange();
+    if(code == RANGE_NOT_SATISFIABLE)
+    {
+        fileEntry.reset();
+    }
+    else if(code == PARTIAL_CONTENT && rangeCount > 1 && !makeMultipart())
+    {
+        return INTERNAL_ERROR;
+    }
+
+    return code;
+}
+
+bool HttpConn::isUpgradeH2c()
+{
+    /* 带消息体的请求不升级，按 HTTP/1.1 回复即可；HTTPS 通过 ALPN 协商 h2 */
+    if(ssl || draining || content_length > 0 || chunked || getHeader("HTTP2-Settings").empty())
+    {
+        return false;
+    }
+
+    return hasToken(getHeader("Connection"), "Upgrade") && hasToken(getHeader("Upgrade"), "h2c");
+}
+
+void HttpConn::upgradeH2()
+{
+    /* 流 1 复制当前请求，之后读缓冲区里的请求数据就可以丢弃了 */
+    h2.reset(new Http2Session(this));
+    if(!h2->upgrade(getHeader("HTTP2-Settings")))
+    {
+        h2.reset();
+        shutdown(sockfd, SHUT_RDWR);
+        loop->modConn(sockfd, EPOLLIN);
+        return;
+    }
+
+    isKeepLive = true;
+    addBytes("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+    queueResponse();
+
+    /* 101 之后紧接着是服务器的 SETTINGS 和流 1 的回复 */
+    processH2();
+}
+
+void HttpConn::processH2()
+{
+    pendingRequest = false;
+
+    bool alive = h2->process();
+    keepConn = alive;
+    if(respCount == 0)
+    {
+        /* 出错或 GOAWAY 之后所有的流都结束了，由事件循环在挂断事件里关闭连接 */
+        if(!alive)
+        {
+            shutdown(sockfd, SHUT_RDWR);
+        }
+        loop->modConn(sockfd, EPOLLIN);
+        return;
+    }
+
+    /* 发送队列满了还有数据可以发送时，这一批发送完不等读事件直接继续 */
+    pendingRequest = h2->hasPending();
+    loop->modConn(sockfd, EPOLLOUT);
+}
+
+bool HttpConn::isUpgradeWebSocket(string_view path)
+{
+    if(draining || m_method != GET || content_length > 0 || chunked)
+    {
+        return false;
+    }
+
+    /* Sec-WebSocket-Key 是 16 字节随机数的 base64 编码 */
+    if(getHeader("Sec-WebSocket-Key").size() != 24 || getHeader("Sec-WebSocket-Version") != "13")
+    {
+        return false;
+    }
+
+    if(!hasToken(getHeader("Connection"), "Upgrade") || !hasToken(getHeader("Upgrade"), "websocket"))
+    {
+        return false;
+    }
+
+    wsRoute = Router::getInstance()->findWebSocket(path);
+    return wsRoute != nullptr;
+}
+
+void HttpConn::upgradeWebSocket()
+{
+    /* 升级请求的路径作为频道名，会话在 101 发送完之后才开始处理帧 */
+    string_view path = m_url.substr(0, scanChar(m_url.data(), m_url.size(), '?'));
+    ws.reset(new WebSocket(this, string(path), wsRoute));
+
+    isKeepLive = true;
+    bool ret = addBytes("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n")
+        && addBytes("Sec-WebSocket-Accept: ") && addBytes(WebSocket::acceptKey(getHeader("Sec-WebSocket-Key")))
+        && addBlankLine() && addBlankLine();
+    if(!ret)
+    {
+        ws.reset();
+        shutdown(sockfd, SHUT_RDWR);
+        loop->modConn(sockfd, EPOLLIN);
+        return;
+    }
+    queueResponse();
+
+    pendingRequest = false;
+    loop->modConn(sockfd, EPOLLOUT);
+}
+
+void HttpConn::processWs()
+{
+    /* 控制帧的回复和回调发送的帧放入发送队列，这一批由事件循环接着发送 */
+    ws->process();
+    ws->fill();
+}
+
+void HttpConn::startStream(StreamProducer m_producer, string_view contentType)
+{
+    producer = std::move(m_producer);
+    streamType = contentType;
+}
+
+void HttpConn::produceChunk()
+{
+    Response& resp = responses[respCount];
+    resp.file.reset();
+    resp.fileOff = 0;
+
+    /* 空的一段不发送，直接生成下一段 */
+    string& out = resp.body;
+    bool more = true;
+    size_t start = 0;
+    do
+    {
+        ChunkedEncoder::begin(out);
+        more = producer(out);
+        if(streamChunked)
+        {
+            start = ChunkedEncoder::finish(out, !more);
+        }
+        else
+        {
+            start = ChunkedEncoder::RESERVE;
+        }
+    }
+    while(more && start == out.size());
+
+    /* 只有 HTTP/1.0 的最后一段可能为空，输出以关闭连接结束 */
+    resp.fileSize = out.size() - start;
+    if(resp.fileSize > 0)
+    {
+        queueSegment(&out[start], resp.fileSize);
+    }
+
+    if(!more)
+    {
+        /* 输出结束，流水线中后面的请求接着处理 */
+        producer = nullptr;
+        keepConn = streamKeepAlive;
+        if(!keepConn)
+        {
+            readBuffer.clear();
+        }
+    }
+}
+
+string_view HttpConn::getHeader(string_view key)
+{
+    for(int i = 0; i < headerCount; ++i)
+    {
+        if(equalsIgnoreCase(headers[i].key, key))
+        {
+            return headers[i].value;
+        }
+    }
+    return string_view();
+}
+
+bool HttpConn::isNotModified()
+{
+    /* 两个都有时以 If-None-Match 为准 */
+    string_view noneMatch = getHeader("If-None-Match");
+    if(!noneMatch.empty())
+    {
+        if(trimSpace(noneMatch) == "*")
+        {
+            return true;
+        }
+
+        /* 逗号分隔的列表，弱比较：忽略 W/ 前缀 */
+        string_view tag(etag);
+        while(!noneMatch.empty())
+        {
+            size_t comma = scanChar(noneMatch.data(), noneMatch.size(), ',');
+            string_view item = trimSpace(noneMatch.substr(0, comma));
+            if(item.substr(0, 2) == "W/")
+            {
+                item.remove_prefix(2);
+            }
+            if(item == tag)
+            {
+                return true;
+            }
+            noneMatch.remove_prefix(comma == noneMatch.size() ? comma : comma + 1);
+        }
+        return false;
+    }
+
+    string_view modifiedSince = getHeader("If-Modified-Since");
+    if(!modifiedSince.empty())
+    {
+        char date[64];
+        size_t len = std::min(modifiedSince.size(), sizeof(date) - 1);
+        memcpy(date, modifiedSince.data(), len);
+        date[len] = '\0';
+
+        struct tm tmInfo;
+        memset(&tmInfo, 0, sizeof(tmInfo));
+        if(strptime(date, "%a, %d %b %Y %H:%M:%S GMT", &tmInfo) == nullptr)
+        {
+            return false;
+        }
+
+        /* HTTP 日期只精确到秒 */
+        return fileInfo.st_mtime <= timegm(&tmInfo);
+    }
+
+    return false;
+}
+
+int HttpConn::acceptEncodings()
+{
+    /* identity 总是可以接受 */
+    int mask = (1 << ENCODING_IDENTITY);
+
+    string_view accept = getHeader("Accept-Encoding");
+    while(!accept.empty())
+    {
+        size_t comma = scanChar(accept.data(), accept.size(), ',');
+        string_view item = accept.substr(0, comma);
+        accept.remove_prefix(comma == accept.size() ? comma : comma + 1);
+
+        /* 形如 "gzip;q=0.8"，q 为 0 表示不接受 */
+        size_t semi = scanChar(item.data(), item.size(), ';');
+        string_view name = trimSpace(item.substr(0, semi));
+        if(semi < item.size())
+        {
+            string_view param = trimSpace(item.substr(semi + 1));
+            if(param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '='
+                && param.find_first_not_of("0.", 2) == string_view::npos)
+            {
+                continue;
+            }
+        }
+
+        if(equalsIgnoreCase(name, "gzip") || equalsIgnoreCase(name, "x-gzip"))
+        {
+            mask |= (1 << ENCODING_GZIP);
+        }
+        else if(equalsIgnoreCase(name, "br"))
+        {
+            mask |= (1 << ENCODING_BROTLI);
+        }
+        else if(name == "*")
+        {
+            mask |= (1 << ENCODING_COUNT) - 1;
+        }
+    }
+
+    return mask;
+}
+
+/* multipart/byteranges 的分隔符，进程启动时随机生成 */
+static const string& rangeBoundary()
+{
+    static const string boundary = []()
+    {
+        std::random_device rd;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%08x%08x", rd(), rd());
+        return string(buf);
+    }();
+    return boundary;
+}
+
+/* 解析 Range 中的一个非负整数 */
+static bool parseOffset(string_view str, off_t& value)
+{
+    auto ret = std::from_chars(str.data(), str.data() + str.size(), value);
+    return ret.ec == std::errc() && ret.ptr == str.data() + str.size() && value >= 0;
+}
+
+HttpConn::HTTP_CODE HttpConn::parseRange()
+{
+    rangeCount = 0;
+
+    off_t size = fileInfo.st_size;
+    string_view range = trimSpace(getHeader("Range"));
+    if(m_method != GET || size == 0 || range.size() < 6 || !equalsIgnoreCase(range.substr(0, 6), "bytes="))
+    {
+        return FILE_REQUETS;
+    }
+
+    /* If-Range 不匹配说明客户端手里的是旧版本，返回整个文件；ETag 用强比较 */
+    string_view ifRange = trimSpace(getHeader("If-Range"));
+    if(!ifRange.empty() && ifRange != etag && ifRange != lastModified)
+    {
+        return FILE_REQUETS;
+    }
+
+    /* 语法错误时忽略整个 Range 头，返回整个文件 */
+    int count = 0;
+    off_t total = 0;
+    range.remove_prefix(6);
+    while(!range.empty())
+    {
+        size_t comma = scanChar(range.data(), range.size(), ',');
+        string_view spec = trimSpace(range.substr(0, comma));
+        range.remove_prefix(comma == range.size() ? comma : comma + 1);
+        if(spec.empty())
+        {
+            continue;
+        }
+
+        size_t dash = spec.find('-');
+        if(dash == string_view::npos)
+        {
+            return FILE_REQUETS;
+        }
+        string_view firstStr = trimSpace(spec.substr(0, dash));
+        string_view lastStr = trimSpace(spec.substr(dash + 1));
+
+        off_t first = 0;
+        off_t last = size - 1;
+        if(firstStr.empty())
+        {
+            /* "-n" 表示最后 n 个字节 */
+            off_t suffix = 0;
+            if(!parseOffset(lastStr, suffix))
+            {
+                return FILE_REQUETS;
+            }
+            if(suffix == 0)
+            {
+                continue;
+            }
+            first = (suffix < size ? size - suffix : 0);
+        }
+        else
+        {
+            if(!parseOffset(firstStr, first))
+            {
+                return FILE_REQUETS;
+            }
+            if(!lastStr.empty())
+            {
+                if(!parseOffset(lastStr, last) || last < first)
+                {
+                    return FILE_REQUETS;
+                }
+                last = std::min(last, size - 1);
+            }
+            /* 起点在文件之外的范围无法满足 */
+            if(first >= size)
+            {
+                continue;
+            }
+        }
+
+        if(count == MAX_RANGES)
+        {
+            return FILE_REQUETS;
+        }
+        ranges[count++] = {first, last};
+        total += last - first + 1;
+    }
+
+    if(count == 0)
+    {
+        return RANGE_NOT_SATISFIABLE;
+    }
+
+    /* 范围重叠得比整个文件还大，不如直接返回整个文件 */
+    if(count > 1 && total > size)
+    {
+        return FILE_REQUETS;
+    }
+
+    /* multipart 消息体太大时合并成一个覆盖所有范围的范围 */
+    if(count > 1 && (size_t)total > RANGE_MULTIPART_MAX)
+    {
+        for(int i = 1; i < count; ++i)
+        {
+            ranges[0].first = std::min(ranges[0].first, ranges[i].first);
+            ranges[0].last = std::max(ranges[0].last, ranges[i].last);
+        }
+        count = 1;
+    }
+
+    rangeCount = count;
+    return PARTIAL_CONTENT;
+}
+
+bool HttpConn::makeMultipart()
+{
+    const string& boundary = rangeBoundary();
+    char partHeader[192];
+
+    multipartBody.clear();
+    for(int i = 0; i < rangeCount; ++i)
+    {
+        off_t len = ranges[i].last - ranges[i].first + 1;
+        int headerLen = snprintf(partHeader, sizeof(partHeader), "\r\n--%s\r\n%.*sContent-Range: bytes %ld-%ld/%ld\r\n\r\n",
+            boundary.c_str(), (int)fileEntry->contentType.size(), fileEntry->contentType.data(),
+            (long)ranges[i].first, (long)ranges[i].last, (long)fileInfo.st_size);
+        multipartBody.append(partHeader, headerLen);
+
+        /* sendfile 模式下没有映射，从 fd 读取 */
+        if(fileEntry->addr)
+        {
+            multipartBody.append(fileEntry->addr + ranges[i].first, len);
+        }
+        else
+        {
+            size_t start = multipartBody.size();
+            multipartBody.resize(start + len);
+            if(pread(fileEntry->fd, &multipartBody[start], len, ranges[i].first) != len)
+            {
+                return false;
+            }
+        }
+    }
+    multipartBody.append("\r\n--" + boundary + "--\r\n");
+
+    return true;
+}
+
+void HttpConn::unmap()
+{
+    fileEntry.reset();
+}
+
+bool HttpConn::addBytes(string_view data)
+{
+    if(writeIdx + data.size() >= WRITE_BUFF_SIZE) return false;
+    if(!writeBuffer)
+    {
+        writeBuffer = BufferPool::getInstance()->get();
+    }
+
+    memcpy(writeBuffer + writeIdx, data.data(), data.size());
+    writeIdx += data.size();
+    return true;
+}
+
+bool HttpConn::addNumber(long value)
+{
+    char buf[24];
+    auto ret = std::to_chars(buf, buf + sizeof(buf), value);
+    return addBytes(string_view(buf, ret.ptr - buf));
+}
+
+bool HttpConn::addResponse(const char* format, ...)
+{
+    if(writeIdx >= WRITE_BUFF_SIZE) return false;
+    if(!writeBuffer)
+    {
+        writeBuffer = BufferPool::getInstance()->get();
+    }
 
     va_list arg_list;
     va_start(arg_list, format);
@@ -529,143 +1525,445 @@ bool HttpConn::addResponse(const char* format, ...)
     return true;
 }
 
-bool HttpConn::addStatuLine(int code, string text)
+bool HttpConn::addStatuLine(int code)
 {
-    return addResponse("%s %d %s\r\n", m_version.c_str(), code, text.c_str());
+    return addBytes(statusLine(code)) && addBytes(dateHeader());
 }
 
-bool HttpConn::addHeader(int len)
+bool HttpConn::addFixed(int code)
 {
-    return  addContentLen(len) && addIsKeepLive() && addBlankLine();
+    fixedBody = fixedResponse(code, isKeepLive);
+    return true;
 }
 
-bool HttpConn::addContentLen(int len)
+bool HttpConn::addContentLen(size_t len)
 {
-    return addResponse("Content-Length:%d\r\n", len);
+    return addBytes("Content-Length:") && addNumber(len) && addBlankLine();
 }
 
 bool HttpConn::addContentType()
 {
-    return addResponse("Content-Type:%s\r\n", "text/html; charset=UTF-8");
+    return addBytes(fileEntry->contentType);
 }
 
 bool HttpConn::addIsKeepLive()
 {
-    string conn = (isKeepLive ? "keep-alive" : "closed");
-    return addResponse("Connection: %s\r\n", conn.c_str());
+    return addBytes(isKeepLive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+}
+
+bool HttpConn::addValidators()
+{
+    return (!vary || addBytes("Vary: Accept-Encoding\r\n"))
+        && addBytes("ETag: ") && addBytes(etag) && addBlankLine()
+        && addBytes("Last-Modified: ") && addBytes(lastModified) && addBlankLine();
+}
+
+bool HttpConn::addBlankLine()
+{
+    return addBytes("\r\n");
+}
+
+
+bool HttpConn::readFromClnt()
+{
+    int len = 0;
+    while(true)
+    {
+        /**
+         * 缓冲区满了先交给线程池：上传的消息体不需要读进缓冲区，
+         * 普通请求超过上限时由 process 关闭连接
+         */
+        if(!readBuffer.ensureWritable(maxRequestSize))
+        {
+            break;
+        }
+
+        if(ssl && !ktlsRecv)
+        {
+            len = tlsRead(readBuffer.beginWrite(), readBuffer.writableBytes());
+        }
+        else
+        {
+            len = recv(sockfd, readBuffer.beginWrite(), readBuffer.writableBytes(), 0);
+        }
+
+        if(len == -1)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // 读空了
+                break;
+            }
+            return false;
+        }
+        else if(len == 0)
+        {
+            // 客户端关闭连接了
+            return false;
+        }
+        else if(len > 0)
+        {
+            readBuffer.hasWritten(len);
+        }
+    }
+
+    return true;
+}
+
+bool HttpConn::appendRead(const char* buf, int len)
+{
+    return readBuffer.append(buf, len, maxRequestSize);
+}
+
+void HttpConn::updateIov(size_t len)
+{
+    bytesHaveSend += len;
+    bytesToSend -= len;
+
+    /* 跳过已经发完的部分，下次从 iov[iovIdx] 继续 */
+    while(len > 0 && iovIdx < iovCount)
+    {
+        if(len >= iov[iovIdx].iov_len)
+        {
+            len -= iov[iovIdx].iov_len;
+            iov[iovIdx].iov_len = 0;
+            ++iovIdx;
+        }
+        else
+        {
+            /* sendfile 的那一项偏移记录在 fileOff 中 */
+            if(iov[iovIdx].iov_base)
+            {
+                iov[iovIdx].iov_base = static_cast<char*>(iov[iovIdx].iov_base) + len;
+            }
+            else
+            {
+                responses[iovIdx / 2].fileOff += len;
+            }
+            iov[iovIdx].iov_len -= len;
+            len = 0;
+        }
+    }
+
+    /* 跳过长度为 0 的项，保证 atFileSegment 看到的是下一段要发送的数据 */
+    while(iovIdx < iovCount && iov[iovIdx].iov_len == 0)
+    {
+        ++iovIdx;
+    }
+}
+
+int HttpConn::getIovCount()
+{
+    /* 只返回到下一个 sendfile 段之前的部分 */
+    int end = iovIdx;
+    while(end < iovCount && (iov[end].iov_base || iov[end].iov_len == 0))
+    {
+        ++end;
+    }
+    return end - iovIdx;
+}
+
+msghdr* HttpConn::getMsg(bool& more)
+{
+    int count = getIovCount();
+    memset(&sendMsg, 0, sizeof(sendMsg));
+    sendMsg.msg_iov = getIov();
+    sendMsg.msg_iovlen = count;
+    more = (iovIdx + count < iovCount);
+    return &sendMsg;
+}
+
+bool HttpConn::atFileSegment()
+{
+    return iovIdx < iovCount && !iov[iovIdx].iov_base && iov[iovIdx].iov_len > 0;
+}
+
+int HttpConn::getFileFd()
+{
+    return responses[iovIdx / 2].file->fd;
+}
+
+off_t HttpConn::getFileOffset()
+{
+    return responses[iovIdx / 2].fileOff;
+}
+
+size_t HttpConn::getFileRemain()
+{
+    return iov[iovIdx].iov_len;
 }
 
-bool HttpConn::addBlankLine()
+int* HttpConn::getPipe()
 {
-    return addResponse("%s","\r\n");
+    if(pipeFd[0] == -1 && pipe2(pipeFd, O_CLOEXEC) == -1)
+    {
+        pipeFd[0] = pipeFd[1] = -1;
+        return nullptr;
+    }
+    return pipeFd;
 }
 
-bool HttpConn::addContent(string text)
+void HttpConn::closePipe()
 {
-    return addResponse("%s", text.c_str());
+    if(pipeFd[0] != -1)
+    {
+        close(pipeFd[0]);
+        close(pipeFd[1]);
+        pipeFd[0] = pipeFd[1] = -1;
+    }
+    pipeBytes = 0;
 }
 
-
-bool HttpConn::readFromClnt()
+bool HttpConn::writeDone()
 {
-    if(readIdx >= READ_BUFF_SIZE) return false;
+    clearResponses();
 
-    int len = 0;
-    while(true)
+    /* WebSocket：发送队列中还有帧时接着放入回复队列，关闭帧发送完后关闭连接 */
+    if(ws && keepConn)
     {
-        len = recv(sockfd, readBuffer + readIdx, READ_BUFF_SIZE - readIdx, 0);
-
-        if(len == -1)
-        {
-            if(errno == EAGAIN || errno == EWOULDBLOCK)
-            {
-                // 读空了
-                break;
-            }
-            return false;
-        }
-        else if(len == 0)
-        {
-            // 客户端关闭连接了
-            return false;
-        }
-        else if(len > 0)
-        {
-            readIdx += len;
-        }
+        keepConn = ws->writeDone();
     }
-
-    return true;
+    return keepConn;
 }
 
 bool HttpConn::writeToClnt()
 {
-    int ret = 0;
+    ssize_t ret = 0;
     if(bytesToSend == 0)
     {
-        modfd(epollfd, sockfd, EPOLLIN);
-        init();
+        clearResponses();
+        loop->modConn(sockfd, EPOLLIN);
         return true;
     }
 
     while(true)
     {
-        ret = writev(sockfd, iov, iovCount);
+        if(ssl && !ktlsSend)
+        {
+            /* 发送方向没有卸载到内核：由 OpenSSL 加密，文件内容也要先读到用户空间 */
+            ret = tlsWrite();
+        }
+        else if(atFileSegment())
+        {
+            /* 文件内容：内核从页缓存直接发送，偏移由 sendfile 更新 */
+            off_t off = getFileOffset();
+            ret = sendfile(sockfd, getFileFd(), &off, getFileRemain());
+        }
+        else
+        {
+            /* 后面还有 sendfile 段时带上 MSG_MORE，回复头和文件内容合并成完整的报文 */
+            int count = getIovCount();
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = getIov();
+            msg.msg_iovlen = count;
+            ret = sendmsg(sockfd, &msg, MSG_NOSIGNAL | (iovIdx + count < iovCount ? MSG_MORE : 0));
+        }
+
         if(ret == -1)
         {
             if(errno == EAGAIN)
             {
-                modfd(epollfd, sockfd, EPOLLOUT);
+                loop->modConn(sockfd, EPOLLOUT);
                 return true;
             }
-            unmap();
             return false;
         }
 
-        bytesHaveSend += ret;
-        bytesToSend -= ret;
+        updateIov(ret);
 
-        if(bytesHaveSend >= iov[0].iov_len)
+        if(bytesToSend == 0)
         {
-            iov[0].iov_len = 0;
-            iov[1].iov_base = fileAddr + (bytesHaveSend - writeIdx);
-            iov[1].iov_len = bytesToSend;
+            if(!writeDone())
+            {
+                return false;
+            }
+
+            /* WebSocket 发送队列中的帧接着发送 */
+            if(bytesToSend > 0)
+            {
+                continue;
+            }
+
+            /* 还有排队的请求时由事件循环交给线程池，不再等待读事件 */
+            if(!pendingRequest)
+            {
+                loop->modConn(sockfd, EPOLLIN);
+            }
+            return true;
         }
-        else
+
+    }
+
+
+    return true;
+}
+
+int HttpConn::tlsHandshake()
+{
+    if(!ssl)
+    {
+        return -1;
+    }
+
+    ERR_clear_error();
+    int ret = SSL_accept(ssl);
+    if(ret != 1)
+    {
+        int err = SSL_get_error(ssl, ret);
+        if(err == SSL_ERROR_WANT_READ)
         {
-            iov[0].iov_base = writeBuffer + bytesHaveSend;
-            iov[0].iov_len = iov[0].iov_len - bytesHaveSend;
+            return EPOLLIN;
         }
+        if(err == SSL_ERROR_WANT_WRITE)
+        {
+            return EPOLLOUT;
+        }
+
+        #ifdef debug
+            ERR_print_errors_fp(stderr);
+        #endif
+        return -1;
+    }
 
-        if(bytesToSend <= 0)
+    /* OpenSSL 在握手完成时尝试启用 kTLS，内核或密码套件不支持的方向仍在用户空间处理 */
+    tlsHandshaking = false;
+    #ifndef OPENSSL_NO_KTLS
+        ktlsSend = BIO_get_ktls_send(SSL_get_wbio(ssl));
+        ktlsRecv = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+    #endif
+
+    #ifdef debug
+        std::cout << "TLS " << SSL_get_version(ssl) << " " << SSL_get_cipher_name(ssl)
+                  << (SSL_session_reused(ssl) ? " (resumed)" : "")
+                  << " ktls send = " << ktlsSend << " recv = " << ktlsRecv << std::endl;
+    #endif
+    return 0;
+}
+
+ssize_t HttpConn::tlsRead(char* buf, size_t len)
+{
+    size_t n = 0;
+    ERR_clear_error();
+    if(SSL_read_ex(ssl, buf, len, &n) == 1)
+    {
+        return n;
+    }
+
+    int err = SSL_get_error(ssl, 0);
+    if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+    {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    /* 对端发送了 close_notify */
+    if(err == SSL_ERROR_ZERO_RETURN)
+    {
+        return 0;
+    }
+
+    errno = ECONNRESET;
+    return -1;
+}
+
+ssize_t HttpConn::tlsWrite()
+{
+    static thread_local char record[TLS_RECORD_SIZE];
+
+    const char* data = record;
+    size_t len = 0;
+    if(iov[iovIdx].iov_base && iov[iovIdx].iov_len >= TLS_RECORD_SIZE)
+    {
+        /* 大块的内存直接交给 OpenSSL，不先复制 */
+        data = static_cast<const char*>(iov[iovIdx].iov_base);
+        len = iov[iovIdx].iov_len;
+    }
+    else
+    {
+        /* 回复头、小的消息体拼成一个记录，减少记录的开销和系统调用；sendfile 段从文件读出来 */
+        for(int i = iovIdx; i < iovCount && len < TLS_RECORD_SIZE; ++i)
         {
-            unmap();
-            modfd(epollfd, sockfd, EPOLLIN);
-            if(isKeepLive)
+            size_t n = std::min(iov[i].iov_len, TLS_RECORD_SIZE - len);
+            if(n == 0)
             {
-                init();
-                return true;
+                continue;
             }
-            else
+
+            if(iov[i].iov_base)
             {
-                return false;
+                memcpy(record + len, iov[i].iov_base, n);
+                len += n;
+                continue;
             }
-        }
 
+            ssize_t ret = pread(responses[i / 2].file->fd, record + len, n, responses[i / 2].fileOff);
+            if(ret <= 0)
+            {
+                /* 文件被截短了，已经发出的回复头无法收回，只能关闭连接 */
+                if(len == 0)
+                {
+                    errno = EIO;
+                    return -1;
+                }
+                break;
+            }
+            len += ret;
+            if((size_t)ret < n)
+            {
+                break;
+            }
+        }
     }
 
+    /* 没写完时下次从同样的位置重新拼出同样的数据，OpenSSL 允许缓冲区地址改变 */
+    size_t written = 0;
+    ERR_clear_error();
+    if(SSL_write_ex(ssl, data, len, &written) == 1)
+    {
+        return written;
+    }
 
-    return true;
+    int err = SSL_get_error(ssl, 0);
+    errno = (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) ? EAGAIN : EPIPE;
+    return -1;
 }
 
+void HttpConn::freeSsl()
+{
+    if(!ssl)
+    {
+        return;
+    }
+
+    /* 只发送 close_notify，不等待对端的回复 */
+    if(!tlsHandshaking)
+    {
+        SSL_shutdown(ssl);
+    }
+    SSL_free(ssl);
+    ssl = nullptr;
+    tlsHandshaking = false;
+}
 
 void HttpConn::closeConn(bool isClose)
 {
     if(isClose && sockfd != -1)
     {
-        removeFd(epollfd, sockfd);
+        /* 关闭之后 fd 可能马上被其他 reactor 复用，先清理自身状态 */
+        int fd = sockfd;
         sockfd = -1;
         --userCount;
+        unmap();
+        clearResponses();
+        abortUpload();
+        closePipe();
+        releaseBuffer();
+        h2.reset();
+        ws.reset();
+        producer = nullptr;
+        freeSsl();
+        loop->closeConn(fd);
     }
 
 }
@@ -674,19 +1972,31 @@ HttpConn::HTTP_CODE HttpConn::processRead()
 {
     HTTP_CODE code = NO_REQUEST;
     LINE_STATUS curLineStatu = LINE_OK;
+
+    /* 上传的消息体还没有接收完 */
+    if(uploadFd != -1)
+    {
+        return transferUpload();
+    }
     
-    char* text = nullptr;
+    string_view text;
 
-    while((curState == CHECK_CONTENT && curLineStatu == LINE_OK) || ((curLineStatu = paraseLine()) == LINE_OK)) 
+    /* 消息体可能分多次到达，等待期间不能让 paraseLine 越过它 */
+    while((curState == CHECK_CONTENT && curLineStatu == LINE_OK) || 
+          (curState != CHECK_CONTENT && (curLineStatu = paraseLine()) == LINE_OK)) 
     {
-        text = getOneLine();
+        /* 消息体不按行解析 */
+        if(curState != CHECK_CONTENT)
+        {
+            text = getOneLine();
+        }
         lineIdx = curIdx;
 
         switch (curState)
         {
             case CHECK_REQUESTLINE :
             {
-                code = paraseRequestLine(string(text));
+                code = paraseRequestLine(text);
                 if(code == BAD_REQUEST)
                 {
                     return BAD_REQUEST;
@@ -698,15 +2008,16 @@ HttpConn::HTTP_CODE HttpConn::processRead()
 
             case CHECK_HEADER :
             {
-                code = paraseRequestHeader(string(text));
+                code = paraseRequestHeader(text);
                 
                 if(code == GET_REQUEST)
                 {
                     return do_request();
                 }
-                else if(code == BAD_REQUEST)
+                /* 出错，或者已经开始上传（消息体不再按行解析） */
+                else if(code != NO_REQUEST || uploadFd != -1)
                 {
-                    return BAD_REQUEST;
+                    return code;
                 }
 
                 break;
@@ -714,12 +2025,16 @@ HttpConn::HTTP_CODE HttpConn::processRead()
 
             case CHECK_CONTENT :
             {
-                code = paraseRequestContent(string(text));
+                code = paraseRequestContent();
                 
                 if(code == GET_REQUEST)
                 {
                     return do_request();
                 }
+                else if(code == BAD_REQUEST)
+                {
+                    return BAD_REQUEST;
+                }
                 curLineStatu = LINE_OPEN;
 
                 break;
@@ -734,93 +2049,319 @@ HttpConn::HTTP_CODE HttpConn::processRead()
 
     }
 
+    /* 行结束符不合法 */
+    if(curLineStatu == LINE_BAD)
+    {
+        return BAD_REQUEST;
+    }
+
     return NO_REQUEST;
 }
 
 void HttpConn::process()
 {
-    HTTP_CODE code = processRead();
+    EventLoop* owner = loop;
+    processTask();
 
-    if(code == NO_REQUEST)
+    /* 交还之后连接可能马上被事件循环关闭回收，不能再访问成员 */
+    if(poolState.fetch_sub(1) == (POOL_CLOSING | 1))
     {
-        modfd(epollfd, sockfd, EPOLLIN);
+        owner->runInLoop([this]() { closeConn(); });
+    }
+}
+
+bool HttpConn::tryClose()
+{
+    if(poolState.fetch_or(POOL_CLOSING) == 0)
+    {
+        return true;
+    }
+
+    shutdown(sockfd, SHUT_RDWR);
+    return false;
+}
+
+void HttpConn::processTask()
+{
+    /* HTTPS 连接先完成握手 */
+    if(tlsHandshaking)
+    {
+        int ev = tlsHandshake();
+        if(ev != 0)
+        {
+            if(ev < 0)
+            {
+                shutdown(sockfd, SHUT_RDWR);
+                ev = EPOLLIN;
+            }
+            loop->modConn(sockfd, ev);
+            return;
+        }
+
+        /* 握手的最后一个记录之后可能已经收到了请求，OpenSSL 可能也缓存了一部分 */
+        if(!readFromClnt())
+        {
+            shutdown(sockfd, SHUT_RDWR);
+            loop->modConn(sockfd, EPOLLIN);
+            return;
+        }
+        if(readBuffer.empty())
+        {
+            loop->modConn(sockfd, EPOLLIN);
+            return;
+        }
+    }
+    /* 上次读到缓冲区上限或消息体的结尾时，OpenSSL 里还有解密好的数据，套接字上不会再有可读事件 */
+    else if(uploadFd == -1 && hasTlsPending())
+    {
+        readFromClnt();
+    }
+
+    /* 连接开头是 HTTP/2 的连接前言（prior knowledge），整个连接交给 HTTP/2 会话 */
+    if(!h2 && respCount == 0 && curState == CHECK_REQUESTLINE && !readBuffer.empty() && readBuffer[0] == 'P')
+    {
+        int match = Http2Session::matchPreface(readBuffer);
+        if(match == 0)
+        {
+            /* 前言还没有收全 */
+            loop->modConn(sockfd, EPOLLIN);
+            return;
+        }
+        else if(match > 0)
+        {
+            h2.reset(new Http2Session(this));
+        }
+    }
+
+    if(h2)
+    {
+        processH2();
+        return;
+    }
+
+    pendingRequest = false;
+
+    /* 流式回复还没有结束：生成下一段，流水线中后面的请求等输出结束再处理 */
+    if(producer)
+    {
+        produceChunk();
+        if(respCount == 0)
+        {
+            shutdown(sockfd, SHUT_RDWR);
+            loop->modConn(sockfd, EPOLLIN);
+            return;
+        }
+
+        pendingRequest = (producer || !readBuffer.empty());
+        loop->modConn(sockfd, EPOLLOUT);
+        return;
+    }
+
+    /* 流水线：一次读到的多个请求依次解析，回复按顺序排队，最后一起发送 */
+    bool ret = true;
+    bool streamed = false;
+    while(respCount < MAX_PIPELINE)
+    {
+        HTTP_CODE code = processRead();
+        if(code == NO_REQUEST)
+        {
+            break;
+        }
+
+        /* 之前排队的回复先发送，101 和 HTTP/2 的帧排在后面 */
+        if(code == SWITCH_PROTOCOL)
+        {
+            if(wsRoute)
+            {
+                upgradeWebSocket();
+            }
+            else
+            {
+                upgradeH2();
+            }
+            return;
+        }
+
+        ret = processWrite(code);
+        if(!ret)
+        {
+            break;
+        }
+
+        queueResponse();
+
+        /* 流式回复：回复头后面紧接着第一段输出，发送期间连接保持，输出结束后再按请求决定 */
+        if(producer)
+        {
+            streamKeepAlive = keepConn;
+            keepConn = true;
+            if(respCount < MAX_PIPELINE)
+            {
+                produceChunk();
+            }
+            streamed = true;
+            break;
+        }
+
+        /* 不保持连接时后面的请求不再处理 */
+        if(!keepConn)
+        {
+            readBuffer.clear();
+            break;
+        }
+    }
+
+    if(ret && respCount == 0)
+    {
+        /* 缓冲区满了也没有一个完整的请求，请求超过上限 */
+        if(uploadFd == -1 && readBuffer.size() >= maxRequestSize)
+        {
+            shutdown(sockfd, SHUT_RDWR);
+        }
+        loop->modConn(sockfd, EPOLLIN);
         return;
     }
 
-    bool ret = processWrite(code);
     if(!ret)
     {
-        closeConn();
+        /**
+         * 连接对象归事件循环所有，不能在工作线程中回收。
+         * 关闭套接字的读写两端，由事件循环在挂断事件里关闭连接。
+         */
+        shutdown(sockfd, SHUT_RDWR);
+        loop->modConn(sockfd, EPOLLIN);
+        return;
     }
 
-    modfd(epollfd, sockfd, EPOLLOUT);
+    /* 队列满了（或者有流式回复、上传），剩下的输出、消息体和缓冲区里的请求等这一批发送完再处理 */
+    pendingRequest = (producer || uploadFd != -1 || hasTlsPending() ||
+                      ((respCount == MAX_PIPELINE || streamed) && !readBuffer.empty()));
+    loop->modConn(sockfd, EPOLLOUT);
 }
 
 bool HttpConn::processWrite(HTTP_CODE code)
 {
+    if(draining)
+    {
+        isKeepLive = false;
+    }
+
+    /* 请求格式错误或消息体没有读完时不知道下一个请求从哪里开始，回复后关闭连接 */
+    if(code == BAD_REQUEST || code == REQUEST_TOO_LARGE)
+    {
+        isKeepLive = false;
+    }
+
     switch (code)
     {
     case INTERNAL_ERROR:
     {
-        addStatuLine(500, error_500_title);
-        addHeader(error_500_form.size());
-        if(!addContent(error_500_form))
-        {
-            return false;
-        }
-        break;
+        return addStatuLine(500) && addFixed(500);
     }
 
     case BAD_REQUEST:
     {
-        addStatuLine(404, error_404_title);
-        addHeader(error_404_form.size());
-        if(!addContent(error_404_form))
+        /* HTTP/2 的回复头要由 Http2Session 重新编码，不能直接发送 */
+        if(h2)
         {
-            return false;
+            return addStatuLine(400) && addFixed(400);
         }
 
-        break;
+        /* 状态行、头部和消息体作为一整块发送，不组装回复头 */
+        fixedBody = string_view(bad_request_400, sizeof(bad_request_400) - 1);
+        return true;
+    }
+
+    case NO_RESOURCE:
+    {
+        return addStatuLine(404) && addFixed(404);
+    }
+
+    case REQUEST_TOO_LARGE:
+    {
+        return addStatuLine(413) && addFixed(413);
+    }
+
+    case FILE_CREATED:
+    {
+        return addStatuLine(201) && addFixed(201);
     }
 
     case FORBIDDEN_REQUEST:
     {
-        addStatuLine(403, error_403_title);
-        addHeader(error_403_form.size());
-        if(!addContent(error_403_form))
+        return addStatuLine(403) && addFixed(403);
+    }
+
+    case METHOD_NOT_ALLOWED:
+    {
+        return addStatuLine(405) && addBytes("Allow: ") && addBytes(allowMethods) && addBlankLine()
+            && addFixed(405);
+    }
+
+    case NOT_IMPLEMENTED:
+    {
+        return addStatuLine(501) && addFixed(501);
+    }
+
+    case NOT_MODIFIED:
+    {
+        /* 304 没有消息体 */
+        return addStatuLine(304) && addValidators() && addIsKeepLive() && addBlankLine();
+    }
+
+    case PARTIAL_CONTENT:
+    {
+        /* 消息体由 queueResponse 放到回复头后面 */
+        bool ret = addStatuLine(206);
+        if(rangeCount == 1)
         {
-            return false;
+            ret = ret && addContentType() && addBytes("Content-Range: bytes ") && addNumber(ranges[0].first)
+                && addBytes("-") && addNumber(ranges[0].last)
+                && addBytes("/") && addNumber(fileInfo.st_size) && addBlankLine()
+                && addContentLen(ranges[0].last - ranges[0].first + 1);
         }
+        else
+        {
+            ret = ret && addBytes("Content-Type: multipart/byteranges; boundary=") && addBytes(rangeBoundary())
+                && addBlankLine() && addContentLen(multipartBody.size());
+        }
+        return ret && addBytes("Accept-Ranges: bytes\r\n") && addValidators() && addIsKeepLive() && addBlankLine();
+    }
 
-        break;
+    case RANGE_NOT_SATISFIABLE:
+    {
+        return addStatuLine(416) && addBytes("Content-Range: bytes */") && addNumber(fileInfo.st_size)
+            && addBlankLine() && addFixed(416);
     }
 
-    case FILE_REQUETS:
+    case STREAM_REQUEST:
     {
-        addStatuLine(200, ok_200_title);
-        if(fileInfo.st_size != 0)
+        /* HTTP/1.1 分块发送；HTTP/1.0 没有分块编码，输出结束时关闭连接；HTTP/2 已经生成了全部输出 */
+        bool ret = addStatuLine(200) && addBytes("Content-Type: ") && addBytes(streamType) && addBlankLine();
+        if(h2)
         {
+            return ret && addContentLen(generatedBody.size()) && addIsKeepLive() && addBlankLine();
+        }
 
-            addHeader(fileInfo.st_size);
-    
-            iov[0].iov_base = writeBuffer;
-            iov[0].iov_len = writeIdx;
-    
-            iov[1].iov_base = fileAddr;
-            iov[1].iov_len = fileInfo.st_size;
-            iovCount = 2;
-            bytesToSend = writeIdx + fileInfo.st_size;
-            return true;
+        streamChunked = (m_version == "HTTP/1.1");
+        if(!streamChunked)
+        {
+            isKeepLive = false;
         }
-        else
+        return ret && (!streamChunked || addBytes("Transfer-Encoding: chunked\r\n")) && addIsKeepLive() && addBlankLine();
+    }
+
+    case FILE_REQUETS:
+    {
+        /* 空文件回复一个空页面 */
+        if(fileInfo.st_size == 0)
         {
-            const string ok_string = "<html><body></body></html>";
-            addHeader(ok_string.size());
-            if(!addContent(ok_string))
-            {
-                return false;
-            }
+            return addStatuLine(200) && addFixed(200);
         }
+
+        /* 缓存中预先生成的 ETag/Last-Modified/Content-Length，文件内容由 queueResponse 放到后面 */
+        return addStatuLine(200) && addBytes(fileEntry->variants[encoding].header)
+            && addIsKeepLive() && addBlankLine();
     }
     
     default:
@@ -829,9 +2370,5 @@ bool HttpConn::processWrite(HTTP_CODE code)
         }
     }
 
-    iov[0].iov_base = writeBuffer;
-    iov[0].iov_len = writeIdx;
-    iovCount = 1;
-    bytesToSend = writeIdx;
     return true;
 }
\ No newline at end of file
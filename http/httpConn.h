@@ -2,6 +2,9 @@
 #define HTTPCONN_H 
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
 #include <cstring>
 #include <iostream>
 #include <sys/socket.h>
@@ -20,13 +23,35 @@
 #include <unordered_map>
 #include "../constance.h"
 #include "../pool/sqlConnPool/connPoolRAII.h"
+#include "../buffer/chainBuffer.h"
+#include "../config/config.h"
+#include "../cache/fileCache.h"
+#include "../tls/tlsContext.h"
+#include "webSocket.h"
+#include "chunked.h"
+#include <functional>
 
 using std::string;
+using std::string_view;
 
 extern std::string rootPath;
 
+class EventLoop;
+class Http2Session;
+
+/**
+ * 流式回复的生成函数，在工作线程中被反复调用：每次把新生成的一段输出追加到 out 后面
+ * （out 前面预留了块头的位置，只能追加），返回 false 表示输出结束。每段生成后立即发送，
+ * 发送完再生成下一段，回复不需要整个缓存在内存中
+ */
+typedef std::function<bool(std::string& out)> StreamProducer;
+
 class HttpConn
 {
+    /* HTTP/2 会话复用请求处理和回复队列 */
+    friend class Http2Session;
+    /* WebSocket 把帧直接放入回复队列 */
+    friend class WebSocket;
 
     public:
         /* 主状态机的两种状态 */
@@ -54,130 +79,372 @@ class HttpConn
             FILE_REQUETS,       // 文件资源
             FORBIDDEN_REQUEST,  // 客户对资源没有权限
             INTERNAL_ERROR,     // 服务器内部错误
-            CLOSED_CONNECTION   // 客户端已经关闭连接
+            CLOSED_CONNECTION,  // 客户端已经关闭连接
+            NOT_MODIFIED,       // 条件请求命中缓存，回复 304
+            PARTIAL_CONTENT,    // 范围请求，回复 206
+            RANGE_NOT_SATISFIABLE,  // 请求的范围都在文件之外，回复 416
+            SWITCH_PROTOCOL,        // 升级到 h2c 或 WebSocket，回复 101
+            STREAM_REQUEST,         // 流式回复，由生成函数边生成边发送
+            FILE_CREATED,           // 上传完成，回复 201
+            REQUEST_TOO_LARGE,      // 上传的消息体超过上限，回复 413
+            METHOD_NOT_ALLOWED,     // 路径只支持其他方法，回复 405
+            NOT_IMPLEMENTED         // 不支持的方法，回复 501
 
         };
 
         /* HTTP请求方法 */
         enum METHOD {
             GET,
-            POST
+            POST,
+            OTHER       // 不支持的方法（PUT、DELETE 等），路由中没有这种方法
         };
 
     public:
-        static int epollfd;
         static std::atomic_int userCount;
+        static std::atomic_bool draining;       // 进程正在退出，回复后关闭连接
+        static size_t maxRequestSize;           // 读缓冲区上限，超过后关闭连接
+        static SEND_MODE sendMode;              // 静态文件的发送方式
         
         /* mysql 链接*/
         MYSQL* m_mysql;
         
     public:
-        HttpConn() {};
-        ~HttpConn(){};
+        HttpConn();
+        ~HttpConn();
 
     public:
-        void init(const int sockfd, const sockaddr_in addr);
+        /* tls 为 true 时连接来自 HTTPS 端口，先完成 TLS 握手 */
+        void init(const int sockfd, const sockaddr_in addr, EventLoop* loop, bool tls = false);
         bool writeToClnt();     // 向客户端发送信息
         bool readFromClnt();    // 读一次数据
-        void process();         // 运行
+        void process();         // 运行，由工作线程调用
+
+        /* 事件循环把连接交给线程池之前调用，工作线程在 process 结束时交还 */
+        void enterPool() { poolState.fetch_add(1); }
+        /**
+         * 超时关闭，只在事件循环线程中调用：连接不在线程池中时返回 true，由调用者关闭；
+         * 否则关闭套接字的读写两端让工作线程尽快结束，最后交还的工作线程再请事件循环关闭
+         */
+        bool tryClose();
+        /* 等待工作线程交还后关闭，期间事件循环忽略这个连接的事件 */
+        bool isClosing() { return poolState & POOL_CLOSING; }
 
         void closeConn(bool isClose = true);
+
+        /* 以下供 io_uring 后端使用：数据由内核直接收发，这里只维护状态 */
+        bool appendRead(const char* buf, int len);  // 追加收到的数据
+        struct iovec* getIov() { return iov + iovIdx; }
+        int getIovCount();          // 到下一个 sendfile 段之前的项数
+        /* 同样的项组成 sendmsg 的参数，后面还有 sendfile 段时 more 为 true（需要 MSG_MORE） */
+        msghdr* getMsg(bool& more);
+
+        /* sendfile 模式：下一段要发送的是文件内容 */
+        bool atFileSegment();
+        int getFileFd();
+        off_t getFileOffset();
+        size_t getFileRemain();
+
+        /* splice 的中转管道（io_uring 发送文件、上传的消息体写入文件），按需创建 */
+        int* getPipe();
+        void closePipe();
+        int pipeBytes;              // 管道中还没有发出去的字节数
+        size_t getBytesToSend() { return bytesToSend; }
+        bool isKeepAlive() { return keepConn; }
+        void updateIov(size_t len); // 已经发送了 len 字节
+        bool writeDone();           // 回复发送完毕，返回是否保持连接
+
+        /* 这一批回复发送完了，缓冲区里还有流水线请求等待处理 */
+        bool hasPendingRequest() { return pendingRequest && respCount == 0; }
+
+        /* 已经完成 WebSocket 握手：读到的数据在事件循环线程中由 processWs 处理，不交给线程池 */
+        bool isWebSocket() { return ws && ws->isOpen(); }
+        void processWs();
+
+        /* 正在接收上传的消息体：套接字可读时直接交给线程池，数据不经过读缓冲区 */
+        bool isUploading() { return uploadFd != -1; }
+
+        /* TLS 握手还没有完成：套接字可读写时交给线程池继续握手 */
+        bool isHandshaking() { return tlsHandshaking; }
+        /**
+         * 套接字上的数据不能由 io_uring 直接收发，只能等待就绪：
+         * 上传的消息体，以及没有卸载到内核、由 OpenSSL 在用户空间加解密的 TLS 连接
+         */
+        bool needPollRead() { return isUploading() || (ssl && (tlsHandshaking || !ktlsRecv)); }
+        bool needPollWrite() { return ssl && (tlsHandshaking || !ktlsSend); }
+
+        /* 空闲超时时间，WebSocket 连接更长 */
+        int getTimeout() { return ws ? WS_IDLE_TIMEOUT : CONN_TIMEOUT; }
+
         sockaddr_in* getAddr() 
         {
             return &clntAddr;
         }
 
-        void initMySQLResult(SqlConnPool* connPool);
+        /* 对端是否是本机（127.0.0.0/8），只对内开放的路由使用 */
+        bool isLoopback();
+
+        EventLoop* getLoop() { return loop; }
+
+        static void initMySQLResult(SqlConnPool* connPool);
+
+        /* 注册到路由的处理函数：登录和注册，返回要发送的页面 */
+        static string_view doLogin(HttpConn* conn);
+        static string_view doRegister(HttpConn* conn);
+
+        /* 路由匹配到流式回复：保存生成函数和内容类型（不复制，必须在路由表中长期有效） */
+        void startStream(StreamProducer producer, string_view contentType);
+
+        /* 请求体（Content-Length 或分块编码解码后的内容），供处理函数使用 */
+        const string& getBody() { return requestBody; }
     
     private:
         void init();
+        /* 一个请求处理完，重置解析状态（不清空读缓冲区） */
+        void resetRequest();
+
+        /* 把当前请求的回复放入发送队列，并丢弃已经解析的数据 */
+        void queueResponse();
+        /* 释放所有已发送的回复 */
+        void clearResponses();
 
         /* 处理读到的内容 */
         HTTP_CODE processRead();
 
-        /* 获得一行 */
-        char* getOneLine() { return readBuffer + lineIdx;}
+        /* 调用一次生成函数，输出作为一块放入发送队列，输出结束后恢复连接原来的状态 */
+        void produceChunk();
+
+        /* 获得 [lineIdx, lineEnd) 这一行，不复制 */
+        string_view getOneLine();
         /* 解析一行 */
         LINE_STATUS paraseLine();
         /* 解析请求行 */ 
-        HTTP_CODE paraseRequestLine(string text);
+        HTTP_CODE paraseRequestLine(string_view text);
         /* 解析请求头 */
-        HTTP_CODE paraseRequestHeader(string text);
+        HTTP_CODE paraseRequestHeader(string_view text);
         /* 解析请求内容 */
-        HTTP_CODE paraseRequestContent(string text);
+        HTTP_CODE paraseRequestContent();
+
+        /* 请求头读完时匹配到上传路由：创建临时文件，开始接收消息体 */
+        HTTP_CODE beginUpload(size_t maxSize);
+        /* 把消息体从套接字经管道 splice 到临时文件，直到读空（NO_REQUEST）或接收完 */
+        HTTP_CODE transferUpload();
+        /* 用户空间解密的 TLS 连接：OpenSSL 读出明文再写入文件 */
+        HTTP_CODE transferTlsUpload();
+        /* 消息体接收完：关闭临时文件，改名为目标文件 */
+        HTTP_CODE finishUpload();
+        /* 上传失败或连接关闭：删除临时文件 */
+        void abortUpload();
+
+        /* 继续 TLS 握手：返回 0 表示完成，EPOLLIN/EPOLLOUT 表示要等待的事件，-1 表示失败 */
+        int tlsHandshake();
+        /* OpenSSL 在用户空间解密读出明文，返回值和 errno 与 recv 相同 */
+        ssize_t tlsRead(char* buf, size_t len);
+        /* 把发送队列中的一段（最多一个 TLS 记录）交给 OpenSSL 加密发送，返回值和 errno 与 send 相同 */
+        ssize_t tlsWrite();
+        /* OpenSSL 中有已经解密、还没有读出来的数据 */
+        bool hasTlsPending() { return ssl && !ktlsRecv && SSL_pending(ssl) > 0; }
+        /* 释放 SSL 对象，握手完成的连接先发送 close_notify */
+        void freeSsl();
 
         /* 执行请求 */
         HTTP_CODE do_request();
 
-        /* 释放映射内存 */
+        /* 请求带 Upgrade: h2c 和 HTTP2-Settings */
+        bool isUpgradeH2c();
+        /* 回复 101，当前请求交给 HTTP/2 的流 1 */
+        void upgradeH2();
+        /* 连接已经是 HTTP/2：由会话处理读到的帧，设置发送队列和连接状态 */
+        void processH2();
+
+        /* 请求是合法的 WebSocket 升级且路径注册了 WebSocket 路由，路由记录在 wsRoute */
+        bool isUpgradeWebSocket(string_view path);
+        /* 回复 101，之后连接由 WebSocket 处理 */
+        void upgradeWebSocket();
+
+        /* 按名字查找请求头（不区分大小写），不存在时返回空 */
+        string_view getHeader(string_view key);
+
+        /* 根据 If-None-Match/If-Modified-Since 判断客户端缓存的文件是否仍然有效 */
+        bool isNotModified();
+
+        /* 解析 Accept-Encoding，返回客户端接受的编码（按位） */
+        int acceptEncodings();
+
+        /* 解析 Range/If-Range，返回 FILE_REQUETS（忽略 Range）、PARTIAL_CONTENT 或 RANGE_NOT_SATISFIABLE */
+        HTTP_CODE parseRange();
+        /* 多个范围时把各个部分组装成 multipart/byteranges 消息体 */
+        bool makeMultipart();
+
+        /* 释放对缓存文件的引用 */
         void unmap();
 
-        /* 填写回复内容 */
+        /* 把读写缓冲区还给缓冲区池 */
+        void releaseBuffer();
+
+        /* 复制一段回复内容 */
+        bool addBytes(string_view data);
+        /* 填写十进制数 */
+        bool addNumber(long value);
+        /* 按格式填写回复内容 */
         bool addResponse(const char*, ...);
         
-        /* 填写状态行 */
-        bool addStatuLine(int, string);
-        /* 填写消息头*/
-        bool addHeader(int contentLength);
+        /* 填写预先构造的状态行和 Date 头 */
+        bool addStatuLine(int code);
+        /* 固定内容的回复（错误页面等）：不复制，由 queueResponse 直接放到回复头后面 */
+        bool addFixed(int code);
         /* 添加内容长度 */
-        bool addContentLen(int contentLen);
-        /* 添加内容类型 */
+        bool addContentLen(size_t contentLen);
+        /* 添加文件的内容类型 */
         bool addContentType();
         /* 添加是否保持连接 */
         bool addIsKeepLive();
+        /* 添加 ETag 和 Last-Modified（和 Vary） */
+        bool addValidators();
         /* 填写空白行 */
         bool addBlankLine();
-        /* 填写内容 */
-        bool addContent(string text);
 
         /* 处理写的内容 */
         bool processWrite(HTTP_CODE code); 
 
+        /* 工作线程中处理读到的数据 */
+        void processTask();
+
 
     private:
 
-        /* 请求行相关信息 */
+        /* 请求行相关信息，指向读缓冲区（或常量字符串），请求处理完之前有效 */
         METHOD m_method;
-        string m_url;
-        string m_version;
+        string_view m_url;
+        string_view m_version;
 
         /* 请求头相关信息 */
-        string m_host;
-        int content_length;
+        string_view m_host;
+
+        /* 所有请求头，指向读缓冲区 */
+        struct Header
+        {
+            string_view key;
+            string_view value;
+        };
+        Header headers[MAX_HEADERS];
+        int headerCount;
+        size_t content_length;
         bool isKeepLive;
+        bool chunked;               // Transfer-Encoding: chunked
 
         /* 请求体相关信息 */
         string requestBody;
+        ChunkedDecoder chunkDecoder;    // 分块的请求体，数据分多次到达时从上次停下的地方继续
+
+        /* 流式回复 */
+        StreamProducer producer;    // 输出没有结束之前不为空
+        string_view streamType;     // Content-Type
+        bool streamChunked;         // HTTP/1.1 分块发送，HTTP/1.0 发送完关闭连接
+        bool streamKeepAlive;       // 输出结束后是否保持连接
+        string generatedBody;       // HTTP/2 不分块，一次生成全部输出
+
+        /* 上传：消息体写入目录下的临时文件，接收完后改名为 filePath */
+        int uploadFd;
+        string uploadTemp;
+        size_t uploadRemain;        // 还没有从套接字读出的字节数
+
+        /**
+         * HTTPS 连接的 SSL 对象，HTTP 连接为空。握手完成后发送或接收方向卸载到内核（kTLS）时，
+         * 这个方向照常使用 recv/writev/sendfile，否则由 OpenSSL 在用户空间加解密
+         */
+        SSL* ssl;
+        bool tlsHandshaking;
+        bool ktlsSend;
+        bool ktlsRecv;
 
         /* 请求客户端的信息 */
         int sockfd;
+        EventLoop* loop;        // 所属的事件循环
         sockaddr_in clntAddr;
 
-        /* 读写缓冲区相关信息 */
-        char readBuffer[READ_BUFF_SIZE];
-        char writeBuffer[WRITE_BUFF_SIZE];
-        int readIdx;
+        /* 读写缓冲区相关信息，按需从 BufferPool 取，空闲时归还 */
+        ChainBuffer readBuffer;     // 按块增长，最大 maxRequestSize
+        char* writeBuffer;
         int writeIdx;
-        int curIdx;
+        size_t curIdx;
 
         /* 处理行号*/
-        int lineIdx;
+        size_t lineIdx;
+        size_t lineEnd;             // 当前行的 "\r\n" 位置
+
+        /* 跨块的行的副本，m_url 等可能指向这里 */
+        std::vector<std::unique_ptr<char[]>> lineSpill;
 
         /* 请求文件相关信息 */
         string filePath;            // 请求文件的路径
-        char* fileAddr;             // map后的映射地址
+        FileEntryPtr fileEntry;     // 文件缓存条目（fd、映射、回复头）
         struct stat fileInfo;       // 文件详情
+        char etag[72];              // 由 inode、大小、修改时间（和编码）生成
+        char lastModified[32];      // HTTP 日期格式的修改时间
+        ENCODING encoding;          // 回复使用的内容编码
+        bool vary;                  // 文件有压缩版本，回复带 Vary
 
-        /* 分散内存 */
-        struct iovec iov[2];
+        /* 范围请求，闭区间 */
+        struct Range
+        {
+            off_t first;
+            off_t last;
+        };
+        Range ranges[MAX_RANGES];
+        int rangeCount;             // 0 表示回复整个文件
+        string multipartBody;       // 多个范围时的消息体
+        string_view fixedBody;      // 固定内容的回复，指向 fixedResponse 返回的常量
+        string_view allowMethods;   // 405 回复的 Allow，指向 Router 中的常量
+
+        /* 排队等待发送的回复：回复头和映射的文件 */
+        struct Response
+        {
+            char* header;
+            FileEntryPtr file;      // 发送完之前保持引用
+            off_t fileOff;          // 文件已发送的偏移
+            size_t fileSize;
+            string body;            // 在内存中组装的消息体：multipart/byteranges 或流式回复的一块
+            WsFramePtr frame;       // WebSocket 帧，多个连接共享
+        };
+        Response responses[MAX_PIPELINE];
+
+        int respCount;
+        bool keepConn;              // 最后一个请求是否保持连接
+        bool pendingRequest;        // 队列满时缓冲区里还有请求
+
+        /**
+         * 低位是线程池中这个连接的任务数（排队的和正在处理的），POOL_CLOSING 表示
+         * 超时时还在线程池中。事件循环在工作线程 modConn 之后就可能再次交出连接，所以是计数
+         */
+        static const int POOL_CLOSING = 1 << 30;
+        std::atomic_int poolState;
+
+        /* 取出当前请求的消息体：偏移、长度和文件引用放入 resp，返回内存中的地址（sendfile 时为空） */
+        char* takeBody(Response& resp);
+        /* 把 writeBuffer 中的内容和一段消息体作为一项回复放入发送队列，responses[respCount] 由调用者填好 */
+        void queueSegment(char* body, size_t len);
+
+        /* 分散内存，每个回复占两项，iovIdx 之前的已经发送完 */
+        struct iovec iov[2 * MAX_PIPELINE];
         int iovCount;
+        int iovIdx;
+        msghdr sendMsg;             // io_uring 的 sendmsg 完成之前一直有效
+
+        int pipeFd[2];
+
+        /* HTTP/2 会话，连接仍是 HTTP/1.x 时为空 */
+        std::unique_ptr<Http2Session> h2;
+
+        /* WebSocket 会话，升级之前为空；wsRoute 是升级请求匹配到的路由 */
+        std::unique_ptr<WebSocket> ws;
+        const WsHandler* wsRoute;
 
         /* 主状态机的状态 */
         CHECK_STATE curState;
 
         /* 写入数据的时候用到*/
-        int bytesToSend;
-        int bytesHaveSend;
+        size_t bytesToSend;
+        size_t bytesHaveSend;
 
         /*  是否启动 CGI*/
         bool isCGI;
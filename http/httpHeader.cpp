@@ -0,0 +1,99 @@
+#include "httpHeader.h"
+
+#include <string>
+#include <time.h>
+
+using std::string;
+using std::string_view;
+
+// 定义http响应的一些状态信息
+static const char empty_200_form[] = "<html><body></body></html>";
+static const char created_201_form[] = "The file has been uploaded.\n";
+static const char error_400_form[] = "Your request has bad syntax or is inherently impossible to satisfy.\n";
+static const char error_403_form[] = "You do not have permission to get file form this server.\n";
+static const char error_404_form[] = "The requested file was not found on this server.\n";
+static const char error_405_form[] = "The request method is not allowed for this resource.\n";
+static const char error_413_form[] = "The request body is larger than the server allows.\n";
+static const char error_416_form[] = "The requested range is not available in this file.\n";
+static const char error_500_form[] = "There was an unusual problem serving the request file.\n";
+static const char error_501_form[] = "The request method is not supported by this server.\n";
+
+string_view statusLine(int code)
+{
+    switch(code)
+    {
+    case 200: return "HTTP/1.1 200 OK\r\n";
+    case 201: return "HTTP/1.1 201 Created\r\n";
+    case 206: return "HTTP/1.1 206 Partial Content\r\n";
+    case 304: return "HTTP/1.1 304 Not Modified\r\n";
+    case 400: return "HTTP/1.1 400 Bad Request\r\n";
+    case 403: return "HTTP/1.1 403 Forbidden\r\n";
+    case 404: return "HTTP/1.1 404 Not Found\r\n";
+    case 405: return "HTTP/1.1 405 Method Not Allowed\r\n";
+    case 413: return "HTTP/1.1 413 Payload Too Large\r\n";
+    case 416: return "HTTP/1.1 416 Range Not Satisfiable\r\n";
+    case 501: return "HTTP/1.1 501 Not Implemented\r\n";
+    default:  return "HTTP/1.1 500 Internal Error\r\n";
+    }
+}
+
+string_view dateHeader()
+{
+    /* 工作线程各自缓存，不需要加锁 */
+    thread_local time_t cachedTime = 0;
+    thread_local char date[48];
+    thread_local size_t len = 0;
+
+    time_t now = time(nullptr);
+    if(now != cachedTime)
+    {
+        struct tm tmInfo;
+        gmtime_r(&now, &tmInfo);
+        len = strftime(date, sizeof(date), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tmInfo);
+        cachedTime = now;
+    }
+    return string_view(date, len);
+}
+
+static string makeFixed(string_view body, bool keepAlive)
+{
+    string response = "Content-Type: text/html; charset=UTF-8\r\n";
+    response += "Content-Length:" + std::to_string(body.size()) + "\r\n";
+    response += (keepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+    response += "\r\n";
+    response += body;
+    return response;
+}
+
+string_view fixedResponse(int code, bool keepAlive)
+{
+    /* 下标 0 是关闭连接的版本，1 是保持连接的版本 */
+    static const string responses[][2] = {
+        { makeFixed(empty_200_form, false), makeFixed(empty_200_form, true) },
+        { makeFixed(created_201_form, false), makeFixed(created_201_form, true) },
+        { makeFixed(error_400_form, false), makeFixed(error_400_form, true) },
+        { makeFixed(error_403_form, false), makeFixed(error_403_form, true) },
+        { makeFixed(error_404_form, false), makeFixed(error_404_form, true) },
+        { makeFixed(error_413_form, false), makeFixed(error_413_form, true) },
+        { makeFixed(error_416_form, false), makeFixed(error_416_form, true) },
+        { makeFixed(error_500_form, false), makeFixed(error_500_form, true) },
+        { makeFixed(error_405_form, false), makeFixed(error_405_form, true) },
+        { makeFixed(error_501_form, false), makeFixed(error_501_form, true) },
+    };
+
+    int idx = 7;
+    switch(code)
+    {
+    case 200: idx = 0; break;
+    case 201: idx = 1; break;
+    case 400: idx = 2; break;
+    case 403: idx = 3; break;
+    case 404: idx = 4; break;
+    case 413: idx = 5; break;
+    case 416: idx = 6; break;
+    case 405: idx = 8; break;
+    case 501: idx = 9; break;
+    default:  idx = 7; break;
+    }
+    return responses[idx][keepAlive ? 1 : 0];
+}
@@ -0,0 +1,23 @@
+/**
+ * 回复头的预先构造的部分
+ *  状态行和错误回复在进程内只构造一次，组装回复时直接复制；
+ *  Date 头每个线程每秒只格式化一次。
+ */
+#ifndef HTTPHEADER_H
+#define HTTPHEADER_H
+
+#include <string_view>
+
+/* "HTTP/1.1 200 OK\r\n" 这样的状态行，未知的状态码按 500 处理 */
+std::string_view statusLine(int code);
+
+/* "Date: ...\r\n" */
+std::string_view dateHeader();
+
+/**
+ * 固定内容的回复（错误页面、空文件）在状态行和 Date 之后的部分：
+ * Content-Type、Content-Length、Connection、空行和消息体，不会改变
+ */
+std::string_view fixedResponse(int code, bool keepAlive);
+
+#endif
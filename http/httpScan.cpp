@@ -0,0 +1,99 @@
+#include "httpScan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTPSCAN_X86
+#endif
+
+/* 在 buf 中查找 a 或 b，两者相同时就是查找单个字符 */
+static size_t scanScalar(const char* buf, size_t len, char a, char b)
+{
+    for(size_t i = 0; i < len; ++i)
+    {
+        if(buf[i] == a || buf[i] == b)
+        {
+            return i;
+        }
+    }
+    return len;
+}
+
+#ifdef HTTPSCAN_X86
+
+__attribute__((target("sse2")))
+static size_t scanSse2(const char* buf, size_t len, char a, char b)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+        if(mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return i + scanScalar(buf + i, len - i, a, b);
+}
+
+__attribute__((target("avx2")))
+static size_t scanAvx2(const char* buf, size_t len, char a, char b)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+
+    size_t i = 0;
+    for(; i + 32 <= len; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i));
+        unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+        if(mask)
+        {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    /**
+     * 剩下不足 32 字节的部分交给 SSE2。SSE2 版本是非 VEX 编码的指令，
+     * 先清掉 ymm 的高半部分，否则短行每次都要付出 AVX/SSE 切换的开销
+     */
+    _mm256_zeroupper();
+    return i + scanSse2(buf + i, len - i, a, b);
+}
+
+#endif
+
+typedef size_t (*ScanFunc)(const char*, size_t, char, char);
+
+/* 启动时根据 CPU 选择一次 */
+static ScanFunc chooseScan()
+{
+#ifdef HTTPSCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return scanAvx2;
+    }
+    if(__builtin_cpu_supports("sse2"))
+    {
+        return scanSse2;
+    }
+#endif
+    return scanScalar;
+}
+
+static const ScanFunc scanImpl = chooseScan();
+
+size_t scanLineEnd(const char* buf, size_t len)
+{
+    return scanImpl(buf, len, '\r', '\n');
+}
+
+size_t scanChar(const char* buf, size_t len, char ch)
+{
+    return scanImpl(buf, len, ch, ch);
+}
@@ -0,0 +1,17 @@
+/**
+ * 请求解析用到的字节扫描
+ *  x86 上按 CPU 支持情况选用 AVX2（32 字节）或 SSE2（16 字节）比较，
+ *  其他平台使用逐字节的实现。
+ */
+#ifndef HTTPSCAN_H
+#define HTTPSCAN_H
+
+#include <cstddef>
+
+/* 返回第一个 '\r' 或 '\n' 的下标，找不到返回 len */
+size_t scanLineEnd(const char* buf, size_t len);
+
+/* 返回第一个 ch 的下标，找不到返回 len */
+size_t scanChar(const char* buf, size_t len, char ch);
+
+#endif
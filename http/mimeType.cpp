@@ -0,0 +1,132 @@
+#include "mimeType.h"
+
+#include <cstdint>
+
+using std::string_view;
+
+static constexpr MimeType mimeTypes[] = {
+    { "html",  "Content-Type: text/html; charset=UTF-8\r\n",               true  },
+    { "htm",   "Content-Type: text/html; charset=UTF-8\r\n",               true  },
+    { "css",   "Content-Type: text/css; charset=UTF-8\r\n",                true  },
+    { "js",    "Content-Type: text/javascript; charset=UTF-8\r\n",         true  },
+    { "mjs",   "Content-Type: text/javascript; charset=UTF-8\r\n",         true  },
+    { "json",  "Content-Type: application/json\r\n",                       true  },
+    { "txt",   "Content-Type: text/plain; charset=UTF-8\r\n",              true  },
+    { "csv",   "Content-Type: text/csv; charset=UTF-8\r\n",                true  },
+    { "md",    "Content-Type: text/markdown; charset=UTF-8\r\n",           true  },
+    { "xml",   "Content-Type: application/xml\r\n",                        true  },
+    { "svg",   "Content-Type: image/svg+xml\r\n",                          true  },
+    { "wasm",  "Content-Type: application/wasm\r\n",                       true  },
+    { "ico",   "Content-Type: image/x-icon\r\n",                           true  },
+    { "png",   "Content-Type: image/png\r\n",                              false },
+    { "jpg",   "Content-Type: image/jpeg\r\n",                             false },
+    { "jpeg",  "Content-Type: image/jpeg\r\n",                             false },
+    { "gif",   "Content-Type: image/gif\r\n",                              false },
+    { "webp",  "Content-Type: image/webp\r\n",                             false },
+    { "avif",  "Content-Type: image/avif\r\n",                             false },
+    { "bmp",   "Content-Type: image/bmp\r\n",                              false },
+    { "mp4",   "Content-Type: video/mp4\r\n",                              false },
+    { "webm",  "Content-Type: video/webm\r\n",                             false },
+    { "ogv",   "Content-Type: video/ogg\r\n",                              false },
+    { "mp3",   "Content-Type: audio/mpeg\r\n",                             false },
+    { "ogg",   "Content-Type: audio/ogg\r\n",                              false },
+    { "wav",   "Content-Type: audio/wav\r\n",                              false },
+    { "m4a",   "Content-Type: audio/mp4\r\n",                              false },
+    { "pdf",   "Content-Type: application/pdf\r\n",                        false },
+    { "zip",   "Content-Type: application/zip\r\n",                        false },
+    { "gz",    "Content-Type: application/gzip\r\n",                       false },
+    { "woff",  "Content-Type: font/woff\r\n",                              false },
+    { "woff2", "Content-Type: font/woff2\r\n",                             false },
+    { "ttf",   "Content-Type: font/ttf\r\n",                               false },
+    { "otf",   "Content-Type: font/otf\r\n",                               false },
+};
+
+static constexpr MimeType defaultType = { "", "Content-Type: application/octet-stream\r\n", false };
+
+static constexpr size_t MIME_TYPE_COUNT = sizeof(mimeTypes) / sizeof(mimeTypes[0]);
+static constexpr size_t MIME_SLOTS = 128;       // 2 的幂，取模用位与
+static constexpr size_t MIME_MAX_EXT = 8;       // 更长的扩展名不可能在表中
+
+/* FNV-1a，种子混入初始值 */
+static constexpr uint32_t mimeHash(string_view ext, uint32_t seed)
+{
+    uint32_t hash = 2166136261u ^ seed;
+    for(char ch : ext)
+    {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* 编译期逐个尝试种子，直到所有扩展名落在不同的槽里 */
+static constexpr uint32_t findSeed()
+{
+    for(uint32_t seed = 0; seed < 100000; ++seed)
+    {
+        bool used[MIME_SLOTS] = {};
+        bool collide = false;
+        for(size_t i = 0; i < MIME_TYPE_COUNT && !collide; ++i)
+        {
+            size_t slot = mimeHash(mimeTypes[i].ext, seed) & (MIME_SLOTS - 1);
+            collide = used[slot];
+            used[slot] = true;
+        }
+        if(!collide)
+        {
+            return seed;
+        }
+    }
+    return UINT32_MAX;
+}
+
+static constexpr uint32_t MIME_SEED = findSeed();
+static_assert(MIME_SEED != UINT32_MAX, "no perfect hash seed for the MIME table, enlarge MIME_SLOTS");
+
+/* 槽 -> mimeTypes 的下标，-1 表示空槽 */
+struct MimeSlots
+{
+    int8_t index[MIME_SLOTS];
+};
+
+static constexpr MimeSlots buildSlots()
+{
+    MimeSlots slots = {};
+    for(size_t i = 0; i < MIME_SLOTS; ++i)
+    {
+        slots.index[i] = -1;
+    }
+    for(size_t i = 0; i < MIME_TYPE_COUNT; ++i)
+    {
+        slots.index[mimeHash(mimeTypes[i].ext, MIME_SEED) & (MIME_SLOTS - 1)] = static_cast<int8_t>(i);
+    }
+    return slots;
+}
+
+static constexpr MimeSlots mimeSlots = buildSlots();
+
+const MimeType& mimeType(string_view path)
+{
+    /* 最后一个 '/' 之后的最后一个 '.' */
+    size_t dot = path.find_last_of("./");
+    if(dot == string_view::npos || path[dot] != '.' || path.size() - dot - 1 > MIME_MAX_EXT)
+    {
+        return defaultType;
+    }
+
+    char ext[MIME_MAX_EXT];
+    size_t len = path.size() - dot - 1;
+    for(size_t i = 0; i < len; ++i)
+    {
+        char ch = path[dot + 1 + i];
+        ext[i] = (ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch);
+    }
+
+    string_view key(ext, len);
+    int idx = mimeSlots.index[mimeHash(key, MIME_SEED) & (MIME_SLOTS - 1)];
+    if(idx < 0 || mimeTypes[idx].ext != key)
+    {
+        return defaultType;
+    }
+    return mimeTypes[idx];
+}
@@ -0,0 +1,21 @@
+/**
+ * 扩展名到 MIME 类型的映射
+ *  表在编译期构造：编译期搜索一个使所有扩展名互不冲突的哈希种子（完美哈希），
+ *  查找时哈希一次、比较一次，不分配内存。
+ */
+#ifndef MIMETYPE_H
+#define MIMETYPE_H
+
+#include <string_view>
+
+struct MimeType
+{
+    std::string_view ext;       // 小写扩展名，不带 '.'
+    std::string_view header;    // 完整的 "Content-Type: ...\r\n"，文本类型带 charset
+    bool compressible;          // 文本类，值得生成压缩版本
+};
+
+/* 按路径的扩展名（不区分大小写）查找，未知类型返回 application/octet-stream */
+const MimeType& mimeType(std::string_view path);
+
+#endif
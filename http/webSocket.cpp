@@ -0,0 +1,530 @@
+#include "webSocket.h"
+#include "httpConn.h"
+#include "../reactor/eventLoop.h"
+
+#include <cstring>
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WEBSOCKET_X86
+#endif
+
+using std::string;
+using std::string_view;
+
+/* 握手时拼接在 Sec-WebSocket-Key 后面的固定 GUID */
+static const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+/* 控制帧的负载上限 */
+static const size_t CONTROL_MAX = 125;
+
+/* 帧头最长 14 字节：2 字节固定部分 + 8 字节扩展长度 + 4 字节掩码 */
+static const size_t HEADER_MAX = 14;
+
+/* key 按内存顺序装进一个 32 位整数，逐字节异或 */
+static void maskScalar(char* data, size_t len, uint32_t key)
+{
+    uint8_t k[4];
+    memcpy(k, &key, sizeof(k));
+    for(size_t i = 0; i < len; ++i)
+    {
+        data[i] ^= k[i & 3];
+    }
+}
+
+#ifdef WEBSOCKET_X86
+
+/* 每次处理的字节数都是 4 的倍数，剩下的部分从掩码的第 0 字节开始 */
+__attribute__((target("sse2")))
+static void maskSse2(char* data, size_t len, uint32_t key)
+{
+    const __m128i vk = _mm_set1_epi32(key);
+
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16)
+    {
+        __m128i* p = reinterpret_cast<__m128i*>(data + i);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), vk));
+    }
+
+    maskScalar(data + i, len - i, key);
+}
+
+__attribute__((target("avx2")))
+static void maskAvx2(char* data, size_t len, uint32_t key)
+{
+    const __m256i vk = _mm256_set1_epi32(key);
+
+    size_t i = 0;
+    for(; i + 32 <= len; i += 32)
+    {
+        __m256i* p = reinterpret_cast<__m256i*>(data + i);
+        _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), vk));
+    }
+
+    /* 剩下不足 32 字节的部分交给 SSE2 */
+    maskSse2(data + i, len - i, key);
+}
+
+#endif
+
+typedef void (*MaskFunc)(char*, size_t, uint32_t);
+
+/* 启动时根据 CPU 选择一次 */
+static MaskFunc chooseMask()
+{
+#ifdef WEBSOCKET_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return maskAvx2;
+    }
+    if(__builtin_cpu_supports("sse2"))
+    {
+        return maskSse2;
+    }
+#endif
+    return maskScalar;
+}
+
+static const MaskFunc maskImpl = chooseMask();
+
+/* 文本消息必须是合法的 UTF-8：没有过长编码、代理区码点，不超过 U+10FFFF */
+static bool isValidUtf8(const uint8_t* s, size_t len)
+{
+    size_t i = 0;
+    while(i < len)
+    {
+        /* ASCII 一次检查 8 字节 */
+        if(i + 8 <= len)
+        {
+            uint64_t word;
+            memcpy(&word, s + i, sizeof(word));
+            if((word & 0x8080808080808080ULL) == 0)
+            {
+                i += 8;
+                continue;
+            }
+        }
+
+        uint8_t c = s[i];
+        if(c < 0x80)
+        {
+            ++i;
+            continue;
+        }
+
+        size_t n = 0;
+        uint32_t cp = 0;
+        if(c >= 0xc2 && c <= 0xdf)
+        {
+            n = 1;
+            cp = c & 0x1f;
+        }
+        else if(c >= 0xe0 && c <= 0xef)
+        {
+            n = 2;
+            cp = c & 0x0f;
+        }
+        else if(c >= 0xf0 && c <= 0xf4)
+        {
+            n = 3;
+            cp = c & 0x07;
+        }
+        else
+        {
+            return false;
+        }
+
+        if(i + n >= len)
+        {
+            return false;
+        }
+        for(size_t j = 1; j <= n; ++j)
+        {
+            if((s[i + j] & 0xc0) != 0x80)
+            {
+                return false;
+            }
+            cp = (cp << 6) | (s[i + j] & 0x3f);
+        }
+
+        if((n == 2 && cp < 0x800) || (n == 3 && (cp < 0x10000 || cp > 0x10ffff)) || (cp >= 0xd800 && cp <= 0xdfff))
+        {
+            return false;
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+WebSocket::WebSocket(HttpConn* m_conn, string m_channel, const WsHandler* m_handler)
+    : conn(m_conn), channel(std::move(m_channel)), handler(m_handler)
+{
+    messageOp = 0;
+    opened = false;
+    closing = false;
+}
+
+WebSocket::~WebSocket()
+{
+    if(opened)
+    {
+        conn->getLoop()->leaveChannel(this);
+    }
+}
+
+string WebSocket::acceptKey(string_view key)
+{
+    string text(key);
+    text.append(WS_GUID);
+
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char*>(text.data()), text.size(), digest);
+
+    /* 20 字节的摘要编码后是 28 个字符，再加结尾的 '\0' */
+    unsigned char encoded[32];
+    int len = EVP_EncodeBlock(encoded, digest, SHA_DIGEST_LENGTH);
+    return string(reinterpret_cast<char*>(encoded), len);
+}
+
+WsFramePtr WebSocket::makeFrame(OPCODE opcode, string_view payload)
+{
+    std::shared_ptr<string> frame = std::make_shared<string>();
+    size_t len = payload.size();
+    frame->reserve(len + 10);
+
+    frame->push_back(static_cast<char>(0x80 | opcode));
+    if(len < 126)
+    {
+        frame->push_back(static_cast<char>(len));
+    }
+    else if(len <= 0xffff)
+    {
+        frame->push_back(126);
+        frame->push_back(static_cast<char>(len >> 8));
+        frame->push_back(static_cast<char>(len));
+    }
+    else
+    {
+        frame->push_back(127);
+        for(int shift = 56; shift >= 0; shift -= 8)
+        {
+            frame->push_back(static_cast<char>((uint64_t)len >> shift));
+        }
+    }
+    frame->append(payload.data(), len);
+
+    return frame;
+}
+
+void WebSocket::applyMask(char* data, size_t len, const uint8_t key[4])
+{
+    uint32_t word;
+    memcpy(&word, key, sizeof(word));
+    maskImpl(data, len, word);
+}
+
+void WebSocket::broadcast(const string& channel, OPCODE opcode, string_view payload)
+{
+    EventLoop::broadcast(channel, makeFrame(opcode, payload));
+}
+
+void WebSocket::open()
+{
+    opened = true;
+    conn->getLoop()->joinChannel(this);
+}
+
+void WebSocket::process()
+{
+    ChainBuffer& buffer = conn->readBuffer;
+
+    while(!buffer.empty())
+    {
+        /* 已经发送了关闭帧，之后收到的数据都丢弃 */
+        if(closing)
+        {
+            buffer.consume(buffer.size());
+            return;
+        }
+
+        size_t avail = buffer.size();
+        if(avail < 2)
+        {
+            return;
+        }
+
+        uint8_t head[HEADER_MAX];
+        buffer.copyOut(0, std::min(avail, HEADER_MAX), reinterpret_cast<char*>(head));
+
+        bool fin = head[0] & 0x80;
+        uint8_t opcode = head[0] & 0x0f;
+        bool masked = head[1] & 0x80;
+        uint64_t len = head[1] & 0x7f;
+
+        /* 没有协商扩展，RSV 位必须为 0；客户端的帧必须加掩码 */
+        if((head[0] & 0x70) || !masked)
+        {
+            fail(CLOSE_PROTOCOL_ERROR);
+            continue;
+        }
+
+        size_t pos = 2;
+        if(len == 126)
+        {
+            pos = 4;
+        }
+        else if(len == 127)
+        {
+            pos = 10;
+        }
+        if(avail < pos + 4)
+        {
+            return;
+        }
+
+        if(len == 126)
+        {
+            len = ((uint64_t)head[2] << 8) | head[3];
+        }
+        else if(len == 127)
+        {
+            len = 0;
+            for(int i = 2; i < 10; ++i)
+            {
+                len = (len << 8) | head[i];
+            }
+        }
+
+        const uint8_t* key = head + pos;
+        pos += 4;
+
+        bool control = opcode & 0x8;
+        if(control && (!fin || len > CONTROL_MAX))
+        {
+            fail(CLOSE_PROTOCOL_ERROR);
+            continue;
+        }
+
+        /* 数据帧拼接到 message 中，整条消息不能超过上限（也保证帧能放进读缓冲区） */
+        if(!control && len > WS_MAX_MESSAGE - message.size())
+        {
+            fail(CLOSE_TOO_BIG);
+            continue;
+        }
+
+        if(avail < pos + len)
+        {
+            return;
+        }
+
+        /* 负载复制出来（读缓冲区可能跨块），在副本上去掉掩码 */
+        if(control)
+        {
+            char payload[CONTROL_MAX];
+            buffer.copyOut(pos, len, payload);
+            buffer.consume(pos + len);
+            applyMask(payload, len, key);
+            handleFrame(opcode, fin, payload, len);
+        }
+        else
+        {
+            size_t off = message.size();
+            message.resize(off + len);
+            buffer.copyOut(pos, len, &message[off]);
+            buffer.consume(pos + len);
+            applyMask(&message[off], len, key);
+            handleFrame(opcode, fin, &message[off], len);
+        }
+    }
+}
+
+void WebSocket::handleFrame(uint8_t opcode, bool fin, char* payload, size_t len)
+{
+    switch(opcode)
+    {
+        case OP_CONTINUATION:
+        case OP_TEXT:
+        case OP_BINARY:
+        {
+            /* 分片消息中间不能开始新的消息，没有消息时不能出现后续分片 */
+            if((opcode == OP_CONTINUATION) != (messageOp != 0))
+            {
+                fail(CLOSE_PROTOCOL_ERROR);
+                return;
+            }
+            if(opcode != OP_CONTINUATION)
+            {
+                messageOp = opcode;
+            }
+            if(!fin)
+            {
+                return;
+            }
+
+            bool binary = (messageOp == OP_BINARY);
+            messageOp = 0;
+            if(!binary && !isValidUtf8(reinterpret_cast<const uint8_t*>(message.data()), message.size()))
+            {
+                fail(CLOSE_INVALID_DATA);
+                return;
+            }
+
+            (*handler)(this, binary, message);
+
+            /* 大消息处理完不保留内存 */
+            if(message.capacity() > READ_BUFF_SIZE)
+            {
+                string().swap(message);
+            }
+            else
+            {
+                message.clear();
+            }
+            break;
+        }
+
+        case OP_PING:
+        {
+            send(OP_PONG, string_view(payload, len));
+            break;
+        }
+
+        case OP_PONG:
+        {
+            break;
+        }
+
+        case OP_CLOSE:
+        {
+            /* 回复同样的状态码，没有状态码时回复空的关闭帧 */
+            if(len == 1)
+            {
+                fail(CLOSE_PROTOCOL_ERROR);
+            }
+            else if(!closing)
+            {
+                send(makeFrame(OP_CLOSE, string_view(payload, std::min(len, (size_t)2))));
+                closing = true;
+            }
+            break;
+        }
+
+        default:
+        {
+            fail(CLOSE_PROTOCOL_ERROR);
+            break;
+        }
+    }
+}
+
+void WebSocket::fail(uint16_t code)
+{
+    message.clear();
+    messageOp = 0;
+    close(code);
+}
+
+void WebSocket::send(const WsFramePtr& frame)
+{
+    if(closing)
+    {
+        return;
+    }
+
+    /**
+     * 跟不上广播的连接：丢弃发送队列，关闭套接字的读写两端，
+     * 由事件循环在挂断事件里关闭连接（广播时正在遍历频道，不能在这里回收）
+     */
+    if(outbox.size() >= WS_MAX_OUTBOX)
+    {
+        outbox.clear();
+        closing = true;
+        shutdown(conn->sockfd, SHUT_RDWR);
+        return;
+    }
+
+    outbox.push_back(frame);
+}
+
+void WebSocket::send(OPCODE opcode, string_view payload)
+{
+    send(makeFrame(opcode, payload));
+}
+
+void WebSocket::deliver(const WsFramePtr& frame)
+{
+    send(frame);
+    flush();
+}
+
+void WebSocket::close(uint16_t code, string_view reason)
+{
+    if(closing)
+    {
+        return;
+    }
+
+    char payload[CONTROL_MAX];
+    payload[0] = static_cast<char>(code >> 8);
+    payload[1] = static_cast<char>(code);
+    size_t len = std::min(reason.size(), CONTROL_MAX - 2);
+    memcpy(payload + 2, reason.data(), len);
+
+    send(makeFrame(OP_CLOSE, string_view(payload, len + 2)));
+    closing = true;
+}
+
+void WebSocket::flush()
+{
+    if(fill())
+    {
+        conn->getLoop()->modConn(conn->sockfd, EPOLLOUT);
+    }
+}
+
+bool WebSocket::fill()
+{
+    /* 上一批还没有发送完，发送完后由 writeDone 接着放入 */
+    if(conn->respCount > 0 || outbox.empty())
+    {
+        return false;
+    }
+
+    /* 每帧作为没有回复头的一项，帧的内容直接作为消息体发送 */
+    while(!outbox.empty() && conn->respCount < MAX_PIPELINE)
+    {
+        HttpConn::Response& resp = conn->responses[conn->respCount];
+        resp.file.reset();
+        resp.fileOff = 0;
+        resp.fileSize = outbox.front()->size();
+        resp.frame = std::move(outbox.front());
+        outbox.pop_front();
+
+        conn->queueSegment(const_cast<char*>(resp.frame->data()), resp.fileSize);
+    }
+
+    return true;
+}
+
+bool WebSocket::writeDone()
+{
+    /* 101 发送完，握手之后紧接着到达的帧还在读缓冲区里 */
+    if(!opened)
+    {
+        open();
+        process();
+    }
+
+    /* 关闭帧已经发送 */
+    if(closing && outbox.empty())
+    {
+        return false;
+    }
+
+    fill();
+    return true;
+}
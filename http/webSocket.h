@@ -0,0 +1,121 @@
+/**
+ * WebSocket (RFC 6455)
+ *  GET 请求带 Upgrade: websocket 且路径注册了 WebSocket 路由时，工作线程回复 101，
+ *  之后连接不再交给线程池：帧在连接所属的事件循环线程中解析，客户端帧的掩码按 CPU
+ *  支持情况用 AVX2/SSE2 去除，完整的消息交给路由注册的回调。
+ *  服务器发出的帧预先编码好（服务器帧不加掩码），用 shared_ptr 引用计数：
+ *  广播时同一份帧放入频道中每个连接的发送队列，作为回复队列的一项直接 writev，
+ *  全部发送完后释放，负载只编码一次、不复制。
+ *  连接以升级请求的路径作为频道，频道表每个事件循环各有一份，只在循环线程中访问，
+ *  广播投递到每个循环中执行，不需要给连接加锁。
+ */
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+class HttpConn;
+class WebSocket;
+
+/* 编码好的服务器帧（帧头 + 负载），多个连接共享 */
+typedef std::shared_ptr<const std::string> WsFramePtr;
+
+/* 收到一条完整的消息，在连接所属的事件循环线程中调用 */
+typedef std::function<void(WebSocket* ws, bool binary, std::string_view payload)> WsHandler;
+
+class WebSocket
+{
+public:
+    enum OPCODE
+    {
+        OP_CONTINUATION = 0x0,
+        OP_TEXT = 0x1,
+        OP_BINARY = 0x2,
+        OP_CLOSE = 0x8,
+        OP_PING = 0x9,
+        OP_PONG = 0xA
+    };
+
+    /* 关闭帧的状态码 */
+    enum CLOSE_CODE
+    {
+        CLOSE_NORMAL = 1000,
+        CLOSE_GOING_AWAY = 1001,
+        CLOSE_PROTOCOL_ERROR = 1002,
+        CLOSE_INVALID_DATA = 1007,
+        CLOSE_TOO_BIG = 1009
+    };
+
+    /* channel: 频道名（升级请求的路径），handler 指向路由表中的回调 */
+    WebSocket(HttpConn* conn, std::string channel, const WsHandler* handler);
+    ~WebSocket();
+
+    /* 由 Sec-WebSocket-Key 计算 Sec-WebSocket-Accept */
+    static std::string acceptKey(std::string_view key);
+
+    /* 编码一个不分片的服务器帧 */
+    static WsFramePtr makeFrame(OPCODE opcode, std::string_view payload);
+
+    /* 按 4 字节掩码异或（加掩码和去掩码是同一个操作），data 从负载的开头算起 */
+    static void applyMask(char* data, size_t len, const uint8_t key[4]);
+
+    /* 向所有事件循环中 channel 频道的连接广播，帧只编码一次（线程安全） */
+    static void broadcast(const std::string& channel, OPCODE opcode, std::string_view payload);
+
+    /* 以下只在连接所属的事件循环线程中调用 */
+
+    /* 101 已经发送完，加入频道 */
+    void open();
+    bool isOpen() { return opened; }
+
+    /* 解析读缓冲区中的帧，控制帧直接回复，完整的消息交给回调 */
+    void process();
+
+    /* 一帧放入发送队列，由调用者（或处理完读事件的事件循环）负责开始发送 */
+    void send(const WsFramePtr& frame);
+    void send(OPCODE opcode, std::string_view payload);
+
+    /* 放入发送队列，连接空闲时立即开始发送（广播和排空时使用） */
+    void deliver(const WsFramePtr& frame);
+
+    /* 发送关闭帧，之后不再发送其他帧，关闭帧发送完后关闭连接 */
+    void close(uint16_t code, std::string_view reason = std::string_view());
+
+    /* 连接空闲时开始发送队列中的帧 */
+    void flush();
+
+    /* 回复队列空闲时把发送队列中的帧放进去，返回是否放入了 */
+    bool fill();
+
+    /* 一批帧发送完：101 之后加入频道并处理随握手到达的帧，返回 false 表示关闭连接 */
+    bool writeDone();
+
+    const std::string& getChannel() const { return channel; }
+    HttpConn* getConn() { return conn; }
+
+private:
+    /* 协议错误：发送关闭帧，丢弃之后收到的数据 */
+    void fail(uint16_t code);
+
+    /* 处理一个完整的帧，payload 已经去掉掩码 */
+    void handleFrame(uint8_t opcode, bool fin, char* payload, size_t len);
+
+private:
+    HttpConn* conn;
+    std::string channel;
+    const WsHandler* handler;
+
+    std::deque<WsFramePtr> outbox;  // 等待放入回复队列的帧
+
+    std::string message;            // 分片消息已经收到的部分
+    uint8_t messageOp;              // 正在接收的消息类型，0 表示没有
+    bool opened;                    // 已经加入频道
+    bool closing;                   // 关闭帧已经放入发送队列
+};
+
+#endif
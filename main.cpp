@@ -4,37 +4,24 @@
 #include <signal.h>
 #include <iostream>
 #include <memory>
+#include <thread>
 #include <libgen.h>  // 用于dirname
 
 #include "./http/httpConn.h"
 #include "./pool/threadPool/threadPool.h"
 #include "./pool/sqlConnPool/connPoolRAII.h"
 #include "./timer/timerHeap.h"
+#include "./reactor/reactor.h"
+#include "./reactor/uringReactor.h"
+#include "./config/config.h"
+#include "./upgrade/upgrade.h"
+#include "./cache/fileCache.h"
+#include "./router/router.h"
 #include "constance.h"
 
 using std::cout;
 using std::endl;
 
-extern void addFd(int epollfd, int fd, bool isOneShot);
-extern int setnoblocking(int fd);
-extern void removeFd(int epollfd, int fd);
-extern void modfd(int epollfd, int fd, int ev);
-
-
-// 设置定时器相关信息
-static int pipefd[2];
-static int epollfd = 0;
-static HeapTimer heapTimer;
-
-// 信号处理函数
-void sig_handler(int sig)
-{
-    int saveErrno = errno;
-    int msg = sig;
-    send(pipefd[1], (char*)&msg, 1, 0);
-    errno = saveErrno;
-}
-
 
 // 添加信号
 void addsig(int sig, void(handler)(int), bool restart = true)
@@ -51,18 +38,6 @@ void addsig(int sig, void(handler)(int), bool restart = true)
     assert(sigaction(sig, &sa, nullptr) != -1);
 }
 
-// 定时任务的处理函数
-void timer_handler()
-{
-    heapTimer.tick();
-    alarm(TIMESLOT);
-}
-
-void cb_func(HttpConn* httpconn)
-{
-    httpconn->closeConn();
-}
-
 // 新增：计算资源根目录（程序所在目录 + "/resources"）
 string getRootPath(const char* argv0) 
 {
@@ -98,11 +73,10 @@ string getRootPath(const char* argv0)
 
 int main(int argc, char** argv)
 {
-    if(argc <= 2)
+    Config config;
+    if(!config.parseArgs(argc, argv))
     {
-        #ifdef debug
-            cout << "usage: <ip> <port>" << endl;
-        #endif
+        Config::usage(argv[0]);
         return 1;
     }
 
@@ -112,224 +86,172 @@ int main(int argc, char** argv)
         std::cout << "动态获取的资源根目录: " << rootPath << std::endl;
     #endif
 
-    string ip = argv[1];
-    int port = atoi(argv[2]);
+    HttpConn::maxRequestSize = config.maxRequest;
+    HttpConn::sendMode = config.sendMode;
 
     /* 忽略SIGPIPE信号 */
     addsig(SIGPIPE, SIG_IGN);
 
+    /* SIGTERM/SIGHUP/SIGUSR2 交给 signalfd，必须在创建线程之前屏蔽 */
+    EventLoop::blockSignals();
 
-    /* 创建数据库连接池 */
-    SqlConnPool* connPool = SqlConnPool::getInstance();
-    connPool->init("localhost", 3306, "ccb", "123456", "webserver", 4);
-    
-    /* 创建线程池 */
-    std::shared_ptr<ThreadPool<HttpConn>> threadsPool(new ThreadPool<HttpConn>(8, 16, connPool));
-    
-    /* 预先创建HTTP连接 */
-    std::vector<HttpConn> users(MAX_FD);
-    /* 读取用户表信息 */
-    users[0].initMySQLResult(connPool);
-
-    /* 套接字 */
-    int listenFd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(listenFd >= 0);
-    
-    /* 绑定地址*/
-    sockaddr_in serverAddr;
-    memset(&serverAddr, 0, sizeof(serverAddr));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(port);
-    inet_pton(AF_INET, ip.c_str(), &serverAddr.sin_addr);
+    /* HTTPS：证书和私钥在启动时加载，所有 reactor 共用 */
+    if(config.tlsPort > 0 && !TlsContext::getInstance()->init(config.certFile, config.keyFile))
+    {
+        cout << "load certificate " << config.certFile << " / " << config.keyFile << " failed" << endl;
+        return 1;
+    }
 
-    int ret = bind(listenFd, (struct sockaddr*)(&serverAddr), sizeof(serverAddr));
-    assert(ret >= 0);
-    ret = listen(listenFd, 8);
-    assert(ret >= 0);
+    /* 平滑升级：记录启动参数，若是由旧进程启动的则取出监听套接字，按端口分成 HTTP 和 HTTPS 两组 */
+    Upgrade::init(argc, argv);
+    std::vector<int> inheritFds;
+    std::vector<int> inheritTlsFds;
+    for(int fd : Upgrade::inheritFds())
+    {
+        /* 新的启动参数不再使用的端口直接关闭 */
+        sockaddr_in addr;
+        socklen_t addrLen = sizeof(addr);
+        int port = (getsockname(fd, (struct sockaddr*)&addr, &addrLen) == 0 ? ntohs(addr.sin_port) : -1);
+        if(port == config.port)
+        {
+            inheritFds.push_back(fd);
+        }
+        else if(config.tlsPort > 0 && port == config.tlsPort)
+        {
+            inheritTlsFds.push_back(fd);
+        }
+        else
+        {
+            close(fd);
+        }
+    }
 
-    // 统一事件源
-    epoll_event events[MAX_EVENT_NUMBER];
-    epollfd = epoll_create(5);
-    assert(epollfd >= 0);
 
-    addFd(epollfd, listenFd, false);
-    HttpConn::epollfd = epollfd;
+    /* 静态文件缓存，监视线程要在屏蔽信号之后创建 */
+    if(!FileCache::getInstance()->init(rootPath, config.sendMode == SEND_MMAP,
+        FILE_CACHE_MAX_BYTES, FILE_CACHE_MAX_ENTRIES))
+    {
+        cout << "file cache init failed: " << strerror(errno) << endl;
+    }
 
-    // 创建管道
-    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
-    assert(ret != -1);
-    setnoblocking(pipefd[1]);
-    addFd(epollfd, pipefd[0], false);
+    /**
+     * 路由：页面上的表单提交到 "0"、"1"、"2CGISQL.cgi" 这样的地址，
+     * 登录和注册由处理函数完成，其余路径映射到资源目录
+     */
+    Router* router = Router::getInstance();
+    router->init(rootPath);
+    for(HttpConn::METHOD method : {HttpConn::GET, HttpConn::POST})
+    {
+        router->addFile(method, "/", "/index.html");
+        router->addFile(method, "/0", "/register.html");
+        router->addFile(method, "/1", "/log.html");
+        router->addFile(method, "/5", "/picture.html");
+        router->addFile(method, "/6", "/video.html");
+        router->addFile(method, "/7", "/fans.html");
+        router->mount(method, "/", rootPath);
+    }
+    router->addHandler(HttpConn::POST, "/2CGISQL.cgi", HttpConn::doLogin);
+    router->addHandler(HttpConn::POST, "/3CGISQL.cgi", HttpConn::doRegister);
 
-    // 设置时钟，终止信号处理函数
-    addsig(SIGALRM, sig_handler, false);
-    addsig(SIGTERM, sig_handler, false);
+    /* 上传：POST /upload/文件名 的消息体保存到资源目录的 upload 下，之后可以直接 GET */
+    string uploadDir = rootPath + "/upload";
+    mkdir(uploadDir.c_str(), 0755);
+    router->addUpload("/upload", uploadDir, UPLOAD_MAX_SIZE);
 
-    bool stopServer = false;
+    /* WebSocket：/ws/fans 上收到的消息转发给频道里所有的连接，页面不必轮询 */
+    router->addWebSocket("/ws/fans", [](WebSocket* ws, bool binary, std::string_view payload)
+    {
+        WebSocket::broadcast(ws->getChannel(), binary ? WebSocket::OP_BINARY : WebSocket::OP_TEXT, payload);
+    });
 
-    bool timeout = false;
+    /* 创建数据库连接池 */
+    SqlConnPool* connPool = SqlConnPool::getInstance();
+    connPool->init("localhost", 3306, "ccb", "123456", "webserver", 4);
+    
+    /* 创建线程池 */
+    std::shared_ptr<ThreadPool<HttpConn>> threadsPool(new ThreadPool<HttpConn>(config.minThreads, config.maxThreads, connPool, config.workStealing));
 
-    alarm(TIMESLOT);
+    /**
+     * 线程池的状态和最近的扩缩容记录，用来根据实际负载调整 -p/-P。
+     * 会暴露内部状态：-S 开启，且只回复本机的请求（HTTPS 也一样），其他来源返回 404
+     */
+    if(config.poolStatus)
+    {
+        ThreadPool<HttpConn>* pool = threadsPool.get();
+        router->addStream(HttpConn::GET, "/status/pool", "application/json", [pool](HttpConn* conn) -> StreamProducer
+        {
+            if(!conn->isLoopback())
+            {
+                return nullptr;
+            }
+            return [pool](string& out)
+            {
+                out += pool->report();
+                return false;
+            };
+        });
+    }
+    
+    /* fd 到连接对象的映射，所有 reactor 共享（fd 在进程内唯一），连接对象由各 reactor 按需分配 */
+    std::vector<HttpConn*> users(MAX_FD, nullptr);
+    /* 读取用户表信息 */
+    HttpConn::initMySQLResult(connPool);
 
-    int numbers = -1;
-    while(!stopServer)
+    /* 每个 reactor 各自监听同一端口 */
+    std::vector<std::unique_ptr<EventLoop>> reactors;
+    for(int i = 0; i < config.reactorNum; ++i)
     {
-        numbers = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);
-        if(numbers < 0 && errno != EINTR)
+        if(config.ioBackend == IO_URING)
         {
-            #ifdef debug
-                cout << "epoll_wait failed" << endl;
-            #endif
-            break;
+            reactors.emplace_back(new UringReactor(i, users.data(), threadsPool.get()));
         }
-
-        for(int i = 0; i < numbers; ++i)
+        else
         {
-            int sockfd = events[i].data.fd;
-
-            /* 说明有新连接 */
-            if(sockfd == listenFd)
-            {
-                sockaddr_in clntAddr;
-                socklen_t addrLen = sizeof(clntAddr);
-                
-                /* listenfd ET 模型*/
-                int connfd = -1;
-                while(1)
-                {
-                    connfd = accept(listenFd, (struct sockaddr*)&clntAddr, &addrLen);
-
-                    if(connfd < 0)
-                    {
-                        // 仅处理非 EAGAIN/EWOULDBLOCK 的错误
-                        if(errno != EAGAIN && errno != EWOULDBLOCK)
-                        {
-                            #ifdef debug
-                                cout << "accept error: " << strerror(errno) << endl;  // 打印具体错误
-                            #endif
-                        }
-
-                        break;
-                    }
-    
-                    if(HttpConn::userCount >= MAX_FD)
-                    {
-                        #ifdef debug
-                            cout << "userCount >= MAX_FD" << endl;
-                        #endif
-                        break;
-                    }
-
-                    #ifdef debug
-                        cout << "新连接: connfd = " << connfd << endl;
-                    #endif
-                    
-                    // 分配一个http并初始化连接
-                    users[connfd].init(connfd, clntAddr);
-    
-                    // 设置定时器
-                    heapTimer.add(connfd, 3 * TIMESLOT, std::bind(cb_func, &users[connfd]));
+            reactors.emplace_back(new Reactor(i, users.data(), threadsPool.get()));
+        }
 
-                }
+        int inheritFd = (i < (int)inheritFds.size() ? inheritFds[i] : -1);
+        int inheritTlsFd = (i < (int)inheritTlsFds.size() ? inheritTlsFds[i] : -1);
+        if(!reactors.back()->init(config, inheritFd, inheritTlsFd))
+        {
+            cout << "reactor " << i << " init failed: " << strerror(errno) << endl;
+            return 1;
+        }
+    }
 
-                continue;   // 不用继续if判断了
-            }
-            /* 关闭连接 */
-            else if(events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
-            {
-                // 删除定时器
-                heapTimer.doWork(sockfd);
+    #ifdef debug
+        cout << "reactor number: " << config.reactorNum << endl;
+    #endif
 
-            }
-            /* 处理信号 */
-            else if((sockfd == pipefd[0]) && (events[i].events & EPOLLIN))
-            {
-                // int sig = -1;
-                char signals[1024];
-                ret = recv(sockfd, signals, sizeof(signals), 0);
-                if(ret <= 0)
-                {
-                    continue;
-                }
-                else if(ret > 0)
-                {
-                    for(int i = 0; i < ret; ++i)
-                    {
-                        switch(signals[i])
-                        {
-                            case SIGALRM :
-                            {
-                                timeout = true;
-                                break;
-                            }
-                            case SIGTERM:
-                            {
-                                stopServer = true;
-                                break;
-                            }
-
-                            default:
-                                break;
-                        }
-                    }
-                }
-            }
+    /* reactor 数量变少时，多出来的监听套接字用不上 */
+    for(int i = config.reactorNum; i < (int)inheritFds.size(); ++i)
+    {
+        close(inheritFds[i]);
+    }
+    for(int i = config.reactorNum; i < (int)inheritTlsFds.size(); ++i)
+    {
+        close(inheritTlsFds[i]);
+    }
 
-            /* 处理客户端连接上接到的数据 */
-            else if(events[i].events & EPOLLIN)
-            {
-                if(users[sockfd].readFromClnt())
-                {
-                    #ifdef debug
-                        cout << "deal with the client: " << inet_ntoa(users[sockfd].getAddr()->sin_addr) << endl;
-                    #endif
-                    
-                    // 线程池中加入任务
-                    threadsPool->addTask(&users[sockfd]);
-
-                    // 调整定时器
-                    heapTimer.adjust(sockfd, 3 * TIMESLOT);
-                }
-                else // 读失败
-                {
-                    heapTimer.doWork(sockfd);
-                }
-            }
-            /* 向客户端写数据 */
-            else if(events[i].events & EPOLLOUT)
-            {
-                if(users[sockfd].writeToClnt())
-                {
-                    #ifdef debug
-                    cout << "send data to the client " << inet_ntoa(users[sockfd].getAddr()->sin_addr) << endl;
-                    #endif
-
-                    // 调整定时器
-                    heapTimer.adjust(sockfd, 3 * TIMESLOT);
-                }
-                else
-                {
-                    heapTimer.doWork(sockfd);
-                }
-            }
+    /* 已经在监听了，旧进程可以停止 accept */
+    Upgrade::notifyReady();
 
+    /* 0 号 reactor 运行在主线程中，其余各占一个线程 */
+    std::vector<std::thread> reactorThreads;
+    for(int i = 1; i < config.reactorNum; ++i)
+    {
+        reactorThreads.emplace_back(&EventLoop::loop, reactors[i].get());
+    }
 
-            // 出现超时信号了
-            if(timeout)
-            {
-                timer_handler();
-                timeout = false;
-            }
+    reactors[0]->loop();
 
-        }
+    for(auto& td : reactorThreads)
+    {
+        td.join();
     }
 
+    Upgrade::join();
+    FileCache::getInstance()->stop();
 
-    close(epollfd);
-    close(listenFd);
-    close(pipefd[1]);
-    close(pipefd[0]);
     return 0;
-    
 }
-
@@ -0,0 +1,69 @@
+#include "bufferPool.h"
+
+BufferPool::BufferPool() : usingCnt(0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    for(char* block : freeBlocks)
+    {
+        delete[] block;
+    }
+}
+
+BufferPool* BufferPool::getInstance()
+{
+    static BufferPool bufferPool;
+    return &bufferPool;
+}
+
+char* BufferPool::get()
+{
+    {
+        std::lock_guard<std::mutex> locker(mtx);
+        ++usingCnt;
+        if(!freeBlocks.empty())
+        {
+            char* block = freeBlocks.back();
+            freeBlocks.pop_back();
+            return block;
+        }
+    }
+
+    /* 在锁外分配 */
+    return new char[BUFF_BLOCK_SIZE];
+}
+
+void BufferPool::put(char* block)
+{
+    if(!block)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> locker(mtx);
+        --usingCnt;
+        if((int)freeBlocks.size() < BUFF_POOL_MAX_FREE)
+        {
+            freeBlocks.push_back(block);
+            return;
+        }
+    }
+
+    /* 突发流量过后多余的块还给系统 */
+    delete[] block;
+}
+
+int BufferPool::getFreeCnt()
+{
+    std::lock_guard<std::mutex> locker(mtx);
+    return (int)freeBlocks.size();
+}
+
+int BufferPool::getUsingCnt()
+{
+    std::lock_guard<std::mutex> locker(mtx);
+    return usingCnt;
+}
@@ -0,0 +1,36 @@
+/**
+ * BufferPool: 全进程共享的定长内存块池
+ *  连接只在读写请求期间持有缓冲区，空闲的长连接把缓冲区还回这里，
+ *  内存占用随活跃连接数变化，而不是随连接总数变化。
+ */
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <mutex>
+#include <vector>
+#include "../../constance.h"
+
+class BufferPool
+{
+public:
+    static BufferPool* getInstance();
+
+    /* 取一个 BUFF_BLOCK_SIZE 大小的块，内容未初始化 */
+    char* get();
+    /* 归还块，空闲块超过上限时直接释放 */
+    void put(char* block);
+
+    int getFreeCnt();
+    int getUsingCnt();
+
+private:
+    BufferPool();
+    ~BufferPool();
+
+private:
+    std::mutex mtx;
+    std::vector<char*> freeBlocks;
+    int usingCnt;
+};
+
+#endif
@@ -0,0 +1,41 @@
+#include "connSlab.h"
+
+ConnSlab::ConnSlab()
+{
+}
+
+ConnSlab::~ConnSlab()
+{
+}
+
+void ConnSlab::grow()
+{
+    HttpConn* slab = new HttpConn[CONN_SLAB_SIZE];
+    slabs.emplace_back(slab);
+
+    /* 倒序压入，先取出的是低地址的对象 */
+    for(int i = CONN_SLAB_SIZE - 1; i >= 0; --i)
+    {
+        freeConns.push_back(&slab[i]);
+    }
+}
+
+HttpConn* ConnSlab::get()
+{
+    if(freeConns.empty())
+    {
+        grow();
+    }
+
+    HttpConn* conn = freeConns.back();
+    freeConns.pop_back();
+    return conn;
+}
+
+void ConnSlab::put(HttpConn* conn)
+{
+    if(conn)
+    {
+        freeConns.push_back(conn);
+    }
+}
@@ -0,0 +1,36 @@
+/**
+ * ConnSlab: HttpConn 对象的 slab 分配器
+ *  每个事件循环一个，accept 时取出、关闭时回收，只在所属循环的线程中使用，不需要加锁。
+ *  对象按 CONN_SLAB_SIZE 个一批分配，回收的对象留在空闲链表中复用。
+ */
+#ifndef CONNSLAB_H
+#define CONNSLAB_H
+
+#include <vector>
+#include <memory>
+#include "../../http/httpConn.h"
+#include "../../constance.h"
+
+class ConnSlab
+{
+public:
+    ConnSlab();
+    ~ConnSlab();
+
+    HttpConn* get();
+    void put(HttpConn* conn);
+
+    /* 已经分配的对象个数（含空闲的） */
+    int getCapacity() { return (int)slabs.size() * CONN_SLAB_SIZE; }
+    int getFreeCnt() { return (int)freeConns.size(); }
+
+private:
+    /* 再分配一批对象 */
+    void grow();
+
+private:
+    std::vector<std::unique_ptr<HttpConn[]>> slabs;
+    std::vector<HttpConn*> freeConns;
+};
+
+#endif
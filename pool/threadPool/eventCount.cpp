@@ -0,0 +1,88 @@
+#include "eventCount.h"
+
+#include <climits>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static void futexWait(std::atomic<uint32_t>* addr, uint32_t expected)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t>* addr, int count)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+EventCount::EventCount() : waiters(0), tokens(0)
+{
+}
+
+void EventCount::prepareWait()
+{
+    /* 和 notify 中的屏障配对：登记之后再检查队列，一定能看到 notify 之前入队的任务 */
+    waiters.fetch_add(1, std::memory_order_seq_cst);
+}
+
+void EventCount::cancelWait()
+{
+    waiters.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+void EventCount::wait()
+{
+    uint32_t token = tokens.load(std::memory_order_acquire);
+    while(true)
+    {
+        if(token > 0)
+        {
+            if(tokens.compare_exchange_weak(token, token - 1, std::memory_order_acquire))
+            {
+                break;
+            }
+            continue;
+        }
+
+        /* 令牌数仍为 0 时睡眠，被唤醒（或虚假唤醒）后重新检查 */
+        futexWait(&tokens, 0);
+        token = tokens.load(std::memory_order_acquire);
+    }
+    waiters.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+bool EventCount::notify()
+{
+    /* 入队（release）和读等待者个数之间需要全屏障，否则可能读到登记之前的值 */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int count = waiters.load(std::memory_order_relaxed);
+    if(count == 0)
+    {
+        return false;
+    }
+
+    /* 每个等待者都已经有令牌了，它们醒来后会取走任务 */
+    uint32_t token = tokens.load(std::memory_order_relaxed);
+    while(token < (uint32_t)count)
+    {
+        if(tokens.compare_exchange_weak(token, token + 1, std::memory_order_release))
+        {
+            futexWake(&tokens, 1);
+            break;
+        }
+    }
+    return true;
+}
+
+void EventCount::notifyAll()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int count = waiters.load(std::memory_order_relaxed);
+    if(count == 0)
+    {
+        return;
+    }
+
+    tokens.fetch_add(count, std::memory_order_release);
+    futexWake(&tokens, INT_MAX);
+}
@@ -0,0 +1,37 @@
+/**
+ * EventCount: 无锁队列的等待/唤醒
+ *  空闲的线程先 prepareWait 登记，再检查一次队列，仍然为空才 wait；
+ *  生产者入队后 notify：没有登记的等待者时只是一次读，不进入内核。
+ *  唤醒通过令牌传递：wait 在 futex 上等待令牌，notify 只在令牌数少于等待者时再发一个，
+ *  等待者还没来得及运行时连续入队不会反复唤醒。
+ *  登记之后入队的任务一定能让某个等待者拿到令牌，不会错过唤醒；多出来的令牌只会造成一次空转。
+ */
+#ifndef EVENTCOUNT_H
+#define EVENTCOUNT_H
+
+#include <atomic>
+#include <cstdint>
+
+class EventCount
+{
+public:
+    EventCount();
+
+    /* 登记为等待者 */
+    void prepareWait();
+    /* 登记之后发现有任务，不再等待 */
+    void cancelWait();
+    /* 睡眠直到拿到令牌，返回时已经取消登记 */
+    void wait();
+
+    /* 唤醒一个等待者，没有登记的等待者时返回 false */
+    bool notify();
+    /* 唤醒所有等待者 */
+    void notifyAll();
+
+private:
+    std::atomic_int waiters;        // 登记的等待者个数
+    std::atomic<uint32_t> tokens;   // 还没有被取走的唤醒令牌，futex 等待的地址
+};
+
+#endif
@@ -0,0 +1,132 @@
+/**
+ * MpmcQueue: 有界的无锁多生产者多消费者环形队列
+ *  每个槽带一个序号：序号等于入队位置时槽是空的，等于位置 + 1 时槽里有数据。
+ *  生产者和消费者各自用 CAS 抢占 tail/head 上的一个位置，然后只读写自己的槽，
+ *  不同位置的入队和出队互不等待，也没有锁。容量必须是 2 的幂。
+ */
+#ifndef MPMCQUEUE_H
+#define MPMCQUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+
+template<typename T>
+class MpmcQueue
+{
+public:
+    explicit MpmcQueue(size_t capacity);
+
+    /* 队列满时返回 false */
+    bool push(const T& value);
+    /* 队列空时返回 false */
+    bool pop(T& value);
+
+    /* 近似的元素个数，只用于统计和过载判断 */
+    size_t size() const;
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    /* head 和 tail 分别被消费者和生产者频繁修改，放在不同的缓存行 */
+    static const size_t CACHE_LINE = 64;
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+
+    alignas(CACHE_LINE) std::atomic<size_t> tail;    // 下一个入队位置
+    alignas(CACHE_LINE) std::atomic<size_t> head;    // 下一个出队位置
+};
+
+template<typename T>
+MpmcQueue<T>::MpmcQueue(size_t capacity)
+    : slots(new Slot[capacity]), mask(capacity - 1), tail(0), head(0)
+{
+    assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+    for(size_t i = 0; i < capacity; ++i)
+    {
+        slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+bool MpmcQueue<T>::push(const T& value)
+{
+    size_t pos = tail.load(std::memory_order_relaxed);
+    while(true)
+    {
+        Slot& slot = slots[pos & mask];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if(diff == 0)
+        {
+            /* 槽是空的，抢到这个位置后再写数据 */
+            if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                slot.data = value;
+                slot.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if(diff < 0)
+        {
+            /* 一圈之前的数据还没有被取走 */
+            return false;
+        }
+        else
+        {
+            /* 其他生产者已经占用了这个位置 */
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template<typename T>
+bool MpmcQueue<T>::pop(T& value)
+{
+    size_t pos = head.load(std::memory_order_relaxed);
+    while(true)
+    {
+        Slot& slot = slots[pos & mask];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if(diff == 0)
+        {
+            if(head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                value = slot.data;
+                /* 槽留给下一圈的同一个位置 */
+                slot.seq.store(pos + mask + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if(diff < 0)
+        {
+            /* 槽里还没有数据（生产者可能抢到了位置还没写完） */
+            return false;
+        }
+        else
+        {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template<typename T>
+size_t MpmcQueue<T>::size() const
+{
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_relaxed);
+    return t > h ? t - h : 0;
+}
+
+#endif
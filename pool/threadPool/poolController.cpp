@@ -0,0 +1,199 @@
+#include "poolController.h"
+#include "../../constance.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+
+PoolController::PoolController(int min, int max)
+{
+    minNum = min;
+    maxNum = max;
+
+    startNs = 0;
+    lastNs = 0;
+    last = PoolSample();
+
+    waitEwma = 0;
+    serviceEwma = 0;
+    rateEwma = 0;
+    active = false;
+
+    calmSinceNs = 0;
+    lastGrowNs = 0;
+    progressNs = 0;
+    lastSaturated = false;
+
+    growNum = 0;
+    shrinkNum = 0;
+}
+
+int PoolController::update(const PoolSample& sample, int64_t nowNs)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if(startNs == 0)
+    {
+        startNs = lastNs = progressNs = nowNs;
+        last = sample;
+        return sample.alive;
+    }
+
+    double dt = (nowNs - lastNs) / 1e9;
+    if(dt <= 0)
+    {
+        return sample.alive;
+    }
+
+    uint64_t added = sample.added - last.added;
+    uint64_t done = sample.done - last.done;
+    uint64_t waitNs = sample.waitNs - last.waitNs;
+    uint64_t serviceNs = sample.serviceNs - last.serviceNs;
+    last = sample;
+    lastNs = nowNs;
+
+    /* 周期长短不一（空闲时更长，也会被提前唤醒），按经过的时间换算权重 */
+    double alpha = 1 - std::exp(-dt * 1000 / POOL_EWMA_TAU_MS);
+    rateEwma += alpha * (added / dt - rateEwma);
+    if(done > 0)
+    {
+        /* 执行时间在第一次有任务完成时直接取样本，不从 0 慢慢爬上来 */
+        double serviceUs = serviceNs / 1e3 / done;
+        serviceEwma = (serviceEwma == 0 ? serviceUs : serviceEwma + alpha * (serviceUs - serviceEwma));
+        waitEwma += alpha * (waitNs / 1e3 / done - waitEwma);
+    }
+    else
+    {
+        /* 没有任务完成就没有新的排队时间，积压由下面按队列长度估计 */
+        waitEwma -= alpha * waitEwma;
+    }
+    active = (added > 0 || done > 0 || sample.queued > 0 || sample.busy > 0);
+
+    /* 到达率 × 执行时间：平均同时在执行的任务数 */
+    double demand = rateEwma * serviceEwma / 1e6;
+    int upTarget = (int)std::ceil(demand / POOL_UP_UTIL);
+    int downTarget = (int)std::ceil(demand / POOL_DOWN_UTIL);
+
+    int alive = sample.alive;
+    int target = alive;
+    const char* reason = nullptr;
+
+    /* 卡住的时间从刚发现所有线程都在忙、任务在排队时算起 */
+    bool saturated = (sample.queued > 0 && sample.busy >= alive);
+    if(done > 0 || !saturated || !lastSaturated)
+    {
+        progressNs = nowNs;
+    }
+    lastSaturated = saturated;
+    /* 按更低的利用率估算也用不了这么多线程、并且几乎不排队，持续一段时间才缩容 */
+    bool calm = (downTarget < alive && sample.queued == 0 && waitEwma < POOL_WAIT_LOW_US);
+    if(!calm)
+    {
+        calmSinceNs = 0;
+    }
+    else if(calmSinceNs == 0)
+    {
+        calmSinceNs = nowNs;
+    }
+    int64_t holdNs = POOL_SHRINK_HOLD_MS * 1000000LL;
+
+    double backlogUs = (alive > 0 ? sample.queued * serviceEwma / alive : 0);
+    if(saturated && nowNs - progressNs > POOL_WAIT_HIGH_US * 1000LL)
+    {
+        /* 所有线程都卡在长任务上，排队的任务一个也没有开始：按积压加线程，一次最多加倍 */
+        target = alive + std::min(sample.queued, std::max(alive, 1));
+        reason = "stalled";
+    }
+    else if(saturated && (backlogUs > POOL_WAIT_HIGH_US || waitEwma > POOL_WAIT_HIGH_US))
+    {
+        /* 扩到能在 POOL_WAIT_HIGH_US 内排完积压的线程数 */
+        int need = (int)std::ceil(sample.queued * serviceEwma / POOL_WAIT_HIGH_US);
+        target = std::max({need, upTarget, alive + 1});
+        reason = "backlog";
+    }
+    else if(waitEwma > POOL_WAIT_HIGH_US && upTarget > alive)
+    {
+        target = upTarget;
+        reason = "wait";
+    }
+    else if(calm && nowNs - calmSinceNs >= holdNs && nowNs - lastGrowNs >= holdNs)
+    {
+        target = downTarget;
+        reason = "idle";
+        calmSinceNs = nowNs;
+    }
+
+    target = std::max(minNum, std::min(maxNum, target));
+    if(target > alive)
+    {
+        ++growNum;
+        lastGrowNs = nowNs;
+        record(nowNs, alive, target, reason, sample.queued);
+    }
+    else if(target < alive)
+    {
+        ++shrinkNum;
+        record(nowNs, alive, target, reason, sample.queued);
+    }
+    return target;
+}
+
+bool PoolController::idle()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return !active;
+}
+
+void PoolController::record(int64_t nowNs, int from, int to, const char* reason, int queued)
+{
+    PoolDecision decision;
+    decision.timeMs = (nowNs - startNs) / 1000000;
+    decision.from = from;
+    decision.to = to;
+    decision.reason = reason;
+    decision.waitUs = waitEwma;
+    decision.serviceUs = serviceEwma;
+    decision.rate = rateEwma;
+    decision.queued = queued;
+
+    decisions.push_back(decision);
+    if((int)decisions.size() > POOL_DECISION_LOG)
+    {
+        decisions.pop_front();
+    }
+
+    #ifdef debug
+        std::cout << "thread pool " << reason << ": " << from << " -> " << to
+                  << ", wait " << waitEwma << "us, service " << serviceEwma << "us, rate " << rateEwma
+                  << "/s, queued " << queued << std::endl;
+    #endif
+}
+
+std::string PoolController::report(const PoolSample& sample)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "{\"min\":%d,\"max\":%d,\"alive\":%d,\"busy\":%d,\"queued\":%d,"
+             "\"added\":%llu,\"done\":%llu,\"steals\":%ld,"
+             "\"waitUs\":%.1f,\"serviceUs\":%.1f,\"rate\":%.1f,\"grows\":%ld,\"shrinks\":%ld,\"decisions\":[",
+             minNum, maxNum, sample.alive, sample.busy, sample.queued,
+             (unsigned long long)sample.added, (unsigned long long)sample.done, sample.steals,
+             waitEwma, serviceEwma, rateEwma, growNum, shrinkNum);
+    std::string out(buf);
+
+    for(size_t i = 0; i < decisions.size(); ++i)
+    {
+        const PoolDecision& d = decisions[i];
+        snprintf(buf, sizeof(buf),
+                 "%s{\"timeMs\":%lld,\"from\":%d,\"to\":%d,\"reason\":\"%s\","
+                 "\"waitUs\":%.1f,\"serviceUs\":%.1f,\"rate\":%.1f,\"queued\":%d}",
+                 i ? "," : "", (long long)d.timeMs, d.from, d.to, d.reason,
+                 d.waitUs, d.serviceUs, d.rate, d.queued);
+        out += buf;
+    }
+    out += "]}\n";
+    return out;
+}
@@ -0,0 +1,88 @@
+/**
+ * PoolController: 根据排队时间调整线程池大小
+ *  管理者每个周期把累计的计数交给 update，由两次之间的差值更新三个 EWMA：
+ *  任务的排队时间、执行时间和到达率。到达率 × 执行时间是平均同时在执行的任务数，
+ *  按目标利用率换算成需要的线程数。
+ *  扩容不等 EWMA：所有线程都在忙、任务在排队，且积压按当前线程数排完要等太久（或一个周期内没有任务完成）时，
+ *  立刻扩到能及时排完积压的线程数。
+ *  缩容有滞后：按更低的利用率估算线程数，排队时间很短且持续 POOL_SHRINK_HOLD_MS、这段时间内没有扩容才缩。
+ *  每次调整和当时的估计值都记录下来，report 输出 JSON，用来根据实际负载确定最少/最多线程数。
+ */
+#ifndef POOLCONTROLLER_H
+#define POOLCONTROLLER_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+/* 一个周期的观测，计数都是启动以来的累计值 */
+struct PoolSample
+{
+    int alive;              // 存在的线程数量（不含将要退出的）
+    int busy;               // 正在执行任务的线程数量
+    int queued;             // 排队的任务数量
+    uint64_t added;         // 入队的任务数
+    uint64_t done;          // 执行完的任务数
+    uint64_t waitNs;        // 执行完的任务的排队时间之和
+    uint64_t serviceNs;     // 执行完的任务的执行时间之和
+    long steals;            // 工作窃取模式下窃取的任务数
+};
+
+/* 一次调整 */
+struct PoolDecision
+{
+    int64_t timeMs;         // 启动以来的毫秒数
+    int from;               // 调整前的线程数
+    int to;                 // 调整后的线程数
+    const char* reason;     // backlog / stalled / wait / idle
+    double waitUs;          // 当时的排队时间 EWMA
+    double serviceUs;       // 当时的执行时间 EWMA
+    double rate;            // 当时的到达率 EWMA（每秒）
+    int queued;             // 当时排队的任务数量
+};
+
+class PoolController
+{
+public:
+    PoolController(int min, int max);
+
+    /* 每个周期调用一次（启动时先调用一次作为基准），返回希望的线程数；和当前线程数不同时记录这次调整 */
+    int update(const PoolSample& sample, int64_t nowNs);
+
+    /* 上个周期没有任何任务，管理者可以睡得久一点 */
+    bool idle();
+
+    /* 当前的估计值、调整次数和最近的调整记录（JSON） */
+    std::string report(const PoolSample& sample);
+
+private:
+    void record(int64_t nowNs, int from, int to, const char* reason, int queued);
+
+private:
+    int minNum;
+    int maxNum;
+
+    int64_t startNs;        // 第一次 update 的时间
+    int64_t lastNs;         // 上一次 update 的时间
+    PoolSample last;        // 上一次的累计值
+
+    double waitEwma;        // 排队时间（微秒）
+    double serviceEwma;     // 执行时间（微秒）
+    double rateEwma;        // 到达率（每秒）
+    bool active;            // 上个周期有任务
+
+    int64_t calmSinceNs;    // 满足缩容条件的开始时间，0 表示不满足
+    int64_t lastGrowNs;     // 上一次扩容的时间
+    int64_t progressNs;     // 上一次有任务完成（或者没有积压）的时间
+    bool lastSaturated;     // 上个周期所有线程都在忙且有任务排队
+
+    long growNum;
+    long shrinkNum;
+    std::deque<PoolDecision> decisions;     // 最近 POOL_DECISION_LOG 次调整
+
+    /* update 在管理者线程中调用，report 在工作线程中调用 */
+    std::mutex mutex;
+};
+
+#endif
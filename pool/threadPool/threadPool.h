@@ -1,17 +1,41 @@
+/**
+ * ThreadPool: 工作线程池
+ *  任务队列是无锁的环形队列（MpmcQueue），事件循环入队和工作线程出队都不加锁；
+ *  队列空时工作线程先自旋一会儿，再通过 EventCount 在 futex 上睡眠，入队时只有有人睡眠才唤醒。
+ *  每个连接同时最多有一个任务在队列中（EPOLLONESHOT，io_uring 后端同样如此），
+ *  队列容量不小于 fd 上限就不会满。
+ *
+ *  工作窃取模式：每个工作线程有自己的队列，任务按连接的 fd 分配给固定的线程，
+ *  同一个连接的请求尽量由同一个线程处理，HttpConn 的状态留在它的缓存里；
+ *  自己的队列空了先看共享队列，再从其他线程的队列里窃取。
+ *  归属线程正忙或已经退出时，入队后唤醒一个睡眠的线程来窃取，倾斜的负载不会堆在一个线程上。
+ *  线程槽按最大线程数分配，前 minNum 个是常驻线程，缩容只退出后面的线程，
+ *  fd 落在空槽上时改按 minNum 取模，交给常驻线程。
+ *
+ *  线程数由 PoolController 决定：任务入队时记下时间，执行时统计排队时间和执行时间，
+ *  管理者有任务时每 POOL_TICK_MS 调整一次，所有线程都在忙时 addTask 会提前唤醒它。
+ *  缩容退出的线程由管理者 join 并从 workThread 中删除。
+ */
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
 #include <iostream>
-#include <queue>
 #include <mutex>
-#include <condition_variable>
+#include <atomic>
 #include <functional>
 #include <unistd.h>
 #include <thread>
 #include <vector>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <condition_variable>
 
 #include "../../constance.h"
 #include "../sqlConnPool/connPoolRAII.h"
+#include "mpmcQueue.h"
+#include "eventCount.h"
+#include "poolController.h"
 
 using std::cout;
 using std::endl;
@@ -21,55 +45,130 @@ class ThreadPool
 {
 
 public:
-    ThreadPool(int min, int max, SqlConnPool* connPool);
+    ThreadPool(int min, int max, SqlConnPool* connPool, bool workStealing = false);
     ~ThreadPool();
 
     /* 任务队列有关函数 */
     T* getTask();
-    bool addTask(T *);
+    /* key 为连接的 fd，工作窃取模式下按它选择线程；小于 0 时放进共享队列 */
+    bool addTask(T* task, int key = -1);
     int getSize();
 
     /* 工作线程有关函数 */
     int getBusyNum();
     int getAliveNum();
     int getExitNum();
+    long getStealNum();
+
+    /* 线程池的状态、大小控制的估计值和最近的调整记录（JSON） */
+    std::string report();
 
 
 private:
+    /* 队列中的任务带着入队时间，出队时得到排队时间 */
+    struct QueueItem
+    {
+        T* task;
+        int64_t enqueueNs;
+    };
+
     /* 线程函数 */
     static void work(void*);
+    static void stealWork(void*, int id);
     static void manager(void*);
 
+    /* 执行一个任务，统计排队时间和执行时间 */
+    void runTask(const QueueItem& item);
+
+    /* 空闲时自旋等待任务，取到返回 true */
+    bool spinForTask(QueueItem& item);
+    bool spinForTask(int id, QueueItem& item);
+    /* 依次从自己的队列、共享队列、其他线程的队列中取任务 */
+    bool takeTask(int id, QueueItem& item);
+    /* 管理者要求缩容时，由空闲的线程退出；工作窃取模式下常驻线程不退出 */
+    bool shouldExit(int id = -1);
+    /* 工作窃取模式下退出前交还线程槽 */
+    void retire(int id);
+
+    /* 按 fd 选择线程槽，没有合适的线程时返回 -1 */
+    int route(int key);
+    /* 唤醒一个睡眠的线程（不是 from）来窃取 */
+    void wakeThief(int from);
+    /* 唤醒所有睡眠的线程，退出或缩容时使用 */
+    void wakeAll();
+    /* 工作窃取模式下扩容时找一个空的线程槽 */
+    int freeSlot();
+
+    /* 所有线程都在忙时提前唤醒管理者（任务开始排队，或者任务排了很久才被取走） */
+    void requestGrow();
+    /* 管理者每个周期的观测 */
+    PoolSample sample();
+    /* 按控制器的决定增加或减少线程 */
+    void grow(int num);
+    void shrink(int num);
+    /* 缩容退出的线程登记自己，由管理者 join 后从 workThread 中删除 */
+    void markExited();
+    void reap();
+
+    static int64_t nowNs();
+
 private:
 
     /* 线程池参数*/
     int maxNum;     // 最大线程数量
     int minNum;     // 最小线程数量
-    int busyNum;    // 工作的数量
-    int aliveNum;   // 存在的线程数量
-    int exitNum;    // 退出的线程数量
+    std::atomic_int busyNum;    // 工作的数量
+    std::atomic_int aliveNum;   // 存在的线程数量
+    std::atomic_int exitNum;    // 退出的线程数量
 
     /* 队列参数 */
-    std::mutex queueMutex;      // 队列锁
-    std::queue<T*> taskQueue;    // 任务队列
+    MpmcQueue<QueueItem> taskQueue;    // 任务队列；工作窃取模式下放不带 fd 的任务和本地队列满时的任务
+    EventCount taskEvent;       // 空闲线程在这里睡眠
+
+    /* 工作窃取模式下每个线程槽的状态 */
+    struct Worker
+    {
+        Worker() : queue(WORKER_QUEUE_SIZE), owned(false), busy(false) {}
+
+        MpmcQueue<QueueItem> queue;     // 分配给这个线程的任务，其他线程可以窃取
+        EventCount event;       // 这个线程在这里睡眠
+        std::atomic_bool owned; // 槽上有线程
+        std::atomic_bool busy;  // 线程正在执行任务
+    };
+    std::unique_ptr<Worker[]> workers;  // maxNum 个线程槽，共享队列模式下为空
+    std::atomic_int idleNum;            // 睡眠（或正要睡眠）的线程数量，为 0 时不用找窃取者
+    std::atomic_long stealNum;          // 从其他线程窃取的任务数量
+
+    /* 大小控制的统计：入队计数由事件循环修改，其余由工作线程修改，分开放在不同的缓存行 */
+    alignas(64) std::atomic<uint64_t> addedNum;     // 入队的任务数
+    alignas(64) std::atomic<uint64_t> doneNum;      // 执行完的任务数
+    std::atomic<uint64_t> waitSum;                  // 排队时间之和（纳秒）
+    std::atomic<uint64_t> serviceSum;               // 执行时间之和（纳秒）
 
     /* 线程 */
-    std::vector<std::thread> workThread;    // 工作线程
-    std::thread managerThread;              // 管理者线程
+    std::vector<std::thread> workThread;        // 工作线程
+    std::vector<std::thread::id> exitedThread;  // 已经退出、还没有 join 的线程
+    std::thread managerThread;                  // 管理者线程
 
-    /* 锁与条件变量 */
-    std::mutex poolMutex;               // 池锁
-    std::condition_variable notEmpty;   // 任务队列
+    /* 池锁：保护 workThread、exitedThread 和缩容时的计数 */
+    std::mutex poolMutex;
 
-    bool isStop;
+    /* 管理者在这里等下一个周期，或者被 addTask 提前唤醒 */
+    PoolController controller;
+    std::mutex managerMutex;
+    std::condition_variable managerCond;
+    std::atomic_bool growPending;
+
+    std::atomic_bool isStop;
 
-    static const int STEP = 2;  // 每次增加线程的个数
     SqlConnPool* connsPool;
 
 };
 
 template<typename T>
-ThreadPool<T>::ThreadPool(int min, int max, SqlConnPool* connPool)
+ThreadPool<T>::ThreadPool(int min, int max, SqlConnPool* connPool, bool workStealing)
+    : taskQueue(TASK_QUEUE_SIZE), idleNum(0), stealNum(0), addedNum(0), doneNum(0), waitSum(0),
+      serviceSum(0), controller(min, max), growPending(false)
 {
     
     #ifdef debug
@@ -84,9 +183,21 @@ ThreadPool<T>::ThreadPool(int min, int max, SqlConnPool* connPool)
     minNum = min;
     connsPool = connPool;
 
-    for(int i = 0; i < min; i++)
+    if(workStealing)
     {
-        workThread.emplace_back(&ThreadPool<T>::work, this);
+        workers.reset(new Worker[maxNum]);
+        for(int i = 0; i < min; i++)
+        {
+            workers[i].owned = true;
+            workThread.emplace_back(&ThreadPool<T>::stealWork, this, i);
+        }
+    }
+    else
+    {
+        for(int i = 0; i < min; i++)
+        {
+            workThread.emplace_back(&ThreadPool<T>::work, this);
+        }
     }
 
     aliveNum = minNum;
@@ -98,17 +209,24 @@ ThreadPool<T>::ThreadPool(int min, int max, SqlConnPool* connPool)
 template<typename T>
 ThreadPool<T>::~ThreadPool()
 {
+    // 清理任务队列，任务对象由调用者管理，这里不释放
+    QueueItem item;
+    while(taskQueue.pop(item))
     {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        // 清理任务队列
-        while (!taskQueue.empty()) {
-            delete taskQueue.front();
-            taskQueue.pop();
+    }
+    for(int i = 0; workers && i < maxNum; ++i)
+    {
+        while(workers[i].queue.pop(item))
+        {
         }
     }
 
     isStop = true;
-    notEmpty.notify_all();
+    wakeAll();
+    {
+        std::lock_guard<std::mutex> lock(managerMutex);
+        managerCond.notify_all();
+    }
 
     for(auto& td : workThread)
     {
@@ -134,57 +252,292 @@ ThreadPool<T>::~ThreadPool()
 template<typename T>
 T* ThreadPool<T>::getTask()
 {
-    // 现在 getTask 只在持有 queueMutex 的情况下被调用（或者自己加锁）
-    std::lock_guard<std::mutex> lock(queueMutex);
-    if (taskQueue.empty())
+    QueueItem item;
+    if(!taskQueue.pop(item))
+    {
         return nullptr;
-    T* task = taskQueue.front();
-    taskQueue.pop();
-    return task;
+    }
+    return item.task;
 }
 
 
 template<typename T>
-bool ThreadPool<T>::addTask(T* task)
+bool ThreadPool<T>::addTask(T* task, int key)
 {
     if (isStop) return false;
+
+    addedNum.fetch_add(1, std::memory_order_relaxed);
+    QueueItem item = {task, nowNs()};
+
+    int id = (workers && key >= 0) ? route(key) : -1;
+    if(id >= 0 && workers[id].queue.push(item))
+    {
+        /* 归属线程在睡眠就唤醒它；它正忙或者已经退出时，唤醒另一个线程来窃取 */
+        Worker& worker = workers[id];
+        if(!worker.event.notify() && (worker.busy || !worker.owned))
+        {
+            wakeThief(id);
+        }
+        requestGrow();
+        return true;
+    }
+
+    /* 每个连接最多一个任务，队列不会满；万一满了等工作线程取走一些，不能丢掉任务 */
+    while(!taskQueue.push(item))
+    {
+        if(isStop)
+        {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+
+    if(workers)
     {
-        std::lock_guard<std::mutex> lock(queueMutex);
-        taskQueue.push(task);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wakeThief(-1);
     }
-    // notify after releasing queueMutex (notify can be outside, but safe either way)
-    notEmpty.notify_one();
+    else
+    {
+        taskEvent.notify();
+    }
+    requestGrow();
     return true;
 }
 
 template<typename T>
 int ThreadPool<T>::getSize()
 {
-    std::lock_guard<std::mutex> lock(queueMutex);
-    return (int)taskQueue.size();
+    size_t size = taskQueue.size();
+    for(int i = 0; workers && i < maxNum; ++i)
+    {
+        size += workers[i].queue.size();
+    }
+    return (int)size;
 }
 
 template<typename T>
 int ThreadPool<T>::getBusyNum()
 {
-    std::lock_guard<std::mutex> lock(poolMutex);
     return busyNum;
 }
 
 template<typename T>
 int ThreadPool<T>::getAliveNum()
 {
-    std::lock_guard<std::mutex> lock(poolMutex);
     return aliveNum;
 }
 
 template<typename T>
 int ThreadPool<T>::getExitNum()
 {
-    std::lock_guard<std::mutex> lock(poolMutex);
     return exitNum;
 }
 
+template<typename T>
+long ThreadPool<T>::getStealNum()
+{
+    return stealNum;
+}
+
+template<typename T>
+std::string ThreadPool<T>::report()
+{
+    return controller.report(sample());
+}
+
+template<typename T>
+void ThreadPool<T>::runTask(const QueueItem& item)
+{
+    ++busyNum;
+    int64_t start = nowNs();
+
+    /* 任务已经排了很久，说明提交时没有赶上唤醒管理者（比如线程还没来得及取任务） */
+    if(start - item.enqueueNs > POOL_WAIT_HIGH_US * 1000LL)
+    {
+        requestGrow();
+    }
+
+    // 执行任务：在此期间不应持有任何线程池级锁
+    {
+        // 防御性：确保 task->m_mysql 是可用地址，SqlConnRAII 构造内会 assert
+        T* task = item.task;
+        SqlConnRAII sqlConn(&task->m_mysql, connsPool);
+        task->process();
+    }
+
+    int64_t end = nowNs();
+    waitSum.fetch_add(start - item.enqueueNs, std::memory_order_relaxed);
+    serviceSum.fetch_add(end - start, std::memory_order_relaxed);
+    doneNum.fetch_add(1, std::memory_order_relaxed);
+    --busyNum;
+}
+
+template<typename T>
+bool ThreadPool<T>::spinForTask(QueueItem& item)
+{
+    /* 任务通常很快到来，先自旋，省掉一次睡眠和唤醒的系统调用 */
+    for(int i = 0; i < TASK_SPIN_COUNT; ++i)
+    {
+        if(taskQueue.pop(item))
+        {
+            return true;
+        }
+        #if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+        #endif
+    }
+    return false;
+}
+
+template<typename T>
+bool ThreadPool<T>::spinForTask(int id, QueueItem& item)
+{
+    /* 刚醒来时任务可能在其他线程的队列里，先完整地找一遍 */
+    if(takeTask(id, item))
+    {
+        return true;
+    }
+
+    /* 自旋时只看自己的队列和共享队列，不去碰其他线程队列所在的缓存行 */
+    Worker& self = workers[id];
+    for(int i = 0; i < TASK_SPIN_COUNT; ++i)
+    {
+        if(self.queue.pop(item) || taskQueue.pop(item))
+        {
+            return true;
+        }
+        #if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+        #endif
+    }
+    return false;
+}
+
+template<typename T>
+bool ThreadPool<T>::takeTask(int id, QueueItem& item)
+{
+    if(workers[id].queue.pop(item) || taskQueue.pop(item))
+    {
+        return true;
+    }
+
+    for(int i = 1; i < maxNum; ++i)
+    {
+        if(workers[(id + i) % maxNum].queue.pop(item))
+        {
+            stealNum.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename T>
+bool ThreadPool<T>::shouldExit(int id)
+{
+    if(exitNum.load(std::memory_order_relaxed) <= 0)
+    {
+        return false;
+    }
+
+    /* 常驻线程的槽一直有线程，按 fd 分配时可以直接落到上面 */
+    if(workers && id < minNum)
+    {
+        return false;
+    }
+
+    /* 已经减到最少时放弃这次缩容，否则 exitNum 一直不为 0 */
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if(exitNum <= 0)
+    {
+        return false;
+    }
+    --exitNum;
+    if(aliveNum > minNum)
+    {
+        --aliveNum;
+        return true;
+    }
+    return false;
+}
+
+template<typename T>
+void ThreadPool<T>::retire(int id)
+{
+    /**
+     * reactor 可能按退出之前的归属刚刚放进来了任务：先交还槽再检查队列，
+     * 和 addTask 中入队之后检查 owned 配对，两边至少有一边能看到对方，任务不会留在空槽上没人管
+     */
+    Worker& self = workers[id];
+    self.owned = false;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    QueueItem item;
+    while(self.queue.pop(item))
+    {
+        runTask(item);
+    }
+}
+
+template<typename T>
+int ThreadPool<T>::route(int key)
+{
+    int id = key % maxNum;
+    if(workers[id].owned)
+    {
+        return id;
+    }
+    return minNum > 0 ? key % minNum : -1;
+}
+
+template<typename T>
+void ThreadPool<T>::wakeThief(int from)
+{
+    /* 调用者入队之后已经有全屏障，和等待者先登记 idleNum 再找任务配对 */
+    if(idleNum.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+
+    for(int i = 1; i <= maxNum; ++i)
+    {
+        int id = (from + i) % maxNum;
+        if(id != from && workers[id].event.notify())
+        {
+            return;
+        }
+    }
+}
+
+template<typename T>
+void ThreadPool<T>::wakeAll()
+{
+    if(!workers)
+    {
+        taskEvent.notifyAll();
+        return;
+    }
+
+    for(int i = 0; i < maxNum; ++i)
+    {
+        workers[i].event.notifyAll();
+    }
+}
+
+template<typename T>
+int ThreadPool<T>::freeSlot()
+{
+    for(int i = minNum; i < maxNum; ++i)
+    {
+        if(!workers[i].owned)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
 template<typename T>
 void ThreadPool<T>::work(void* arg)
 {
@@ -192,18 +545,16 @@ void ThreadPool<T>::work(void* arg)
 
     while (true)
     {
-        T* task = nullptr;
-        {   // 作用域：操作队列的临界区
-            std::unique_lock<std::mutex> qlock(pool->queueMutex);
-
-            // 等待：队列非空 OR 线程池停止 OR 要求缩容（exitNum>0）
-            pool->notEmpty.wait(qlock, [&]() {
-                return !pool->taskQueue.empty() || pool->isStop || pool->getExitNum() > 0;
-            });
+        QueueItem item;
+        if(!pool->spinForTask(item))
+        {
+            /* 先登记再检查：登记之后入队的任务一定会唤醒本线程 */
+            pool->taskEvent.prepareWait();
 
             // 如果要停止，直接退出
             if (pool->isStop) 
             {
+                pool->taskEvent.cancelWait();
 #ifdef debug
                 cout << "thread: " << std::this_thread::get_id() << " closed (stop) !!!" << endl;
 #endif
@@ -211,49 +562,77 @@ void ThreadPool<T>::work(void* arg)
             }
 
             // 缩容逻辑：若管理线程设置了 exitNum，并且当前线程数 > minNum，则自己退出
-            if (pool->getExitNum() > 0) 
+            if (pool->shouldExit()) 
             {
-                std::lock_guard<std::mutex> lock(pool->poolMutex);
-                if (pool->aliveNum > pool->minNum) {
-                    --pool->exitNum;
-                    --pool->aliveNum;
+                pool->taskEvent.cancelWait();
+                pool->markExited();
 #ifdef debug
-                    cout << "thread: " << std::this_thread::get_id() << " closed (shrink) !!!" << endl;
+                cout << "thread: " << std::this_thread::get_id() << " closed (shrink) !!!" << endl;
 #endif
-                    return;
-                }
+                return;
             }
 
-            // 从队列取一个任务（确保在 queueMutex 下）
-            if (!pool->taskQueue.empty()) 
+            if(pool->taskQueue.pop(item))
             {
-                task = pool->taskQueue.front();
-                pool->taskQueue.pop();
+                pool->taskEvent.cancelWait();
+            }
+            else
+            {
+                pool->taskEvent.wait();
+                continue;
             }
-        } // 释放 queueMutex
-
-        if (task == nullptr) 
-        {
-            // 可能由于缩容/stop 等原因，没有任务，继续循环
-            continue;
         }
 
-        {   // 增加 busyNum（保护 poolMutex）
-            std::lock_guard<std::mutex> lock(pool->poolMutex);
-            ++pool->busyNum;
-        }
+        pool->runTask(item);
+    }
+}
 
-        // 执行任务：在此期间不应持有任何线程池级锁
+template<typename T>
+void ThreadPool<T>::stealWork(void* arg, int id)
+{
+    ThreadPool<T>* pool = static_cast<ThreadPool<T>*>(arg);
+    Worker& self = pool->workers[id];
+
+    while (true)
+    {
+        QueueItem item;
+        if(!pool->spinForTask(id, item))
         {
-            // 防御性：确保 task->m_mysql 是可用地址，SqlConnRAII 构造内会 assert
-            SqlConnRAII sqlConn(&task->m_mysql, pool->connsPool);
-            task->process();
-        }
+            /* 先登记再检查所有队列：登记之后入队的任务一定会唤醒本线程或者其他线程 */
+            ++pool->idleNum;
+            self.event.prepareWait();
 
-        {   // 任务完成，减少 busyNum
-            std::lock_guard<std::mutex> lock(pool->poolMutex);
-            --pool->busyNum;
+            if (pool->isStop || pool->shouldExit(id))
+            {
+                self.event.cancelWait();
+                --pool->idleNum;
+                if(!pool->isStop)
+                {
+                    pool->retire(id);
+                    pool->markExited();
+                }
+#ifdef debug
+                cout << "thread: " << std::this_thread::get_id() << " closed !!!" << endl;
+#endif
+                return;
+            }
+
+            if(pool->takeTask(id, item))
+            {
+                self.event.cancelWait();
+                --pool->idleNum;
+            }
+            else
+            {
+                self.event.wait();
+                --pool->idleNum;
+                continue;
+            }
         }
+
+        self.busy = true;
+        pool->runTask(item);
+        self.busy = false;
     }
 }
 
@@ -261,40 +640,152 @@ template<typename T>
 void ThreadPool<T>::manager(void* arg)
 {
     ThreadPool<T>* pool = static_cast<ThreadPool<T>*>(arg);
+    pool->controller.update(pool->sample(), nowNs());
 
     while(!pool->isStop)
     {
-        // 每隔3s检查一下
-        std::this_thread::sleep_for(std::chrono::seconds(3));
+        /**
+         * 有任务时每 POOL_TICK_MS 调整一次；空闲时睡得久一些，任务开始排队时被提前唤醒。
+         * 忙的时候不提前醒来，否则持续饱和时每次提交都会唤醒一次管理者
+         */
+        {
+            bool idle = pool->controller.idle();
+            int tick = idle ? POOL_IDLE_TICK_MS : POOL_TICK_MS;
+            std::unique_lock<std::mutex> lock(pool->managerMutex);
+            pool->managerCond.wait_for(lock, std::chrono::milliseconds(tick),
+                                       [pool, idle] { return pool->isStop || (idle && pool->growPending); });
+            pool->growPending = false;
+        }
+        if(pool->isStop)
+        {
+            break;
+        }
+
+        pool->reap();
+
+        PoolSample now = pool->sample();
+        int target = pool->controller.update(now, nowNs());
+        if(target > now.alive)
+        {
+            pool->grow(target - now.alive);
+        }
+        else if(target < now.alive)
+        {
+            pool->shrink(now.alive - target);
+        }
+    }
+
+}
+
+template<typename T>
+void ThreadPool<T>::requestGrow()
+{
+    /* 每个周期最多唤醒一次；加锁再通知，管理者检查完条件、还没睡下时不会错过 */
+    if(busyNum < aliveNum || aliveNum >= maxNum || growPending.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    if(!growPending.exchange(true))
+    {
+        std::lock_guard<std::mutex> lock(managerMutex);
+        managerCond.notify_one();
+    }
+}
 
-        int busy = pool->getBusyNum();
-        int alive = pool->getAliveNum();
+template<typename T>
+PoolSample ThreadPool<T>::sample()
+{
+    PoolSample now;
+    now.alive = aliveNum - exitNum;
+    now.busy = busyNum;
+    now.queued = getSize();
+    now.added = addedNum.load(std::memory_order_relaxed);
+    now.done = doneNum.load(std::memory_order_relaxed);
+    now.waitNs = waitSum.load(std::memory_order_relaxed);
+    now.serviceNs = serviceSum.load(std::memory_order_relaxed);
+    now.steals = stealNum.load(std::memory_order_relaxed);
+    return now;
+}
 
-        if(pool->getSize() > busy && alive < pool->maxNum && !pool->isStop)
+template<typename T>
+void ThreadPool<T>::grow(int num)
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    /* 还没退出的线程先取消退出 */
+    while(num > 0 && exitNum > 0)
+    {
+        --exitNum;
+        --num;
+    }
+
+    for(int i = 0; i < num && aliveNum < maxNum; ++i)
+    {
+        if(!workers)
         {
-            std::lock_guard<std::mutex> lock(pool->poolMutex);
-            for(int i = 0; i < STEP && pool->aliveNum < pool->maxNum; ++i)
-            {
-                ++pool->aliveNum;
-                pool->workThread.emplace_back(&ThreadPool<T>::work, pool);
-            }
+            ++aliveNum;
+            workThread.emplace_back(&ThreadPool<T>::work, this);
+            continue;
+        }
 
-            #ifdef debug
-                cout << "add thread !!!" << endl;
-            #endif
+        /* 退出的线程可能还没交还槽，下次再扩 */
+        int id = freeSlot();
+        if(id < 0)
+        {
+            break;
         }
-        else if(busy * 2 < alive && !pool->isStop)
+        workers[id].owned = true;
+        ++aliveNum;
+        workThread.emplace_back(&ThreadPool<T>::stealWork, this, id);
+    }
+}
+
+template<typename T>
+void ThreadPool<T>::shrink(int num)
+{
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        for(int i = 0; i < num && aliveNum - exitNum > minNum; ++i)
         {
-            std::lock_guard<std::mutex> lock(pool->poolMutex);
-            for(int i = 0; i < STEP && pool->aliveNum > pool->minNum; ++i)
+            ++exitNum;
+        }
+    }
+    wakeAll();
+}
+
+template<typename T>
+void ThreadPool<T>::markExited()
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    exitedThread.push_back(std::this_thread::get_id());
+}
+
+template<typename T>
+void ThreadPool<T>::reap()
+{
+    std::lock_guard<std::mutex> lock(poolMutex);
+    for(std::thread::id id : exitedThread)
+    {
+        for(size_t i = 0; i < workThread.size(); ++i)
+        {
+            if(workThread[i].get_id() == id)
             {
-                ++pool->exitNum;
-                pool->notEmpty.notify_one();
+                /* 线程登记之后马上返回，join 不会等很久 */
+                workThread[i].join();
+                workThread[i] = std::move(workThread.back());
+                workThread.pop_back();
+                break;
             }
         }
-
     }
+    exitedThread.clear();
+}
 
+template<typename T>
+int64_t ThreadPool<T>::nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 #endif
@@ -0,0 +1,385 @@
+#include "eventLoop.h"
+#include "../upgrade/upgrade.h"
+
+extern int setnoblocking(int fd);
+
+using std::cout;
+using std::endl;
+
+/* 过载时直接发送的回复，预先构造好 */
+static const char overload_503[] =
+    "HTTP/1.1 503 Service Unavailable\r\n"
+    "Content-Length:0\r\n"
+    "Connection: close\r\n"
+    "Retry-After: 1\r\n"
+    "\r\n";
+
+sigset_t EventLoop::sigMask;
+EventLoop* EventLoop::loops[MAX_REACTOR];
+std::atomic_int EventLoop::loopCount(0);
+
+void EventLoop::cb_func(HttpConn* httpconn)
+{
+    /* 还在线程池中的连接等工作线程交还之后再关闭，否则会回收一个正在处理的连接 */
+    if(httpconn->tryClose())
+    {
+        httpconn->closeConn();
+    }
+}
+
+EventLoop::EventLoop(int m_id, HttpConn** m_users, ThreadPool<HttpConn>* pool)
+{
+    id = m_id;
+    listenFd = -1;
+    tlsListenFd = -1;
+    stopServer = false;
+    draining = false;
+    accepting = true;
+
+    maxConn = MAX_CONN;
+    maxQueue = MAX_QUEUE_DEPTH;
+    acceptPaused = false;
+
+    users = m_users;
+    threadsPool = pool;
+}
+
+EventLoop::~EventLoop()
+{
+    if(listenFd != -1) close(listenFd);
+    if(tlsListenFd != -1) close(tlsListenFd);
+}
+
+void EventLoop::blockSignals()
+{
+    sigemptyset(&sigMask);
+    sigaddset(&sigMask, SIGTERM);
+    sigaddset(&sigMask, SIGHUP);
+    sigaddset(&sigMask, SIGUSR2);
+
+    /* 之后创建的线程都会继承这个信号掩码 */
+    int ret = pthread_sigmask(SIG_BLOCK, &sigMask, nullptr);
+    assert(ret == 0);
+}
+
+void EventLoop::stop()
+{
+    stopServer = true;
+    wakeup();
+}
+
+void EventLoop::drain()
+{
+    draining = true;
+    wakeup();
+}
+
+void EventLoop::stopAll()
+{
+    int n = loopCount;
+    for(int i = 0; i < n; ++i)
+    {
+        loops[i]->stop();
+    }
+}
+
+void EventLoop::drainAll()
+{
+    /* 之后的回复都不再保持连接 */
+    HttpConn::draining = true;
+
+    int n = loopCount;
+    for(int i = 0; i < n; ++i)
+    {
+        loops[i]->drain();
+    }
+}
+
+std::vector<int> EventLoop::listenFds()
+{
+    std::vector<int> fds;
+    int n = loopCount;
+    for(int i = 0; i < n; ++i)
+    {
+        if(loops[i]->listenFd != -1)
+        {
+            fds.push_back(loops[i]->listenFd);
+        }
+        if(loops[i]->tlsListenFd != -1)
+        {
+            fds.push_back(loops[i]->tlsListenFd);
+        }
+    }
+    return fds;
+}
+
+void EventLoop::onSignal(int signo)
+{
+    switch(signo)
+    {
+        case SIGTERM:
+        case SIGHUP:
+        {
+            stopAll();
+            break;
+        }
+
+        case SIGUSR2:
+        {
+            if(!Upgrade::start(listenFds()))
+            {
+                cout << "upgrade not started" << endl;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+bool EventLoop::checkDrain()
+{
+    if(!draining)
+    {
+        return false;
+    }
+
+    if(accepting)
+    {
+        accepting = false;
+        stopAccept();
+
+        /* 空闲的长连接不必等满超时时间，WebSocket 连接先收到关闭帧 */
+        closeWebSockets();
+        heapTimer.shrinkAll(DRAIN_IDLE_TIMEOUT);
+    }
+
+    return HttpConn::userCount == 0;
+}
+
+void EventLoop::runInLoop(std::function<void()> task)
+{
+    bool needWakeup = false;
+    {
+        std::lock_guard<std::mutex> locker(taskMutex);
+        needWakeup = tasks.empty();
+        tasks.push_back(std::move(task));
+    }
+
+    /* 队列原本不为空时，之前的投递已经唤醒过循环了 */
+    if(needWakeup)
+    {
+        wakeup();
+    }
+}
+
+void EventLoop::runTasks()
+{
+    {
+        std::lock_guard<std::mutex> locker(taskMutex);
+        if(tasks.empty())
+        {
+            return;
+        }
+        runningTasks.swap(tasks);
+    }
+
+    for(auto& task : runningTasks)
+    {
+        task();
+    }
+    runningTasks.clear();
+}
+
+void EventLoop::joinChannel(WebSocket* ws)
+{
+    channels[ws->getChannel()].insert(ws);
+}
+
+void EventLoop::leaveChannel(WebSocket* ws)
+{
+    auto it = channels.find(ws->getChannel());
+    if(it == channels.end())
+    {
+        return;
+    }
+
+    it->second.erase(ws);
+    if(it->second.empty())
+    {
+        channels.erase(it);
+    }
+}
+
+void EventLoop::broadcast(const std::string& channel, const WsFramePtr& frame)
+{
+    int n = loopCount;
+    for(int i = 0; i < n; ++i)
+    {
+        EventLoop* loop = loops[i];
+        loop->runInLoop([loop, channel, frame]()
+        {
+            loop->deliver(channel, frame);
+        });
+    }
+}
+
+void EventLoop::deliver(const std::string& channel, const WsFramePtr& frame)
+{
+    auto it = channels.find(channel);
+    if(it == channels.end())
+    {
+        return;
+    }
+
+    /* 发送队列满的连接只会被 shutdown，不会在这里离开频道 */
+    for(WebSocket* ws : it->second)
+    {
+        ws->deliver(frame);
+    }
+}
+
+void EventLoop::closeWebSockets()
+{
+    for(auto& item : channels)
+    {
+        for(WebSocket* ws : item.second)
+        {
+            ws->close(WebSocket::CLOSE_GOING_AWAY);
+            ws->flush();
+        }
+    }
+}
+
+HttpConn* EventLoop::newConn(int connfd)
+{
+    HttpConn* conn = connSlab.get();
+    users[connfd] = conn;
+    return conn;
+}
+
+HttpConn* EventLoop::detachConn(int sockfd)
+{
+    HttpConn* conn = users[sockfd];
+    users[sockfd] = nullptr;
+    return conn;
+}
+
+void EventLoop::queueConn(HttpConn* conn, int sockfd)
+{
+    conn->enterPool();
+    threadsPool->addTask(conn, sockfd);
+}
+
+HttpConn* EventLoop::getConn(int sockfd)
+{
+    /* 同一批事件中前面刚关闭的 fd 可能已经被其他循环复用；等待关闭的连接不再处理事件 */
+    HttpConn* conn = users[sockfd];
+    if(conn && conn->getLoop() == this && !conn->isClosing())
+    {
+        return conn;
+    }
+    return nullptr;
+}
+
+void EventLoop::registerLoop()
+{
+    loops[loopCount++] = this;
+}
+
+bool EventLoop::admitConn(int connfd, bool tls)
+{
+    if(connfd < MAX_FD && HttpConn::userCount < maxConn)
+    {
+        return true;
+    }
+
+    #ifdef debug
+        cout << "reject connfd = " << connfd << ", userCount = " << HttpConn::userCount << endl;
+    #endif
+
+    /* 新连接的发送缓冲区是空的，一次非阻塞 send 就能写完 */
+    if(!tls)
+    {
+        send(connfd, overload_503, sizeof(overload_503) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    close(connfd);
+    return false;
+}
+
+bool EventLoop::overloaded()
+{
+    return threadsPool->getSize() >= maxQueue;
+}
+
+bool EventLoop::canResume()
+{
+    return threadsPool->getSize() < maxQueue / 2;
+}
+
+bool EventLoop::initLoop(const Config& config, int inheritFd, int inheritTlsFd)
+{
+    maxConn = config.maxConn;
+    maxQueue = config.maxQueue;
+
+    /* 平滑升级：旧进程的监听套接字已经绑定并在监听，直接使用 */
+    if(inheritFd >= 0)
+    {
+        listenFd = inheritFd;
+        setnoblocking(listenFd);
+    }
+    else
+    {
+        listenFd = createListenFd(config.ip, config.port, config.backlog);
+    }
+
+    if(config.tlsPort > 0)
+    {
+        if(inheritTlsFd >= 0)
+        {
+            tlsListenFd = inheritTlsFd;
+            setnoblocking(tlsListenFd);
+        }
+        else
+        {
+            tlsListenFd = createListenFd(config.ip, config.tlsPort, config.backlog);
+        }
+    }
+
+    return listenFd != -1 && (config.tlsPort == 0 || tlsListenFd != -1);
+}
+
+int EventLoop::createListenFd(const std::string& ip, int port, int backlog)
+{
+    /* 套接字 */
+    int fd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        return -1;
+    }
+
+    /* 每个 reactor 绑定同一个端口，由内核做负载均衡 */
+    int optval = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optval, sizeof(optval));
+    if(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    /* 绑定地址*/
+    sockaddr_in serverAddr;
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(port);
+    inet_pton(AF_INET, ip.c_str(), &serverAddr.sin_addr);
+
+    if(bind(fd, (struct sockaddr*)(&serverAddr), sizeof(serverAddr)) < 0 || listen(fd, backlog) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
@@ -0,0 +1,169 @@
+/**
+ * EventLoop: reactor 的公共部分
+ *  每个事件循环拥有独立的 SO_REUSEPORT 监听套接字（HTTP 和可选的 HTTPS）和定时器，
+ *  具体的 I/O 方式由子类实现（epoll 或 io_uring）。
+ */
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <string>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../http/httpConn.h"
+#include "../pool/threadPool/threadPool.h"
+#include "../pool/connSlab/connSlab.h"
+#include "../timer/timerHeap.h"
+#include "../config/config.h"
+#include "../constance.h"
+
+class EventLoop
+{
+public:
+    EventLoop(int id, HttpConn** users, ThreadPool<HttpConn>* pool);
+    virtual ~EventLoop();
+
+    /**
+     * 创建监听套接字及各自需要的资源，inheritFd/inheritTlsFd >= 0 时
+     * 使用旧进程传来的 HTTP/HTTPS 监听套接字
+     */
+    virtual bool init(const Config& config, int inheritFd, int inheritTlsFd) = 0;
+
+    /* 事件循环，直到 stop() 被调用或排空结束 */
+    virtual void loop() = 0;
+
+    /* 通知本循环退出（线程安全） */
+    void stop();
+
+    /* 通知本循环停止 accept，处理完已有连接后退出（线程安全） */
+    void drain();
+
+    /* 连接重新等待读(EPOLLIN)或写(EPOLLOUT)事件，可能在工作线程中调用 */
+    virtual void modConn(int sockfd, int ev) = 0;
+
+    /* 从事件循环中移除并关闭连接，回收连接对象，只在本循环线程中调用 */
+    virtual void closeConn(int sockfd) = 0;
+
+    /* 把任务投递到本循环线程中执行（线程安全） */
+    void runInLoop(std::function<void()> task);
+
+    /* WebSocket 连接加入、离开频道，只在本循环线程中调用 */
+    void joinChannel(WebSocket* ws);
+    void leaveChannel(WebSocket* ws);
+
+    /* 把一帧投递给所有循环中 channel 频道的连接（线程安全），每个循环只投递一次 */
+    static void broadcast(const std::string& channel, const WsFramePtr& frame);
+
+    /* 在创建任何线程之前屏蔽 SIGTERM/SIGHUP，之后由 signalfd 读取 */
+    static void blockSignals();
+
+    /* 停止所有事件循环 */
+    static void stopAll();
+
+    /* 所有事件循环进入排空状态 */
+    static void drainAll();
+
+    /* 所有事件循环的监听套接字（包括 HTTPS），平滑升级时传给新进程 */
+    static std::vector<int> listenFds();
+
+protected:
+    /* 唤醒阻塞中的事件循环 */
+    virtual void wakeup() = 0;
+
+    /* 停止监听：从事件循环中移除监听套接字并关闭本进程的引用 */
+    virtual void stopAccept() = 0;
+
+    /* 保存接入控制参数，创建（或沿用继承的）SO_REUSEPORT 监听套接字 */
+    bool initLoop(const Config& config, int inheritFd, int inheritTlsFd);
+
+    /* 0 号循环从 signalfd 读到的信号 */
+    void onSignal(int signo);
+
+    /* 每轮循环检查排空状态，返回 true 表示可以退出 */
+    bool checkDrain();
+
+    /* 执行其他线程投递过来的任务 */
+    void runTasks();
+
+    /* 排空开始时向所有 WebSocket 连接发送关闭帧（1001） */
+    void closeWebSockets();
+
+    /**
+     * 接入控制：fd 超出范围或连接数达到软上限时回复 503 并关闭，
+     * 返回 false 表示连接已被拒绝；HTTPS 连接还没有握手，不回复直接关闭
+     */
+    bool admitConn(int connfd, bool tls = false);
+
+    /* 线程池排队过多，应当暂停 accept */
+    bool overloaded();
+    /* 排队降到一半以下，可以恢复 accept */
+    bool canResume();
+
+    /* accept 后从 slab 中取一个连接对象登记到 users[connfd] */
+    HttpConn* newConn(int connfd);
+
+    /**
+     * 注销 users[sockfd] 并返回连接对象，必须在 close(sockfd) 之前调用：
+     * 关闭后 fd 可能马上被其他循环复用并登记
+     */
+    HttpConn* detachConn(int sockfd);
+
+    /* 把连接交给线程池：工作线程交还之前超时不会回收连接对象 */
+    void queueConn(HttpConn* conn, int sockfd);
+
+    /* 连接对象属于 sockfd 且由本循环管理 */
+    HttpConn* getConn(int sockfd);
+
+    /* 注册到全局列表，供 stopAll 使用 */
+    void registerLoop();
+
+    /* 连接超时的回调 */
+    static void cb_func(HttpConn* httpconn);
+
+protected:
+    int id;
+    int listenFd;
+    int tlsListenFd;            // HTTPS，没有配置时为 -1
+    std::atomic_bool stopServer;
+    std::atomic_bool draining;
+    bool accepting;             // 排空开始后置为 false
+
+    int maxConn;
+    int maxQueue;
+    bool acceptPaused;
+
+    HttpConn** users;           // fd -> 连接对象，所有循环共享（fd 在进程内唯一）
+
+    /* WebSocket 频道：频道名 -> 本循环中的连接，只在本循环线程中访问（要比 connSlab 后析构） */
+    std::unordered_map<std::string, std::unordered_set<WebSocket*>> channels;
+
+    ConnSlab connSlab;          // 本循环的连接对象，只在本循环线程中分配和回收
+    ThreadPool<HttpConn>* threadsPool;
+    HeapTimer heapTimer;
+
+    static sigset_t sigMask;
+
+private:
+    /* 创建绑定到 ip:port 的 SO_REUSEPORT 监听套接字，失败返回 -1 */
+    static int createListenFd(const std::string& ip, int port, int backlog);
+
+    /* 把帧放入本循环中 channel 频道每个连接的发送队列 */
+    void deliver(const std::string& channel, const WsFramePtr& frame);
+
+    std::mutex taskMutex;
+    std::vector<std::function<void()>> tasks;
+    std::vector<std::function<void()>> runningTasks;
+
+
+    static EventLoop* loops[MAX_REACTOR];
+    static std::atomic_int loopCount;
+};
+
+#endif
@@ -0,0 +1,387 @@
+#include "reactor.h"
+
+using std::cout;
+using std::endl;
+
+extern void addFd(int epollfd, int fd, bool isOneShot);
+extern void removeFd(int epollfd, int fd);
+extern void modfd(int epollfd, int fd, int ev);
+
+Reactor::Reactor(int m_id, HttpConn** m_users, ThreadPool<HttpConn>* pool)
+    : EventLoop(m_id, m_users, pool)
+{
+    epollfd = -1;
+    timerFd = -1;
+    signalFd = -1;
+    wakeupFd = -1;
+    timerArmed = false;
+}
+
+Reactor::~Reactor()
+{
+    if(epollfd != -1) close(epollfd);
+    if(timerFd != -1) close(timerFd);
+    if(signalFd != -1) close(signalFd);
+    if(wakeupFd != -1) close(wakeupFd);
+}
+
+void Reactor::wakeup()
+{
+    uint64_t one = 1;
+    ssize_t ret = write(wakeupFd, &one, sizeof(one));
+    (void)ret;
+}
+
+void Reactor::modConn(int sockfd, int ev)
+{
+    modfd(epollfd, sockfd, ev);
+}
+
+void Reactor::closeConn(int sockfd)
+{
+    HttpConn* conn = detachConn(sockfd);
+    removeFd(epollfd, sockfd);
+    connSlab.put(conn);
+}
+
+void Reactor::stopAccept()
+{
+    /* 新进程还持有同一个监听套接字，这里只是关闭本进程的引用 */
+    removeFd(epollfd, listenFd);
+    listenFd = -1;
+    if(tlsListenFd != -1)
+    {
+        removeFd(epollfd, tlsListenFd);
+        tlsListenFd = -1;
+    }
+}
+
+bool Reactor::init(const Config& config, int inheritFd, int inheritTlsFd)
+{
+    if(!initLoop(config, inheritFd, inheritTlsFd))
+    {
+        return false;
+    }
+
+    // 统一事件源
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if(epollfd < 0)
+    {
+        return false;
+    }
+
+    addFd(epollfd, listenFd, false);
+    if(tlsListenFd != -1)
+    {
+        addFd(epollfd, tlsListenFd, false);
+    }
+
+    // 定时器，由 updateTimer 按最近的超时时间设置
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timerFd == -1)
+    {
+        return false;
+    }
+    addFd(epollfd, timerFd, false);
+
+    // 用于 stop() 唤醒
+    wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wakeupFd == -1)
+    {
+        return false;
+    }
+    addFd(epollfd, wakeupFd, false);
+
+    // 信号只需要一个 reactor 处理
+    if(id == 0)
+    {
+        signalFd = signalfd(-1, &sigMask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if(signalFd == -1)
+        {
+            return false;
+        }
+        addFd(epollfd, signalFd, false);
+    }
+
+    registerLoop();
+
+    return true;
+}
+
+void Reactor::updateTimer()
+{
+    int next = heapTimer.getNextTick();
+    if(next < 0)
+    {
+        return;
+    }
+
+    /**
+     * 连接活跃时定时器只会往后推迟，此时保留已设置的较早时间即可：
+     * 到期后 tick 不做任何事，再按新的时间设置一次。
+     * 这样大多数循环不需要调用 timerfd_settime。
+     */
+    TimeStamp expires = Clock::now() + MS(next);
+    if(timerArmed && armedExpires <= expires)
+    {
+        return;
+    }
+
+    itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = next / 1000;
+    its.it_value.tv_nsec = (next % 1000) * 1000000L;
+    if(next == 0)
+    {
+        /* 全 0 表示取消定时器 */
+        its.it_value.tv_nsec = 1;
+    }
+
+    timerfd_settime(timerFd, 0, &its, nullptr);
+    timerArmed = true;
+    armedExpires = expires;
+}
+
+void Reactor::dealTimer()
+{
+    uint64_t expirations = 0;
+    ssize_t ret = read(timerFd, &expirations, sizeof(expirations));
+    (void)ret;
+
+    timerArmed = false;
+    heapTimer.tick();
+}
+
+void Reactor::dealListen(int fd)
+{
+    sockaddr_in clntAddr;
+    socklen_t addrLen = sizeof(clntAddr);
+    
+    /* listenfd ET 模型，必须一直 accept 到 EAGAIN */
+    int connfd = -1;
+    while(1)
+    {
+        /* 线程池积压太多，先留在内核队列里，等队列降下来再 accept */
+        if(overloaded())
+        {
+            acceptPaused = true;
+            break;
+        }
+
+        connfd = accept4(fd, (struct sockaddr*)&clntAddr, &addrLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if(connfd < 0)
+        {
+            // 仅处理非 EAGAIN/EWOULDBLOCK 的错误
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                #ifdef debug
+                    cout << "accept error: " << strerror(errno) << endl;  // 打印具体错误
+                #endif
+            }
+
+            break;
+        }
+
+        /* 超过连接数上限的回复 503 后关闭，继续处理队列里其余的连接 */
+        if(!admitConn(connfd, fd == tlsListenFd))
+        {
+            continue;
+        }
+
+        #ifdef debug
+            cout << "reactor " << id << " 新连接: connfd = " << connfd << endl;
+        #endif
+        
+        // 分配一个http并初始化连接
+        HttpConn* conn = newConn(connfd);
+        conn->init(connfd, clntAddr, this, fd == tlsListenFd);
+        addFd(epollfd, connfd, true);
+
+        // 设置定时器
+        heapTimer.add(connfd, CONN_TIMEOUT, std::bind(cb_func, conn));
+    }
+}
+
+void Reactor::dealSignal()
+{
+    signalfd_siginfo info;
+    while(read(signalFd, &info, sizeof(info)) == sizeof(info))
+    {
+        onSignal(info.ssi_signo);
+    }
+}
+
+void Reactor::dealRead(int sockfd)
+{
+    HttpConn* conn = getConn(sockfd);
+    if(!conn)
+    {
+        return;
+    }
+
+    /* TLS 握手和上传的消息体由工作线程直接读套接字，这里不读 */
+    if(conn->isHandshaking() || conn->isUploading())
+    {
+        heapTimer.adjust(sockfd, conn->getTimeout());
+        queueConn(conn, sockfd);
+        return;
+    }
+
+    if(conn->readFromClnt())
+    {
+        #ifdef debug
+            cout << "deal with the client: " << inet_ntoa(conn->getAddr()->sin_addr) << endl;
+        #endif
+
+        // 调整定时器：交给线程池之后，getTimeout 读的状态可能正在被工作线程修改
+        heapTimer.adjust(sockfd, conn->getTimeout());
+
+        if(conn->isWebSocket())
+        {
+            /* WebSocket 的帧直接在本线程中处理，有帧要发送时等待写事件 */
+            conn->processWs();
+            modConn(sockfd, conn->getBytesToSend() > 0 ? EPOLLOUT : EPOLLIN);
+        }
+        else
+        {
+            // 线程池中加入任务
+            queueConn(conn, sockfd);
+        }
+    }
+    else // 读失败
+    {
+        heapTimer.doWork(sockfd);
+    }
+}
+
+void Reactor::dealWrite(int sockfd)
+{
+    HttpConn* conn = getConn(sockfd);
+    if(!conn)
+    {
+        return;
+    }
+
+    /* 握手要发送的数据由 OpenSSL 写，继续握手 */
+    if(conn->isHandshaking())
+    {
+        heapTimer.adjust(sockfd, conn->getTimeout());
+        queueConn(conn, sockfd);
+        return;
+    }
+
+    if(conn->writeToClnt())
+    {
+        #ifdef debug
+        cout << "send data to the client " << inet_ntoa(conn->getAddr()->sin_addr) << endl;
+        #endif
+
+        // 调整定时器，要在交给线程池之前
+        heapTimer.adjust(sockfd, conn->getTimeout());
+
+        // 流水线中剩下的请求
+        if(conn->hasPendingRequest())
+        {
+            queueConn(conn, sockfd);
+        }
+    }
+    else
+    {
+        heapTimer.doWork(sockfd);
+    }
+}
+
+void Reactor::loop()
+{
+    int numbers = -1;
+    while(!stopServer)
+    {
+        /* 暂停 accept 或排空期间需要定期检查 */
+        int timeout = -1;
+        if(draining)
+        {
+            timeout = DRAIN_CHECK_MS;
+        }
+        else if(acceptPaused)
+        {
+            timeout = ACCEPT_PAUSE_MS;
+        }
+
+        numbers = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, timeout);
+        if(numbers < 0 && errno != EINTR)
+        {
+            #ifdef debug
+                cout << "epoll_wait failed" << endl;
+            #endif
+            break;
+        }
+
+        for(int i = 0; i < numbers; ++i)
+        {
+            int sockfd = events[i].data.fd;
+
+            /* 说明有新连接 */
+            if(sockfd == listenFd || sockfd == tlsListenFd)
+            {
+                if(accepting && !acceptPaused)
+                {
+                    dealListen(sockfd);
+                }
+            }
+            /* 关闭连接 */
+            else if(events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            {
+                // 删除定时器
+                heapTimer.doWork(sockfd);
+            }
+            /* 定时器到期 */
+            else if(sockfd == timerFd)
+            {
+                dealTimer();
+            }
+            /* 处理信号 */
+            else if(sockfd == signalFd)
+            {
+                dealSignal();
+            }
+            /* 被其他线程唤醒，执行投递过来的任务 */
+            else if(sockfd == wakeupFd)
+            {
+                uint64_t cnt = 0;
+                ssize_t ret = read(wakeupFd, &cnt, sizeof(cnt));
+                (void)ret;
+                runTasks();
+            }
+            /* 处理客户端连接上接到的数据 */
+            else if(events[i].events & EPOLLIN)
+            {
+                dealRead(sockfd);
+            }
+            /* 向客户端写数据 */
+            else if(events[i].events & EPOLLOUT)
+            {
+                dealWrite(sockfd);
+            }
+        }
+
+        /* 排队降下来了，把积压在内核里的连接取出来 */
+        if(acceptPaused && accepting && canResume())
+        {
+            acceptPaused = false;
+            dealListen(listenFd);
+            if(tlsListenFd != -1)
+            {
+                dealListen(tlsListenFd);
+            }
+        }
+
+        updateTimer();
+
+        /* 平滑升级：连接都处理完了就退出 */
+        if(checkDrain())
+        {
+            break;
+        }
+    }
+}
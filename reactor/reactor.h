@@ -0,0 +1,56 @@
+/**
+ * Reactor: 基于 epoll 的事件循环
+ *  超时由 timerfd 驱动（按 HeapTimer::getNextTick 设置），
+ *  SIGTERM/SIGHUP 由 0 号 reactor 通过 signalfd 读取。
+ */
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+
+#include "eventLoop.h"
+
+class Reactor : public EventLoop
+{
+public:
+    Reactor(int id, HttpConn** users, ThreadPool<HttpConn>* pool);
+    ~Reactor();
+
+    bool init(const Config& config, int inheritFd, int inheritTlsFd) override;
+    void loop() override;
+
+    void modConn(int sockfd, int ev) override;
+    void closeConn(int sockfd) override;
+
+protected:
+    void wakeup() override;
+    void stopAccept() override;
+
+private:
+    /* 从 fd（HTTP 或 HTTPS 监听套接字）接收新连接 */
+    void dealListen(int fd);
+    void dealSignal();
+    void dealTimer();
+    void dealRead(int sockfd);
+    void dealWrite(int sockfd);
+
+    /* 根据最近的定时器重新设置 timerfd */
+    void updateTimer();
+
+private:
+    int epollfd;
+    int timerFd;            // 定时器超时
+    int signalFd;           // 只有 0 号 reactor 持有
+    int wakeupFd;           // 其他线程唤醒本 reactor
+
+    /* timerfd 当前设置的到期时间 */
+    bool timerArmed;
+    TimeStamp armedExpires;
+
+    epoll_event events[MAX_EVENT_NUMBER];
+};
+
+#endif
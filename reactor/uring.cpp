@@ -0,0 +1,249 @@
+#include "uring.h"
+
+static int io_uring_setup(unsigned entries, io_uring_params* p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nrArgs)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs);
+}
+
+Uring::Uring()
+{
+    ringFd = -1;
+    sqEntries = 0;
+    toSubmit = 0;
+    sqPtr = cqPtr = MAP_FAILED;
+    sqSize = cqSize = sqesSize = 0;
+    sqes = nullptr;
+    sqeTail = 0;
+
+    bufRing = nullptr;
+    bufRingSize = 0;
+    bufBase = nullptr;
+    bufCount = 0;
+    bufSize = 0;
+    bufGroup = 0;
+}
+
+Uring::~Uring()
+{
+    if(bufRing) munmap(bufRing, bufRingSize);
+    delete[] bufBase;
+
+    if(sqes) munmap(sqes, sqesSize);
+    if(cqPtr != MAP_FAILED && cqPtr != sqPtr) munmap(cqPtr, cqSize);
+    if(sqPtr != MAP_FAILED) munmap(sqPtr, sqSize);
+    if(ringFd != -1) close(ringFd);
+}
+
+bool Uring::init(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ringFd = io_uring_setup(entries, &params);
+    if(ringFd < 0)
+    {
+        return false;
+    }
+
+    /* 需要 IORING_ENTER_EXT_ARG 实现带超时的等待 */
+    if(!(params.features & IORING_FEAT_EXT_ARG))
+    {
+        return false;
+    }
+
+    sqEntries = params.sq_entries;
+    sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(singleMmap)
+    {
+        sqSize = cqSize = (sqSize > cqSize ? sqSize : cqSize);
+    }
+
+    sqPtr = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if(sqPtr == MAP_FAILED)
+    {
+        return false;
+    }
+
+    if(singleMmap)
+    {
+        cqPtr = sqPtr;
+    }
+    else
+    {
+        cqPtr = mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if(cqPtr == MAP_FAILED)
+        {
+            return false;
+        }
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* ptr = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if(ptr == MAP_FAILED)
+    {
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(ptr);
+
+    char* sq = static_cast<char*>(sqPtr);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqeTail = *sqTail;
+
+    char* cq = static_cast<char*>(cqPtr);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+io_uring_sqe* Uring::getSqe()
+{
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    if(sqeTail - head >= sqEntries)
+    {
+        /* 提交队列满了，先交给内核 */
+        io_uring_enter(ringFd, toSubmit, 0, 0, nullptr, 0);
+        toSubmit = 0;
+
+        head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if(sqeTail - head >= sqEntries)
+        {
+            return nullptr;
+        }
+    }
+
+    unsigned idx = sqeTail & *sqMask;
+    io_uring_sqe* sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+
+    sqArray[idx] = idx;
+    ++sqeTail;
+    ++toSubmit;
+    __atomic_store_n(sqTail, sqeTail, __ATOMIC_RELEASE);
+
+    return sqe;
+}
+
+int Uring::submitAndWait(int timeoutMs)
+{
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    memset(&arg, 0, sizeof(arg));
+
+    if(timeoutMs >= 0)
+    {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+    }
+
+    /* 已经有完成事件时不再阻塞 */
+    unsigned minComplete = (peekCqe() ? 0 : 1);
+
+    int ret = io_uring_enter(ringFd, toSubmit, minComplete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if(ret >= 0)
+    {
+        toSubmit = 0;
+    }
+    else if(errno == ETIME || errno == EINTR)
+    {
+        /* 超时或被打断，sqe 已经提交 */
+        toSubmit = 0;
+        ret = 0;
+    }
+
+    return ret;
+}
+
+io_uring_cqe* Uring::peekCqe()
+{
+    unsigned head = *cqHead;
+    if(head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+    {
+        return nullptr;
+    }
+
+    return &cqes[head & *cqMask];
+}
+
+void Uring::cqeSeen()
+{
+    __atomic_store_n(cqHead, *cqHead + 1, __ATOMIC_RELEASE);
+}
+
+bool Uring::setupBufRing(unsigned short bgid, unsigned count, unsigned size)
+{
+    /* count 必须是 2 的幂 */
+    if(count == 0 || (count & (count - 1)) != 0)
+    {
+        return false;
+    }
+
+    bufRingSize = count * sizeof(io_uring_buf);
+    void* ptr = mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if(ptr == MAP_FAILED)
+    {
+        bufRingSize = 0;
+        return false;
+    }
+    /* 注册前先写一遍，确保页面已经分配且可写 */
+    memset(ptr, 0, bufRingSize);
+    bufRing = static_cast<io_uring_buf_ring*>(ptr);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)bufRing;
+    reg.ring_entries = count;
+    reg.bgid = bgid;
+
+    if(io_uring_register(ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        return false;
+    }
+
+    bufGroup = bgid;
+    bufCount = count;
+    bufSize = size;
+    bufBase = new char[(size_t)count * size];
+
+    bufRing->tail = 0;
+    for(unsigned i = 0; i < count; ++i)
+    {
+        recycleBuf(i);
+    }
+
+    return true;
+}
+
+void Uring::recycleBuf(unsigned short bid)
+{
+    unsigned short tail = bufRing->tail;
+    /**
+     * 不能用 bufRing->bufs：内核头文件里的柔性数组在 C++ 下
+     * 前面多了一个空结构体，偏移量会错 8 字节
+     */
+    io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(bufRing) + (tail & (bufCount - 1));
+    buf->addr = (uint64_t)(uintptr_t)getBuf(bid);
+    buf->len = bufSize;
+    buf->bid = bid;
+
+    __atomic_store_n(&bufRing->tail, (unsigned short)(tail + 1), __ATOMIC_RELEASE);
+}
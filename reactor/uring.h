@@ -0,0 +1,74 @@
+/**
+ * 对 io_uring 系统调用的简单封装（不依赖 liburing）
+ *  只实现服务器用到的部分：提交队列、完成队列、提供缓冲区环。
+ */
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdint>
+#include <errno.h>
+
+class Uring
+{
+public:
+    Uring();
+    ~Uring();
+
+    /* 创建 entries 大小的 ring，失败返回 false */
+    bool init(unsigned entries);
+
+    /* 取一个空闲的 sqe，提交队列满时先提交 */
+    io_uring_sqe* getSqe();
+
+    /* 提交所有 sqe，并等待至少一个完成事件，timeoutMs < 0 表示一直等待 */
+    int submitAndWait(int timeoutMs);
+
+    /* 取下一个完成事件，没有时返回 nullptr，处理完调用 cqeSeen */
+    io_uring_cqe* peekCqe();
+    void cqeSeen();
+
+    /* 注册 count 个大小为 size 的提供缓冲区，组号为 bgid */
+    bool setupBufRing(unsigned short bgid, unsigned count, unsigned size);
+    char* getBuf(unsigned short bid) { return bufBase + (size_t)bid * bufSize; }
+    /* 把缓冲区还给内核 */
+    void recycleBuf(unsigned short bid);
+
+private:
+    int ringFd;
+    unsigned sqEntries;
+    unsigned toSubmit;
+
+    /* 提交队列 */
+    void* sqPtr;
+    size_t sqSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned sqeTail;
+
+    /* 完成队列 */
+    void* cqPtr;
+    size_t cqSize;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    io_uring_cqe* cqes;
+
+    /* 提供缓冲区环 */
+    io_uring_buf_ring* bufRing;
+    size_t bufRingSize;
+    char* bufBase;
+    unsigned bufCount;
+    unsigned bufSize;
+    unsigned short bufGroup;
+};
+
+#endif
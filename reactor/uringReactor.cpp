@@ -0,0 +1,777 @@
+#include "uringReactor.h"
+
+using std::cout;
+using std::endl;
+
+UringReactor::UringReactor(int m_id, HttpConn** m_users, ThreadPool<HttpConn>* pool)
+    : EventLoop(m_id, m_users, pool)
+{
+    wakeupFd = -1;
+    wakeupBuf = 0;
+    signalFd = -1;
+    acceptArmed = false;
+    tlsAcceptArmed = false;
+}
+
+UringReactor::~UringReactor()
+{
+    if(wakeupFd != -1) close(wakeupFd);
+    if(signalFd != -1) close(signalFd);
+}
+
+uint64_t UringReactor::makeData(OP_TYPE op, int fd, uint32_t gen)
+{
+    /* | op 8位 | gen 24位 | fd 32位 | */
+    return ((uint64_t)op << 56) | ((uint64_t)(gen & 0xffffff) << 32) | (uint32_t)fd;
+}
+
+bool UringReactor::init(const Config& config, int inheritFd, int inheritTlsFd)
+{
+    if(!initLoop(config, inheritFd, inheritTlsFd))
+    {
+        return false;
+    }
+
+    if(!ring.init(URING_ENTRIES))
+    {
+        #ifdef debug
+            cout << "io_uring setup failed: " << strerror(errno) << endl;
+        #endif
+        return false;
+    }
+
+    /* recv 使用的提供缓冲区，数据拷贝进 HttpConn 后立即归还 */
+    if(!ring.setupBufRing(0, URING_BUF_COUNT, READ_BUFF_SIZE))
+    {
+        return false;
+    }
+
+    /* io_uring 对非阻塞文件直接返回 EAGAIN，这里使用阻塞的 fd */
+    wakeupFd = eventfd(0, EFD_CLOEXEC);
+    if(wakeupFd == -1)
+    {
+        return false;
+    }
+
+    // 信号只需要一个循环处理
+    if(id == 0)
+    {
+        signalFd = signalfd(-1, &sigMask, SFD_CLOEXEC);
+        if(signalFd == -1)
+        {
+            return false;
+        }
+    }
+
+    connGen.assign(MAX_FD, 0);
+    recvArmed.assign(MAX_FD, 0);
+    registerLoop();
+
+    return true;
+}
+
+void UringReactor::wakeup()
+{
+    uint64_t one = 1;
+    ssize_t ret = write(wakeupFd, &one, sizeof(one));
+    (void)ret;
+}
+
+void UringReactor::modConn(int sockfd, int ev)
+{
+    if(std::this_thread::get_id() == loopThread)
+    {
+        dealEvent(sockfd, ev);
+        return;
+    }
+
+    bool needWakeup = false;
+    {
+        std::lock_guard<std::mutex> locker(postMutex);
+        needWakeup = postQueue.empty();
+        postQueue.push_back({sockfd, ev});
+    }
+
+    /* 队列原本不为空时，之前的投递已经唤醒过循环了 */
+    if(needWakeup)
+    {
+        uint64_t one = 1;
+        ssize_t ret = write(wakeupFd, &one, sizeof(one));
+        (void)ret;
+    }
+}
+
+void UringReactor::closeConn(int sockfd)
+{
+    modConn(sockfd, 0);
+}
+
+void UringReactor::submitAccept(int fd)
+{
+    io_uring_sqe* sqe = ring.getSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    /**
+     * 和 epoll 后端一样接受为非阻塞的套接字：工作线程直接读写套接字（上传的 splice、OpenSSL），
+     * 阻塞的套接字会让线程停在对端停滞的连接上，超时关闭时还在使用这个连接对象
+     */
+    sqe->accept_flags = SOCK_CLOEXEC | SOCK_NONBLOCK;
+    sqe->user_data = makeData(OP_ACCEPT, fd, 0);
+    (fd == tlsListenFd ? tlsAcceptArmed : acceptArmed) = true;
+}
+
+void UringReactor::cancelAccept(int fd)
+{
+    /* 取消后 multishot accept 会返回一个不带 F_MORE 的完成事件 */
+    io_uring_sqe* sqe = ring.getSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = makeData(OP_ACCEPT, fd, 0);
+    sqe->user_data = makeData(OP_CLOSE, fd, 0);
+}
+
+void UringReactor::stopAccept()
+{
+    /* 取消 multishot accept，新进程还持有同一个监听套接字 */
+    if(acceptArmed)
+    {
+        cancelAccept(listenFd);
+    }
+    close(listenFd);
+    listenFd = -1;
+
+    if(tlsListenFd != -1)
+    {
+        if(tlsAcceptArmed)
+        {
+            cancelAccept(tlsListenFd);
+        }
+        close(tlsListenFd);
+        tlsListenFd = -1;
+    }
+}
+
+void UringReactor::submitRecv(int fd)
+{
+    if(recvArmed[fd])
+    {
+        return;
+    }
+    recvArmed[fd] = 1;
+
+    io_uring_sqe* sqe = ring.getSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->len = READ_BUFF_SIZE;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = makeData(OP_RECV, fd, connGen[fd]);
+}
+
+void UringReactor::submitPoll(int fd, bool out)
+{
+    /* 等待可读和 recv 一样，同一时间只能有一个在内核中 */
+    if(!out)
+    {
+        if(recvArmed[fd])
+        {
+            return;
+        }
+        recvArmed[fd] = 1;
+    }
+
+    io_uring_sqe* sqe = ring.getSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = (out ? POLLOUT : POLLIN | POLLRDHUP);
+    sqe->user_data = makeData(out ? OP_POLL_OUT : OP_POLL_IN, fd, connGen[fd]);
+}
+
+void UringReactor::armRead(int fd)
+{
+    /* 上传的数据不能被 recv 取走；用户空间解密的 TLS 连接要由 OpenSSL 读套接字 */
+    if(users[fd]->needPollRead())
+    {
+        submitPoll(fd, false);
+    }
+    else
+    {
+        submitRecv(fd);
+    }
+}
+
+void UringReactor::armWrite(int fd)
+{
+    /* 用户空间加密的 TLS 连接（和握手）由 OpenSSL 写套接字 */
+    if(users[fd]->needPollWrite())
+    {
+        submitPoll(fd, true);
+    }
+    else
+    {
+        submitSend(fd);
+    }
+}
+
+void UringReactor::submitSend(int fd)
+{
+    /* sendfile 模式下文件内容经管道 splice 到套接字 */
+    if(users[fd]->atFileSegment())
+    {
+        submitSplice(fd);
+        return;
+    }
+
+    /**
+     * 后面还有 splice 段时带上 MSG_MORE，和 epoll 后端一样让回复头（或 HTTP/2 的帧头）
+     * 和文件内容合并发送，否则小的头先发出去，文件内容要等对端延迟确认
+     */
+    bool more = false;
+    msghdr* msg = users[fd]->getMsg(more);
+
+    io_uring_sqe* sqe = ring.getSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | (more ? MSG_MORE : 0);
+    sqe->user_data = makeData(OP_SEND, fd, connGen[fd]);
+}
+
+void UringReactor::submitSplice(int fd)
+{
+    HttpConn* conn = users[fd];
+    int* pipeFd = conn->getPipe();
+    if(!pipeFd)
+    {
+        heapTimer.doWork(fd);
+        return;
+    }
+
+    io_uring_sqe* sqe = ring.getSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->splice_flags = SPLICE_F_MOVE;
+
+    if(conn->pipeBytes > 0)
+    {
+        /* 先把管道里的数据发出去 */
+        sqe->splice_fd_in = pipeFd[0];
+        sqe->splice_off_in = (uint64_t)-1;
+        sqe->fd = fd;
+        sqe->off = (uint64_t)-1;
+        sqe->len = conn->pipeBytes;
+        sqe->user_data = makeData(OP_SPLICE_OUT, fd, connGen[fd]);
+    }
+    else
+    {
+        /* 管道空了，从文件当前偏移再读一段 */
+        sqe->splice_fd_in = conn->getFileFd();
+        sqe->splice_off_in = conn->getFileOffset();
+        sqe->fd = pipeFd[1];
+        sqe->off = (uint64_t)-1;
+        sqe->len = std::min(conn->getFileRemain(), (size_t)URING_SPLICE_CHUNK);
+        sqe->user_data = makeData(OP_SPLICE_IN, fd, connGen[fd]);
+    }
+}
+
+void UringReactor::submitClose(int fd)
+{
+    /* 先取消该 fd 上未完成的 recv/send，否则它们持有的引用会让套接字一直打开 */
+    io_uring_sqe* sqe = ring.getSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    /* 没有可取消的请求时会返回 -ENOENT，用硬链接保证 close 照常执行 */
+    sqe->flags = IOSQE_IO_HARDLINK;
+    sqe->user_data = makeData(OP_CLOSE, fd, connGen[fd]);
+
+    sqe = ring.getSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = makeData(OP_CLOSE, fd, connGen[fd]);
+}
+
+void UringReactor::submitWakeup()
+{
+    io_uring_sqe* sqe = ring.getSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeupFd;
+    sqe->addr = (uint64_t)(uintptr_t)&wakeupBuf;
+    sqe->len = sizeof(wakeupBuf);
+    sqe->user_data = makeData(OP_WAKEUP, wakeupFd, 0);
+}
+
+void UringReactor::submitSignal()
+{
+    io_uring_sqe* sqe = ring.getSqe();
+    assert(sqe);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = signalFd;
+    sqe->addr = (uint64_t)(uintptr_t)&sigInfo;
+    sqe->len = sizeof(sigInfo);
+    sqe->user_data = makeData(OP_SIGNAL, signalFd, 0);
+}
+
+void UringReactor::dealAccept(io_uring_cqe* cqe)
+{
+    /* multishot accept 结束了，需要重新提交（暂停期间由 loop 恢复） */
+    if(!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        int fd = (int)(cqe->user_data & 0xffffffff);
+        (fd == tlsListenFd ? tlsAcceptArmed : acceptArmed) = false;
+        if(!stopServer && !acceptPaused && accepting && (fd == listenFd || fd == tlsListenFd))
+        {
+            submitAccept(fd);
+        }
+    }
+
+    int connfd = cqe->res;
+    if(connfd < 0)
+    {
+        #ifdef debug
+            cout << "accept error: " << strerror(-connfd) << endl;
+        #endif
+        return;
+    }
+
+    bool tls = ((int)(cqe->user_data & 0xffffffff) == tlsListenFd);
+    if(!admitConn(connfd, tls))
+    {
+        return;
+    }
+
+    /* 线程池积压太多，剩下的连接先留在内核队列里 */
+    if(!acceptPaused && overloaded())
+    {
+        acceptPaused = true;
+        if(acceptArmed)
+        {
+            cancelAccept(listenFd);
+        }
+        if(tlsAcceptArmed)
+        {
+            cancelAccept(tlsListenFd);
+        }
+    }
+
+    /* multishot accept 不返回对端地址，只在调试时查询 */
+    sockaddr_in clntAddr;
+    memset(&clntAddr, 0, sizeof(clntAddr));
+    #ifdef debug
+        socklen_t addrLen = sizeof(clntAddr);
+        getpeername(connfd, (struct sockaddr*)&clntAddr, &addrLen);
+        cout << "uring " << id << " 新连接: connfd = " << connfd << endl;
+    #endif
+
+    HttpConn* conn = newConn(connfd);
+    conn->init(connfd, clntAddr, this, tls);
+    heapTimer.add(connfd, CONN_TIMEOUT, std::bind(cb_func, conn));
+
+    armRead(connfd);
+}
+
+void UringReactor::dealRecv(int fd, io_uring_cqe* cqe)
+{
+    int len = cqe->res;
+    if(len == -ENOBUFS)
+    {
+        /* 缓冲区暂时用完了，重新提交 */
+        submitRecv(fd);
+        return;
+    }
+
+    /* 套接字是非阻塞的，可能直接返回 EAGAIN，等可读后再读 */
+    if(len == -EAGAIN)
+    {
+        submitPoll(fd, false);
+        return;
+    }
+
+    if(len <= 0)
+    {
+        // 客户端关闭连接或出错
+        heapTimer.doWork(fd);
+        return;
+    }
+
+    unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    bool ok = users[fd]->appendRead(ring.getBuf(bid), len);
+    ring.recycleBuf(bid);
+
+    if(!ok)
+    {
+        heapTimer.doWork(fd);
+        return;
+    }
+
+    afterRead(fd);
+}
+
+void UringReactor::afterRead(int fd)
+{
+    HttpConn* conn = users[fd];
+
+    // 调整定时器：交给线程池之后，getTimeout 读的状态可能正在被工作线程修改
+    heapTimer.adjust(fd, conn->getTimeout());
+
+    if(conn->isWebSocket())
+    {
+        /* WebSocket 的帧直接在本线程中处理；recv 一直保持在内核中，send 和它并行 */
+        bool sending = conn->getBytesToSend() > 0;
+        conn->processWs();
+        if(!sending && conn->getBytesToSend() > 0)
+        {
+            armWrite(fd);
+        }
+        armRead(fd);
+    }
+    else
+    {
+        // 线程池中加入任务
+        queueConn(conn, fd);
+    }
+}
+
+void UringReactor::dealPollIn(int fd, io_uring_cqe* cqe)
+{
+    HttpConn* conn = users[fd];
+    if(cqe->res < 0 || (!conn->isUploading() && (cqe->res & (POLLHUP | POLLERR))))
+    {
+        heapTimer.doWork(fd);
+        return;
+    }
+
+    /* 对端关闭时 splice 返回 0，由工作线程删除临时文件；握手也在工作线程中进行 */
+    if(conn->isUploading() || conn->isHandshaking())
+    {
+        heapTimer.adjust(fd, conn->getTimeout());
+        queueConn(conn, fd);
+        return;
+    }
+
+    /* recv 返回 EAGAIN 之后等到了可读，重新提交 recv */
+    if(!conn->needPollRead())
+    {
+        submitRecv(fd);
+        return;
+    }
+
+    /* 用户空间解密的 TLS 连接：由 OpenSSL 读出明文，之后和 recv 完成一样处理 */
+    if(!conn->readFromClnt())
+    {
+        heapTimer.doWork(fd);
+        return;
+    }
+    afterRead(fd);
+}
+
+void UringReactor::dealPollOut(int fd, io_uring_cqe* cqe)
+{
+    HttpConn* conn = users[fd];
+    if(cqe->res < 0 || (cqe->res & POLLERR))
+    {
+        heapTimer.doWork(fd);
+        return;
+    }
+
+    if(conn->isHandshaking())
+    {
+        heapTimer.adjust(fd, conn->getTimeout());
+        queueConn(conn, fd);
+        return;
+    }
+
+    /* 发送方向已经卸载到内核，send/splice 返回 EAGAIN 之后重新提交 */
+    if(!conn->needPollWrite())
+    {
+        submitSend(fd);
+        return;
+    }
+
+    /* 和 epoll 后端一样在本线程中写，没写完时 writeToClnt 会再次等待可写 */
+    if(!conn->writeToClnt())
+    {
+        heapTimer.doWork(fd);
+        return;
+    }
+
+    heapTimer.adjust(fd, conn->getTimeout());
+    if(conn->hasPendingRequest())
+    {
+        queueConn(conn, fd);
+    }
+}
+
+void UringReactor::dealSpliceIn(int fd, io_uring_cqe* cqe)
+{
+    int len = cqe->res;
+    if(len <= 0)
+    {
+        users[fd]->writeDone();
+        heapTimer.doWork(fd);
+        return;
+    }
+
+    users[fd]->pipeBytes += len;
+    submitSplice(fd);
+}
+
+void UringReactor::dealSend(int fd, io_uring_cqe* cqe, bool splice)
+{
+    int len = cqe->res;
+    if(len == -EAGAIN)
+    {
+        /* 非阻塞的套接字发送缓冲区满了，等可写后重新提交 */
+        submitPoll(fd, true);
+        return;
+    }
+
+    if(len < 0 || (splice && len == 0))
+    {
+        users[fd]->writeDone();
+        heapTimer.doWork(fd);
+        return;
+    }
+
+    if(splice)
+    {
+        users[fd]->pipeBytes -= len;
+    }
+    users[fd]->updateIov(len);
+    if(users[fd]->getBytesToSend() > 0)
+    {
+        /* 没写完，继续发送剩下的部分 */
+        armWrite(fd);
+        return;
+    }
+
+    if(users[fd]->writeDone())
+    {
+        heapTimer.adjust(fd, users[fd]->getTimeout());
+
+        // WebSocket 发送队列中的帧接着发送；流水线中剩下的请求直接交给线程池，否则继续接收
+        if(users[fd]->getBytesToSend() > 0)
+        {
+            armWrite(fd);
+            /* WebSocket 连接发送时也保持 recv（已经在内核中时不会重复提交） */
+            if(users[fd]->isWebSocket())
+            {
+                armRead(fd);
+            }
+        }
+        else if(users[fd]->hasPendingRequest())
+        {
+            queueConn(users[fd], fd);
+        }
+        else
+        {
+            armRead(fd);
+        }
+    }
+    else
+    {
+        heapTimer.doWork(fd);
+    }
+}
+
+void UringReactor::handleCqe(io_uring_cqe* cqe)
+{
+    OP_TYPE op = (OP_TYPE)(cqe->user_data >> 56);
+    uint32_t gen = (cqe->user_data >> 32) & 0xffffff;
+    int fd = (int)(cqe->user_data & 0xffffffff);
+
+    switch(op)
+    {
+        case OP_ACCEPT:
+        {
+            dealAccept(cqe);
+            break;
+        }
+
+        case OP_RECV:
+        case OP_SEND:
+        case OP_SPLICE_IN:
+        case OP_SPLICE_OUT:
+        case OP_POLL_IN:
+        case OP_POLL_OUT:
+        {
+            /* 连接已经关闭（fd 可能被复用），丢弃这个事件 */
+            if(gen != (connGen[fd] & 0xffffff))
+            {
+                if(cqe->flags & IORING_CQE_F_BUFFER)
+                {
+                    ring.recycleBuf(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                }
+                break;
+            }
+
+            if(op == OP_RECV)
+            {
+                recvArmed[fd] = 0;
+                dealRecv(fd, cqe);
+            }
+            else if(op == OP_POLL_IN)
+            {
+                recvArmed[fd] = 0;
+                dealPollIn(fd, cqe);
+            }
+            else if(op == OP_POLL_OUT)
+            {
+                dealPollOut(fd, cqe);
+            }
+            else if(op == OP_SPLICE_IN)
+            {
+                dealSpliceIn(fd, cqe);
+            }
+            else
+            {
+                dealSend(fd, cqe, op == OP_SPLICE_OUT);
+            }
+            break;
+        }
+
+        case OP_WAKEUP:
+        {
+            if(!stopServer)
+            {
+                submitWakeup();
+            }
+            break;
+        }
+
+        case OP_SIGNAL:
+        {
+            if(cqe->res == sizeof(sigInfo))
+            {
+                onSignal(sigInfo.ssi_signo);
+            }
+
+            if(!stopServer)
+            {
+                submitSignal();
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void UringReactor::dealEvent(int fd, int ev)
+{
+    /* 投递期间连接可能已经超时关闭 */
+    if(ev != 0 && !getConn(fd))
+    {
+        return;
+    }
+
+    if(ev & EPOLLIN)
+    {
+        armRead(fd);
+    }
+    else if(ev & EPOLLOUT)
+    {
+        /* 握手时 OpenSSL 有数据要写 */
+        if(users[fd]->isHandshaking() || users[fd]->getBytesToSend() > 0)
+        {
+            armWrite(fd);
+        }
+    }
+    else
+    {
+        /* 关闭连接，之后到达的完成事件都作废 */
+        ++connGen[fd];
+        recvArmed[fd] = 0;
+        connSlab.put(detachConn(fd));
+        submitClose(fd);
+    }
+}
+
+void UringReactor::dealPosted()
+{
+    {
+        std::lock_guard<std::mutex> locker(postMutex);
+        dealQueue.swap(postQueue);
+    }
+
+    for(auto& item : dealQueue)
+    {
+        dealEvent(item.fd, item.ev);
+    }
+    dealQueue.clear();
+}
+
+void UringReactor::loop()
+{
+    loopThread = std::this_thread::get_id();
+
+    submitAccept(listenFd);
+    if(tlsListenFd != -1)
+    {
+        submitAccept(tlsListenFd);
+    }
+    submitWakeup();
+    if(signalFd != -1)
+    {
+        submitSignal();
+    }
+
+    while(!stopServer)
+    {
+        /* 暂停 accept 或排空期间需要定期检查 */
+        int timeout = heapTimer.getNextTick();
+        int check = (draining ? DRAIN_CHECK_MS : (acceptPaused ? ACCEPT_PAUSE_MS : -1));
+        if(check >= 0 && (timeout < 0 || timeout > check))
+        {
+            timeout = check;
+        }
+
+        int ret = ring.submitAndWait(timeout);
+        if(ret < 0)
+        {
+            #ifdef debug
+                cout << "io_uring_enter failed: " << strerror(errno) << endl;
+            #endif
+            break;
+        }
+
+        io_uring_cqe* cqe = nullptr;
+        while((cqe = ring.peekCqe()) != nullptr)
+        {
+            handleCqe(cqe);
+            ring.cqeSeen();
+        }
+
+        dealPosted();
+        runTasks();
+
+        if(acceptPaused && accepting && canResume())
+        {
+            acceptPaused = false;
+            if(!acceptArmed)
+            {
+                submitAccept(listenFd);
+            }
+            if(tlsListenFd != -1 && !tlsAcceptArmed)
+            {
+                submitAccept(tlsListenFd);
+            }
+        }
+
+        /* 平滑升级：连接都处理完了就退出 */
+        if(checkDrain())
+        {
+            break;
+        }
+    }
+}
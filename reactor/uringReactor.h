@@ -0,0 +1,117 @@
+/**
+ * UringReactor: 基于 io_uring 的事件循环
+ *  multishot accept 接收新连接，recv 使用内核提供的缓冲区，
+ *  回复用 writev 发送，关闭也交给 io_uring，尽量减少每个请求的系统调用。
+ *  HttpConn 的状态机不变，工作线程通过 modConn 把结果投递回本循环。
+ */
+#ifndef URINGREACTOR_H
+#define URINGREACTOR_H
+
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <vector>
+#include <mutex>
+#include <thread>
+
+#include "eventLoop.h"
+#include "uring.h"
+
+class UringReactor : public EventLoop
+{
+public:
+    UringReactor(int id, HttpConn** users, ThreadPool<HttpConn>* pool);
+    ~UringReactor();
+
+    bool init(const Config& config, int inheritFd, int inheritTlsFd) override;
+    void loop() override;
+
+    void modConn(int sockfd, int ev) override;
+    void closeConn(int sockfd) override;
+
+protected:
+    void wakeup() override;
+    void stopAccept() override;
+
+private:
+    /* 完成事件的类型，编码在 user_data 的高位 */
+    enum OP_TYPE
+    {
+        OP_ACCEPT = 1,
+        OP_RECV,
+        OP_SEND,
+        OP_CLOSE,
+        OP_WAKEUP,
+        OP_SIGNAL,
+        OP_SPLICE_IN,       // 文件 -> 管道
+        OP_SPLICE_OUT,      // 管道 -> 套接字，按发送处理
+        OP_POLL_IN,         // 等待可读：上传的消息体由工作线程 splice，TLS 由 OpenSSL 读
+        OP_POLL_OUT         // 等待可写：用户空间加密的 TLS 连接由 OpenSSL 写
+    };
+
+    /* 工作线程投递过来的事件 */
+    struct PostEvent
+    {
+        int fd;
+        int ev;         // EPOLLIN / EPOLLOUT / 0 表示关闭
+    };
+
+    static uint64_t makeData(OP_TYPE op, int fd, uint32_t gen);
+
+    void submitAccept(int fd);
+    void cancelAccept(int fd);
+    void submitRecv(int fd);
+    void submitPoll(int fd, bool out);
+    void submitSend(int fd);
+    void submitSplice(int fd);
+    void submitClose(int fd);
+    void submitWakeup();
+    void submitSignal();
+
+    /* 等待读写：内核能直接收发明文时用 recv/send，否则只等待就绪，由 OpenSSL 或工作线程读写 */
+    void armRead(int fd);
+    void armWrite(int fd);
+
+    void handleCqe(io_uring_cqe* cqe);
+    void dealAccept(io_uring_cqe* cqe);
+    void dealRecv(int fd, io_uring_cqe* cqe);
+    /* 读到数据之后：WebSocket 在本线程处理，其余交给线程池 */
+    void afterRead(int fd);
+    void dealSend(int fd, io_uring_cqe* cqe, bool splice);
+    void dealSpliceIn(int fd, io_uring_cqe* cqe);
+    void dealPollIn(int fd, io_uring_cqe* cqe);
+    void dealPollOut(int fd, io_uring_cqe* cqe);
+
+    /* 处理工作线程投递的事件 */
+    void dealPosted();
+    void dealEvent(int fd, int ev);
+
+private:
+    Uring ring;
+
+    int wakeupFd;                   // 工作线程/stop 唤醒
+    uint64_t wakeupBuf;
+    int signalFd;                   // 只有 0 号循环持有
+    signalfd_siginfo sigInfo;
+
+    std::thread::id loopThread;
+
+    /* HTTP 和 HTTPS 监听套接字的 multishot accept 是否还在内核中 */
+    bool acceptArmed;
+    bool tlsAcceptArmed;
+
+    /* 每个 fd 的代数，连接关闭后加一，用于丢弃过期的完成事件 */
+    std::vector<uint32_t> connGen;
+
+    /**
+     * 每个 fd 是否有 recv（或等待可读的 poll）在内核中：
+     * WebSocket 连接发送广播时 recv 不取消，send 完成后不能重复提交
+     */
+    std::vector<char> recvArmed;
+
+    std::mutex postMutex;
+    std::vector<PostEvent> postQueue;
+    std::vector<PostEvent> dealQueue;
+};
+
+#endif
@@ -0,0 +1,309 @@
+#include "router.h"
+
+#include <iostream>
+
+using std::string;
+using std::string_view;
+
+Router::Router()
+{
+}
+
+Router* Router::getInstance()
+{
+    static Router router;
+    return &router;
+}
+
+void Router::init(const string& root)
+{
+    rootDir = root;
+}
+
+Router::Node* Router::insert(HttpConn::METHOD method, string_view path)
+{
+    Node* node = &roots[method];
+    while(!path.empty())
+    {
+        Node* next = nullptr;
+        for(auto& child : node->children)
+        {
+            if(child->prefix[0] == path[0])
+            {
+                next = child.get();
+                break;
+            }
+        }
+
+        /* 没有相同首字符的子节点，剩下的路径整段作为新节点 */
+        if(!next)
+        {
+            node->children.emplace_back(new Node());
+            node->children.back()->prefix = string(path);
+            return node->children.back().get();
+        }
+
+        size_t common = 0;
+        while(common < next->prefix.size() && common < path.size() && next->prefix[common] == path[common])
+        {
+            ++common;
+        }
+
+        /* 只有一部分相同，把子节点拆成两段 */
+        if(common < next->prefix.size())
+        {
+            std::unique_ptr<Node> mid(new Node());
+            mid->prefix = next->prefix.substr(0, common);
+            next->prefix.erase(0, common);
+
+            for(auto& child : node->children)
+            {
+                if(child.get() == next)
+                {
+                    mid->children.push_back(std::move(child));
+                    child = std::move(mid);
+                    next = child.get();
+                    break;
+                }
+            }
+        }
+
+        path.remove_prefix(common);
+        node = next;
+    }
+
+    return node;
+}
+
+void Router::addRoute(HttpConn::METHOD method, string_view path, Route route, bool isMount)
+{
+    Node* node = insert(method, path);
+    int& slot = (isMount ? node->mount : node->route);
+    if(slot != -1)
+    {
+        /* 重复注册时后注册的生效 */
+        routes[slot] = std::move(route);
+        return;
+    }
+
+    routes.push_back(std::move(route));
+    slot = routes.size() - 1;
+}
+
+void Router::addHandler(HttpConn::METHOD method, string_view path, RouteHandler handler)
+{
+    addRoute(method, path, {ROUTE_HANDLER, std::move(handler), string()}, false);
+}
+
+void Router::addFile(HttpConn::METHOD method, string_view path, string_view file)
+{
+    addRoute(method, path, {ROUTE_FILE, nullptr, string(file)}, false);
+}
+
+void Router::mount(HttpConn::METHOD method, string_view prefix, const string& dir)
+{
+    /* 前缀统一不带结尾的 '/'，"/" 挂载在根节点上 */
+    while(!prefix.empty() && prefix.back() == '/')
+    {
+        prefix.remove_suffix(1);
+    }
+    addRoute(method, prefix, {ROUTE_MOUNT, nullptr, dir}, true);
+}
+
+void Router::addWebSocket(string_view path, WsHandler handler)
+{
+    addRoute(HttpConn::GET, path, {ROUTE_WEBSOCKET, nullptr, string(), std::move(handler)}, false);
+}
+
+void Router::addStream(HttpConn::METHOD method, string_view path, string_view contentType, StreamHandler handler)
+{
+    addRoute(method, path, {ROUTE_STREAM, nullptr, string(contentType), nullptr, std::move(handler)}, false);
+}
+
+void Router::addUpload(string_view prefix, const string& dir, size_t maxSize)
+{
+    while(!prefix.empty() && prefix.back() == '/')
+    {
+        prefix.remove_suffix(1);
+    }
+    addRoute(HttpConn::POST, prefix, {ROUTE_UPLOAD, nullptr, dir, nullptr, nullptr, maxSize}, true);
+}
+
+/* 路径中有 ".." 段时不允许映射到目录，防止访问资源目录之外的文件 */
+static bool hasDotDot(string_view path)
+{
+    for(size_t pos = path.find(".."); pos != string_view::npos; pos = path.find("..", pos + 2))
+    {
+        bool begin = (pos == 0 || path[pos - 1] == '/');
+        bool end = (pos + 2 == path.size() || path[pos + 2] == '/');
+        if(begin && end)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+const Router::Node* Router::match(HttpConn::METHOD method, string_view path, string_view& remain,
+                                  const Route** mountRoute, size_t* mountLen)
+{
+    const Node* node = &roots[method];
+    remain = path;
+
+    while(true)
+    {
+        /* 挂载点只在整段路径处匹配："/static" 匹配 "/static/a"，不匹配 "/staticx" */
+        if(node->mount != -1 && (remain.empty() || remain[0] == '/'))
+        {
+            *mountRoute = &routes[node->mount];
+            *mountLen = path.size() - remain.size();
+        }
+
+        if(remain.empty())
+        {
+            break;
+        }
+
+        const Node* next = nullptr;
+        for(const auto& child : node->children)
+        {
+            if(child->prefix[0] == remain[0])
+            {
+                next = child.get();
+                break;
+            }
+        }
+        if(!next || remain.compare(0, next->prefix.size(), next->prefix) != 0)
+        {
+            break;
+        }
+
+        remain.remove_prefix(next->prefix.size());
+        node = next;
+    }
+
+    return node;
+}
+
+bool Router::dispatch(HttpConn* conn, HttpConn::METHOD method, string_view path, string& filePath)
+{
+    const Route* mountRoute = nullptr;
+    size_t mountLen = 0;
+    string_view remain;
+    const Node* node = match(method, path, remain, &mountRoute, &mountLen);
+
+    /* 精确匹配优先于挂载 */
+    if(remain.empty() && node->route != -1)
+    {
+        const Route& route = routes[node->route];
+        /* WebSocket 路由不回复普通请求 */
+        if(route.type == ROUTE_WEBSOCKET)
+        {
+            return false;
+        }
+
+        /* 流式回复没有文件，生成函数交给连接 */
+        if(route.type == ROUTE_STREAM)
+        {
+            StreamProducer producer = route.streamHandler(conn);
+            if(!producer)
+            {
+                return false;
+            }
+            conn->startStream(std::move(producer), route.target);
+            return true;
+        }
+
+        string_view file = route.target;
+        if(route.type == ROUTE_HANDLER)
+        {
+            file = route.handler(conn);
+            if(file.empty())
+            {
+                return false;
+            }
+        }
+
+        filePath.assign(rootDir);
+        filePath.append(file.data(), file.size());
+        return true;
+    }
+
+    /* 上传路由只接收消息体，在读完请求头时就已经处理了（HTTP/2 不支持上传） */
+    if(mountRoute && mountRoute->type != ROUTE_UPLOAD)
+    {
+        string_view rest = path.substr(mountLen);
+        if(hasDotDot(rest))
+        {
+            return false;
+        }
+
+        filePath.assign(mountRoute->target);
+        filePath.append(rest.data(), rest.size());
+        return true;
+    }
+
+    return false;
+}
+
+string_view Router::allowedMethods(string_view path)
+{
+    /* 下标是能匹配的方法的位掩码：GET 为 1，POST 为 2 */
+    static_assert(METHOD_NUM == 2, "allowedMethods only knows GET and POST");
+    static const string_view names[] = {"", "GET", "POST", "GET, POST"};
+
+    int mask = 0;
+    for(int method = 0; method < METHOD_NUM; ++method)
+    {
+        const Route* mountRoute = nullptr;
+        size_t mountLen = 0;
+        string_view remain;
+        const Node* node = match((HttpConn::METHOD)method, path, remain, &mountRoute, &mountLen);
+        if((remain.empty() && node->route != -1) || mountRoute)
+        {
+            mask |= 1 << method;
+        }
+    }
+    return names[mask];
+}
+
+const WsHandler* Router::findWebSocket(string_view path)
+{
+    const Route* mountRoute = nullptr;
+    size_t mountLen = 0;
+    string_view remain;
+    const Node* node = match(HttpConn::GET, path, remain, &mountRoute, &mountLen);
+
+    if(remain.empty() && node->route != -1 && routes[node->route].type == ROUTE_WEBSOCKET)
+    {
+        return &routes[node->route].wsHandler;
+    }
+    return nullptr;
+}
+
+bool Router::findUpload(string_view path, string& filePath, size_t& maxSize)
+{
+    const Route* mountRoute = nullptr;
+    size_t mountLen = 0;
+    string_view remain;
+    const Node* node = match(HttpConn::POST, path, remain, &mountRoute, &mountLen);
+
+    /* 精确匹配的路由优先 */
+    if((remain.empty() && node->route != -1) || !mountRoute || mountRoute->type != ROUTE_UPLOAD)
+    {
+        return false;
+    }
+
+    /* 文件名只能是一段，不能以 '.' 开头：不会越出目录，也不会和上传中的临时文件重名 */
+    filePath.clear();
+    maxSize = mountRoute->maxSize;
+    string_view name = path.substr(mountLen);
+    if(name.size() < 2 || name[0] != '/' || name[1] == '.' || name.find('/', 1) != string_view::npos)
+    {
+        return true;
+    }
+
+    filePath.assign(mountRoute->target);
+    filePath.append(name.data(), name.size());
+    return true;
+}
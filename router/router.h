@@ -0,0 +1,111 @@
+/**
+ * Router: 按请求方法和路径分发请求
+ *  每种方法一棵路径压缩的前缀树（radix trie），启动时注册，之后只读，不需要加锁；
+ *  查找按路径逐段比较，代价与路径长度成正比，不分配内存。
+ *  六种路由：
+ *   处理函数  —— 精确匹配，由回调决定返回哪个文件（登录、注册）
+ *   固定文件  —— 精确匹配，返回资源目录下的某个文件
+ *   静态挂载  —— 前缀匹配，前缀之后的部分映射到某个目录下，最长的前缀优先
+ *   WebSocket —— 精确匹配的 GET，只接受升级请求，消息交给回调
+ *   流式回复  —— 精确匹配，回调返回生成函数，输出边生成边分块发送
+ *   上传      —— 前缀匹配的 POST，前缀之后的一段是文件名，消息体直接写入某个目录
+ */
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "../http/httpConn.h"
+
+/* 处理函数返回要发送的文件（相对资源目录，如 "/welcome.html"），返回空表示 404 */
+typedef std::function<std::string_view(HttpConn* conn)> RouteHandler;
+
+/* 流式回复：每个请求调用一次，返回这个请求的生成函数（可以带自己的状态），返回空表示 404 */
+typedef std::function<StreamProducer(HttpConn* conn)> StreamHandler;
+
+class Router
+{
+public:
+    static Router* getInstance();
+
+    /* 资源目录，固定文件和处理函数返回的文件都在这里 */
+    void init(const std::string& root);
+
+    void addHandler(HttpConn::METHOD method, std::string_view path, RouteHandler handler);
+    void addFile(HttpConn::METHOD method, std::string_view path, std::string_view file);
+    void mount(HttpConn::METHOD method, std::string_view prefix, const std::string& dir);
+    void addWebSocket(std::string_view path, WsHandler handler);
+    void addStream(HttpConn::METHOD method, std::string_view path, std::string_view contentType, StreamHandler handler);
+    void addUpload(std::string_view prefix, const std::string& dir, size_t maxSize);
+
+    /* 找到路由并得到要发送的文件的完整路径，没有匹配的路由返回 false */
+    bool dispatch(HttpConn* conn, HttpConn::METHOD method, std::string_view path, std::string& filePath);
+
+    /* 能匹配 path 的方法，作为 405 回复的 Allow（如 "GET, POST"），都不能匹配时为空 */
+    std::string_view allowedMethods(std::string_view path);
+
+    /* path 注册的 WebSocket 回调，没有时返回空 */
+    const WsHandler* findWebSocket(std::string_view path);
+
+    /**
+     * POST path 匹配到上传路由时返回 true：要保存的完整路径放入 filePath（文件名不合法时为空），
+     * 大小上限放入 maxSize
+     */
+    bool findUpload(std::string_view path, std::string& filePath, size_t& maxSize);
+
+private:
+    Router();
+
+    enum ROUTE_TYPE
+    {
+        ROUTE_HANDLER,
+        ROUTE_FILE,
+        ROUTE_MOUNT,
+        ROUTE_WEBSOCKET,
+        ROUTE_STREAM,
+        ROUTE_UPLOAD
+    };
+
+    struct Route
+    {
+        ROUTE_TYPE type;
+        RouteHandler handler;
+        std::string target;     // 固定文件（相对资源目录）、挂载（上传）的目录或流式回复的内容类型
+        WsHandler wsHandler;
+        StreamHandler streamHandler;
+        size_t maxSize;         // 上传文件的大小上限
+    };
+
+    struct Node
+    {
+        std::string prefix;     // 从父节点到这里的一段路径
+        std::vector<std::unique_ptr<Node>> children;    // 首字符各不相同
+        int route;              // 精确匹配的路由，-1 表示没有
+        int mount;              // 挂载在这里的路由，-1 表示没有
+
+        Node() : route(-1), mount(-1) {}
+    };
+
+    /* 找到（必要时创建）path 对应的节点 */
+    Node* insert(HttpConn::METHOD method, std::string_view path);
+    void addRoute(HttpConn::METHOD method, std::string_view path, Route route, bool isMount);
+
+    /**
+     * 沿前缀树逐段匹配 path，返回能匹配到的最深节点，remain 是没有匹配的部分；
+     * 经过的最长挂载点放入 mountRoute，前缀长度放入 mountLen
+     */
+    const Node* match(HttpConn::METHOD method, std::string_view path, std::string_view& remain,
+                      const Route** mountRoute, size_t* mountLen);
+
+private:
+    static const int METHOD_NUM = HttpConn::POST + 1;
+
+    Node roots[METHOD_NUM];
+    std::vector<Route> routes;
+    std::string rootDir;
+};
+
+#endif
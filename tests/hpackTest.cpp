@@ -0,0 +1,129 @@
+/**
+ * HpackDecoder 的测试：正常的头部块、字段个数上限，
+ * 以及反复引用动态表中的大项展开出几百 MB 的头部块（HPACK 炸弹）
+ */
+#include "../http/hpack.h"
+#include "../constance.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++failures; \
+        } \
+    } while(0)
+
+/* HPACK 整数编码（RFC 7541 5.1） */
+static void putInt(std::string& out, uint8_t flags, int prefix, size_t value)
+{
+    size_t max = (1u << prefix) - 1;
+    if(value < max)
+    {
+        out.push_back(flags | value);
+        return;
+    }
+    out.push_back(flags | max);
+    value -= max;
+    while(value >= 128)
+    {
+        out.push_back((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(value);
+}
+
+/* 不用 Huffman 的字符串 */
+static void putString(std::string& out, const std::string& str)
+{
+    putInt(out, 0, 7, str.size());
+    out += str;
+}
+
+static bool decode(HpackDecoder& decoder, const std::string& block, std::vector<HpackHeader>& headers)
+{
+    return decoder.decode(reinterpret_cast<const uint8_t*>(block.data()), block.size(), headers);
+}
+
+/* RFC 7541 C.3.1：第一个请求 */
+static void testRequest()
+{
+    HpackDecoder decoder(HTTP2_HEADER_TABLE_SIZE, HTTP2_MAX_HEADER_LIST, HTTP2_MAX_HEADER_FIELDS);
+    std::string block("\x82\x86\x84\x41\x0f" "www.example.com", 20);
+
+    std::vector<HpackHeader> headers;
+    CHECK(decode(decoder, block, headers));
+    CHECK(headers.size() == 4);
+    CHECK(headers.size() == 4 && headers[0] == HpackHeader(":method", "GET"));
+    CHECK(headers.size() == 4 && headers[3] == HpackHeader(":authority", "www.example.com"));
+}
+
+/* 一个约 4KB 的字面值加入动态表，后面全是引用它的一个字节 */
+static void testIndexedBomb()
+{
+    HpackDecoder decoder(HTTP2_HEADER_TABLE_SIZE, HTTP2_MAX_HEADER_LIST, HTTP2_MAX_HEADER_FIELDS);
+
+    std::string block;
+    block.push_back(0x40);
+    putString(block, "x-bomb");
+    putString(block, std::string(4000, 'a'));
+    while(block.size() < HTTP2_MAX_HEADER_BLOCK)
+    {
+        /* 索引 62：动态表的第一项 */
+        block.push_back(0x80 | 62);
+    }
+
+    std::vector<HpackHeader> headers;
+    CHECK(!decode(decoder, block, headers));
+
+    /* 超过上限时马上停止，展开的内容不超过上限 */
+    size_t listSize = 0;
+    for(const HpackHeader& header : headers)
+    {
+        listSize += header.first.size() + header.second.size() + 32;
+    }
+    CHECK(listSize <= HTTP2_MAX_HEADER_LIST);
+}
+
+/* 很小的字段也不能超过个数上限 */
+static void testFieldCount()
+{
+    std::string block;
+    for(size_t i = 0; i < HTTP2_MAX_HEADER_FIELDS; ++i)
+    {
+        block.push_back(0x82);
+    }
+
+    HpackDecoder decoder(HTTP2_HEADER_TABLE_SIZE, HTTP2_MAX_HEADER_LIST, HTTP2_MAX_HEADER_FIELDS);
+    std::vector<HpackHeader> headers;
+    CHECK(decode(decoder, block, headers));
+    CHECK(headers.size() == HTTP2_MAX_HEADER_FIELDS);
+
+    block.push_back(0x82);
+    HpackDecoder full(HTTP2_HEADER_TABLE_SIZE, HTTP2_MAX_HEADER_LIST, HTTP2_MAX_HEADER_FIELDS);
+    headers.clear();
+    CHECK(!decode(full, block, headers));
+    CHECK(headers.size() <= HTTP2_MAX_HEADER_FIELDS);
+}
+
+int main()
+{
+    testRequest();
+    testIndexedBomb();
+    testFieldCount();
+
+    if(failures)
+    {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("hpackTest ok\n");
+    return 0;
+}
@@ -0,0 +1,193 @@
+/**
+ * HttpConn 的持久连接：HTTP/1.1 没有 Connection 头部时默认保持连接，
+ * 流水线中的请求都要得到回复；Connection: close 和 HTTP/1.0 回复后关闭；
+ * 不支持的方法回复 405/501 之后连接照常处理下一个请求。
+ * 连接通过 socketpair 收发，事件循环只记录 modConn/closeConn 的调用
+ */
+#include "../http/httpConn.h"
+#include "../reactor/eventLoop.h"
+#include "../cache/fileCache.h"
+#include "../router/router.h"
+#include "../constance.h"
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <memory>
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do \
+    { \
+        if(!(cond)) \
+        { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++failures; \
+        } \
+    } while(0)
+
+static HttpConn* testUsers[MAX_FD];
+
+/* 不运行事件循环，只记录工作线程和发送时请求的事件 */
+class TestLoop : public EventLoop
+{
+public:
+    TestLoop() : EventLoop(0, testUsers, nullptr), lastEv(0), closed(false) {}
+
+    bool init(const Config&, int, int) override { return true; }
+    void loop() override {}
+    void modConn(int, int ev) override { lastEv = ev; }
+    void closeConn(int) override { closed = true; }
+
+    int lastEv;
+    bool closed;
+
+protected:
+    void wakeup() override {}
+    void stopAccept() override {}
+};
+
+static int countOf(const std::string& text, const std::string& word)
+{
+    int count = 0;
+    for(size_t pos = text.find(word); pos != std::string::npos; pos = text.find(word, pos + 1))
+    {
+        ++count;
+    }
+    return count;
+}
+
+/* 一次把 requests 全部发给连接，返回收到的回复；keepAlive 为发送完之后连接是否保持 */
+static std::string exchange(const std::string& requests, bool& keepAlive)
+{
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+    {
+        perror("socketpair");
+        exit(1);
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+
+    TestLoop loop;
+    std::unique_ptr<HttpConn> conn(new HttpConn());
+    sockaddr_in addr = {};
+    conn->init(fds[0], addr, &loop);
+
+    CHECK(write(fds[1], requests.data(), requests.size()) == (ssize_t)requests.size());
+    CHECK(conn->readFromClnt());
+
+    /* 和事件循环一样，交给线程池之前登记 */
+    conn->enterPool();
+    conn->process();
+    CHECK(loop.lastEv == EPOLLOUT);
+
+    keepAlive = conn->writeToClnt() && !loop.closed;
+
+    std::string responses;
+    char buf[4096];
+    ssize_t len;
+    while((len = read(fds[1], buf, sizeof(buf))) > 0)
+    {
+        responses.append(buf, len);
+    }
+
+    conn->closeConn();
+    close(fds[0]);
+    close(fds[1]);
+    return responses;
+}
+
+/* HTTP/1.1 流水线中的两个请求，都没有 Connection 头部 */
+static void testDefaultKeepAlive()
+{
+    std::string req = "GET / HTTP/1.1\r\nHost: test\r\n\r\n";
+    bool keepAlive = false;
+    std::string responses = exchange(req + req, keepAlive);
+
+    CHECK(countOf(responses, "HTTP/1.1 200 OK") == 2);
+    CHECK(countOf(responses, "Connection: keep-alive") == 2);
+    CHECK(keepAlive);
+}
+
+/* Connection: close 的请求回复后关闭，后面的请求不再处理 */
+static void testClose()
+{
+    std::string req = "GET / HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n";
+    bool keepAlive = true;
+    std::string responses = exchange(req + req, keepAlive);
+
+    CHECK(countOf(responses, "HTTP/1.1 200 OK") == 1);
+    CHECK(countOf(responses, "Connection: close") == 1);
+    CHECK(!keepAlive);
+}
+
+/* HTTP/1.0 默认关闭，Connection: keep-alive 时保持 */
+static void testHttp10()
+{
+    bool keepAlive = true;
+    std::string responses = exchange("GET / HTTP/1.0\r\n\r\n", keepAlive);
+    CHECK(countOf(responses, " 200 OK") == 1);
+    CHECK(!keepAlive);
+
+    responses = exchange("GET / HTTP/1.0\r\nConnection: keep-alive\r\n\r\n", keepAlive);
+    CHECK(countOf(responses, " 200 OK") == 1);
+    CHECK(keepAlive);
+}
+
+/* PUT 带消息体：路径有 GET 路由时 405，没有任何路由时 501，后面的 GET 不受影响 */
+static void testUnknownMethod()
+{
+    bool keepAlive = false;
+    std::string responses = exchange("PUT / HTTP/1.1\r\nHost: test\r\nContent-Length: 3\r\n\r\nabc"
+                                     "DELETE /missing HTTP/1.1\r\nHost: test\r\n\r\n"
+                                     "GET / HTTP/1.1\r\nHost: test\r\n\r\n", keepAlive);
+
+    CHECK(responses.compare(0, 31, "HTTP/1.1 405 Method Not Allowed") == 0);
+    CHECK(countOf(responses, "Allow: GET\r\n") == 1);
+    CHECK(countOf(responses, "HTTP/1.1 501 Not Implemented") == 1);
+    CHECK(countOf(responses, "HTTP/1.1 200 OK") == 1);
+    CHECK(keepAlive);
+}
+
+int main()
+{
+    /* 资源目录放一个首页，路由和 main.cpp 一样把 "/" 映射到它 */
+    char dir[] = "/tmp/keepAliveTestXXXXXX";
+    if(!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    rootPath = dir;
+    std::string index = rootPath + "/index.html";
+    FILE* fp = fopen(index.c_str(), "w");
+    fputs("<html>hello</html>\n", fp);
+    fclose(fp);
+
+    FileCache::getInstance()->init(rootPath, true, FILE_CACHE_MAX_BYTES, FILE_CACHE_MAX_ENTRIES);
+    Router* router = Router::getInstance();
+    router->init(rootPath);
+    router->addFile(HttpConn::GET, "/", "/index.html");
+
+    testDefaultKeepAlive();
+    testClose();
+    testHttp10();
+    testUnknownMethod();
+
+    unlink(index.c_str());
+    rmdir(dir);
+
+    if(failures)
+    {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("keepAliveTest ok\n");
+    return 0;
+}
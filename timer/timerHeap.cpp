@@ -14,10 +14,10 @@ void HeapTimer::shiftUp(size_t i)
 {
     assert(i >= 0 && i < m_heap.size());
 
-    size_t j = (i - 1) / 2;
-
-    while(j >= 0)
+    /* size_t 没有负数，到堆顶（i == 0）时必须停下 */
+    while(i > 0)
     {
+        size_t j = (i - 1) / 2;
         if(m_heap[j] < m_heap[i])
         {
             break;
@@ -25,7 +25,6 @@ void HeapTimer::shiftUp(size_t i)
 
         swapNode(i, j);
         i = j;
-        j = (i - 1) / 2;
     }
 
 }
@@ -179,4 +178,17 @@ int HeapTimer::getNextTick()
     }
 
     return res;
+}
+
+void HeapTimer::shrinkAll(int timeout)
+{
+    /* 所有定时器最多再等 timeout 毫秒，min 是单调的，堆的顺序不变 */
+    TimeStamp limit = Clock::now() + MS(timeout);
+    for(auto& node : m_heap)
+    {
+        if(limit < node.expires)
+        {
+            node.expires = limit;
+        }
+    }
 }
\ No newline at end of file
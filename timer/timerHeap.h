@@ -42,6 +42,7 @@ public:
     void tick();
     void pop();
     int getNextTick();
+    void shrinkAll(int timeout);
 
 private:
     void _del(size_t i);
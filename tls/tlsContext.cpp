@@ -0,0 +1,109 @@
+#include "tlsContext.h"
+#include "../constance.h"
+
+#include <openssl/err.h>
+#include <iostream>
+
+/* 服务器支持的协议，按优先级排列，格式为长度 + 名字 */
+static const unsigned char alpnProtos[] = "\x02h2\x08http/1.1";
+
+TlsContext::TlsContext()
+{
+    ctx = nullptr;
+}
+
+TlsContext::~TlsContext()
+{
+    if(ctx)
+    {
+        SSL_CTX_free(ctx);
+    }
+}
+
+TlsContext* TlsContext::getInstance()
+{
+    static TlsContext tlsContext;
+    return &tlsContext;
+}
+
+bool TlsContext::init(const std::string& certFile, const std::string& keyFile)
+{
+    ctx = SSL_CTX_new(TLS_server_method());
+    if(!ctx)
+    {
+        return false;
+    }
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    /**
+     * 握手后尽量启用 kTLS；不允许重协商。
+     * 用户空间加密时 SSL_write 可以只写一部分，重试时缓冲区地址可以变（由 iov 重新拼出来）；
+     * 空闲连接释放读写缓冲区
+     */
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                          SSL_MODE_RELEASE_BUFFERS);
+
+    if(SSL_CTX_use_certificate_chain_file(ctx, certFile.c_str()) != 1 ||
+       SSL_CTX_use_PrivateKey_file(ctx, keyFile.c_str(), SSL_FILETYPE_PEM) != 1 ||
+       SSL_CTX_check_private_key(ctx) != 1)
+    {
+        #ifdef debug
+            ERR_print_errors_fp(stderr);
+        #endif
+        SSL_CTX_free(ctx);
+        ctx = nullptr;
+        return false;
+    }
+
+    /**
+     * 会话恢复只用无状态票据：会话状态加密后交给客户端保存，所有 reactor 共用同一个 SSL_CTX，
+     * 不需要服务器端的会话缓存（也就没有缓存的锁）。票据密钥由 OpenSSL 随机生成，
+     * 平滑升级后新进程的密钥不同，旧票据失效，客户端做一次完整握手
+     */
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_timeout(ctx, TLS_SESSION_TIMEOUT);
+    SSL_CTX_set_num_tickets(ctx, TLS_NUM_TICKETS);
+
+    SSL_CTX_set_alpn_select_cb(ctx, selectAlpn, nullptr);
+
+    return true;
+}
+
+SSL* TlsContext::newSsl(int sockfd)
+{
+    if(!ctx)
+    {
+        return nullptr;
+    }
+
+    SSL* ssl = SSL_new(ctx);
+    if(!ssl)
+    {
+        return nullptr;
+    }
+
+    if(SSL_set_fd(ssl, sockfd) != 1)
+    {
+        SSL_free(ssl);
+        return nullptr;
+    }
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+int TlsContext::selectAlpn(SSL* ssl, const unsigned char** out, unsigned char* outLen,
+                           const unsigned char* in, unsigned int inLen, void* arg)
+{
+    /* 按服务器的优先级选择；没有共同的协议时不使用 ALPN，按 HTTP/1.1 处理 */
+    unsigned char* selected = nullptr;
+    if(SSL_select_next_proto(&selected, outLen, alpnProtos, sizeof(alpnProtos) - 1, in, inLen)
+       != OPENSSL_NPN_NEGOTIATED)
+    {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
@@ -0,0 +1,42 @@
+/**
+ * TlsContext: HTTPS 监听端口共用的 SSL_CTX
+ *  握手由 OpenSSL 完成，之后尽量把记录层交给内核（kTLS，SSL_OP_ENABLE_KTLS）：
+ *  发送方向卸载后 writev/sendfile/splice 照常使用，加密在内核中完成，文件内容不经过用户空间；
+ *  接收方向卸载后 recv 直接得到明文。内核或 OpenSSL 不支持的方向由 OpenSSL 在用户空间加解密。
+ *  会话恢复使用无状态票据，票据密钥在进程内有效，重连时不需要完整握手。
+ *  ALPN 优先选择 h2，连接以 HTTP/2 前言开头，按 prior knowledge 处理。
+ *
+ *  本机测试可以用自签名证书：
+ *   openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:P-256 -nodes -days 365 \
+ *       -subj /CN=localhost -keyout key.pem -out cert.pem
+ */
+#ifndef TLSCONTEXT_H
+#define TLSCONTEXT_H
+
+#include <string>
+#include <openssl/ssl.h>
+
+class TlsContext
+{
+public:
+    static TlsContext* getInstance();
+
+    /* 加载证书链和私钥，失败返回 false */
+    bool init(const std::string& certFile, const std::string& keyFile);
+
+    /* 为新连接创建 SSL 对象（服务器端），失败返回空 */
+    SSL* newSsl(int sockfd);
+
+private:
+    TlsContext();
+    ~TlsContext();
+
+    /* ALPN：客户端支持 h2 时选择 h2，否则 http/1.1 */
+    static int selectAlpn(SSL* ssl, const unsigned char** out, unsigned char* outLen,
+                          const unsigned char* in, unsigned int inLen, void* arg);
+
+private:
+    SSL_CTX* ctx;
+};
+
+#endif
@@ -0,0 +1,228 @@
+#include "upgrade.h"
+#include "../reactor/eventLoop.h"
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+
+extern char** environ;
+
+/* 传递通道在新进程中的 fd 号 */
+static const int UPGRADE_CHANNEL_FD = 3;
+static const char* UPGRADE_ENV = "WEBSERVER_UPGRADE_FD";
+
+std::string Upgrade::exePath;
+std::vector<std::string> Upgrade::args;
+int Upgrade::readyFd = -1;
+std::atomic_bool Upgrade::inProgress(false);
+std::thread Upgrade::waitThread;
+
+void Upgrade::init(int argc, char** argv)
+{
+    /* 用启动时的路径，部署时替换的是这个路径上的文件 */
+    char path[4096];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if(len > 0)
+    {
+        path[len] = '\0';
+        exePath = path;
+    }
+
+    for(int i = 0; i < argc; ++i)
+    {
+        args.push_back(argv[i]);
+    }
+}
+
+std::vector<int> Upgrade::inheritFds()
+{
+    std::vector<int> fds;
+
+    const char* env = getenv(UPGRADE_ENV);
+    if(!env)
+    {
+        return fds;
+    }
+    int channel = atoi(env);
+    unsetenv(UPGRADE_ENV);
+
+    char data = 0;
+    iovec iov;
+    iov.iov_base = &data;
+    iov.iov_len = 1;
+
+    /* 每个 reactor 最多有 HTTP 和 HTTPS 两个监听套接字 */
+    char control[CMSG_SPACE(sizeof(int) * MAX_REACTOR * 2)];
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if(recvmsg(channel, &msg, MSG_CMSG_CLOEXEC) <= 0)
+    {
+        close(channel);
+        return fds;
+    }
+
+    for(cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int* p = reinterpret_cast<int*>(CMSG_DATA(cmsg));
+            fds.assign(p, p + n);
+        }
+    }
+
+    readyFd = channel;
+    return fds;
+}
+
+void Upgrade::notifyReady()
+{
+    if(readyFd == -1)
+    {
+        return;
+    }
+
+    char ok = 1;
+    ssize_t ret = write(readyFd, &ok, 1);
+    (void)ret;
+    close(readyFd);
+    readyFd = -1;
+}
+
+bool Upgrade::start(const std::vector<int>& listenFds)
+{
+    bool expected = false;
+    if(exePath.empty() || listenFds.empty() || !inProgress.compare_exchange_strong(expected, true))
+    {
+        return false;
+    }
+
+    /* 上一次失败的升级留下的线程 */
+    join();
+
+    int sv[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+    {
+        inProgress = false;
+        return false;
+    }
+
+    /* fork 之后子进程只能调用异步信号安全的函数，参数和环境变量提前准备好 */
+    std::vector<char*> argv;
+    for(auto& arg : args)
+    {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    std::string channelEnv = std::string(UPGRADE_ENV) + "=" + std::to_string(UPGRADE_CHANNEL_FD);
+    std::vector<char*> envp;
+    for(char** e = environ; *e; ++e)
+    {
+        if(strncmp(*e, UPGRADE_ENV, strlen(UPGRADE_ENV)) != 0)
+        {
+            envp.push_back(*e);
+        }
+    }
+    envp.push_back(const_cast<char*>(channelEnv.c_str()));
+    envp.push_back(nullptr);
+
+    pid_t pid = fork();
+    if(pid == -1)
+    {
+        close(sv[0]);
+        close(sv[1]);
+        inProgress = false;
+        return false;
+    }
+
+    if(pid == 0)
+    {
+        /* 子进程：只保留标准输入输出和传递通道 */
+        if(sv[1] == UPGRADE_CHANNEL_FD)
+        {
+            fcntl(UPGRADE_CHANNEL_FD, F_SETFD, 0);
+        }
+        else
+        {
+            dup2(sv[1], UPGRADE_CHANNEL_FD);
+        }
+        close_range(UPGRADE_CHANNEL_FD + 1, ~0U, 0);
+
+        execve(exePath.c_str(), argv.data(), envp.data());
+        _exit(127);
+    }
+
+    close(sv[1]);
+
+    /* 把所有监听套接字一次传过去 */
+    char data = 0;
+    iovec iov;
+    iov.iov_base = &data;
+    iov.iov_len = 1;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * listenFds.size()));
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * listenFds.size());
+    memcpy(CMSG_DATA(cmsg), listenFds.data(), sizeof(int) * listenFds.size());
+
+    if(sendmsg(sv[0], &msg, 0) <= 0)
+    {
+        close(sv[0]);
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+        inProgress = false;
+        return false;
+    }
+
+    /* 新进程可能要加载较久，不能阻塞事件循环 */
+    waitThread = std::thread(&Upgrade::waitReady, sv[0], pid);
+    return true;
+}
+
+void Upgrade::waitReady(int channel, int pid)
+{
+    char ok = 0;
+    ssize_t ret = read(channel, &ok, 1);
+    close(channel);
+
+    if(ret == 1 && ok == 1)
+    {
+        #ifdef debug
+            std::cout << "new process " << pid << " ready, draining" << std::endl;
+        #endif
+        EventLoop::drainAll();
+        return;
+    }
+
+    /* 新进程启动失败，继续由本进程提供服务 */
+    std::cout << "upgrade failed, new process " << pid << " exited" << std::endl;
+    waitpid(pid, nullptr, 0);
+    inProgress = false;
+}
+
+void Upgrade::join()
+{
+    if(waitThread.joinable())
+    {
+        waitThread.join();
+    }
+}
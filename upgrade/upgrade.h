@@ -0,0 +1,46 @@
+/**
+ * 平滑升级
+ *  旧进程收到 SIGUSR2 后 fork/exec 新的可执行文件，通过 SCM_RIGHTS 把监听套接字传过去；
+ *  新进程初始化完成（包括加载用户表）后回复一个字节，旧进程随后停止 accept，
+ *  处理完已有的连接再退出。整个过程中监听套接字一直打开，不会出现连接被拒绝。
+ */
+#ifndef UPGRADE_H
+#define UPGRADE_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+class Upgrade
+{
+public:
+    /* 启动时记录可执行文件路径和参数 */
+    static void init(int argc, char** argv);
+
+    /* 新进程：取出旧进程传来的监听套接字，不是由升级启动时返回空 */
+    static std::vector<int> inheritFds();
+
+    /* 新进程：所有 reactor 就绪后通知旧进程 */
+    static void notifyReady();
+
+    /* 旧进程：启动新进程并传递监听套接字，成功后由后台线程等待新进程就绪 */
+    static bool start(const std::vector<int>& listenFds);
+
+    /* 退出前等待后台线程 */
+    static void join();
+
+private:
+    /* 等待新进程就绪，然后让所有事件循环进入排空状态 */
+    static void waitReady(int channel, int pid);
+
+private:
+    static std::string exePath;
+    static std::vector<std::string> args;
+
+    static int readyFd;                     // 新进程：通知旧进程的通道
+    static std::atomic_bool inProgress;     // 旧进程：正在升级
+    static std::thread waitThread;
+};
+
+#endif